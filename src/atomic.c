@@ -0,0 +1,138 @@
+#include "atomic.h"
+
+#include <string.h>
+
+bool atomicOrder(ObjString* name, memory_order* order) {
+  static const struct {
+    const char* name;
+    memory_order order;
+  } orders[] = {{"relaxed", memory_order_relaxed},
+                {"acquire", memory_order_acquire},
+                {"release", memory_order_release},
+                {"acq_rel", memory_order_acq_rel},
+                {"seq_cst", memory_order_seq_cst}};
+
+  flattenString(name);
+  for (size_t idx = 0; idx < sizeof(orders) / sizeof(orders[0]); idx++) {
+    if (strcmp(name->chars, orders[idx].name) == 0) {
+      *order = orders[idx].order;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Failed compare exchanges only load, release semantics are dropped
+static memory_order failureOrder(memory_order order) {
+  switch (order) {
+    case memory_order_release:
+      return memory_order_relaxed;
+    case memory_order_acq_rel:
+      return memory_order_acquire;
+    default:
+      return order;
+  }
+}
+
+void atomicStore(ObjAtomic* atomic, int idx, double value, memory_order order) {
+  switch (atomic->kind) {
+    case ATOMIC_INT64:
+      atomic_store_explicit(&atomic->as.int64[idx], (int64_t)value, order);
+      break;
+    case ATOMIC_FLOAT64:
+      atomic_store_explicit(&atomic->as.float64[idx], value, order);
+      break;
+  }
+}
+
+double atomicLoad(ObjAtomic* atomic, int idx, memory_order order) {
+  switch (atomic->kind) {
+    case ATOMIC_INT64:
+      return (double)atomic_load_explicit(&atomic->as.int64[idx], order);
+    case ATOMIC_FLOAT64:
+      return atomic_load_explicit(&atomic->as.float64[idx], order);
+  }
+
+  return 0;
+}
+
+static int64_t updateInt64(_Atomic int64_t* cell, AtomicOperation operation,
+                           int64_t value, memory_order order) {
+  switch (operation) {
+    case ATOMIC_ADD:
+      return atomic_fetch_add_explicit(cell, value, order);
+    case ATOMIC_SUB:
+      return atomic_fetch_sub_explicit(cell, value, order);
+    case ATOMIC_AND:
+      return atomic_fetch_and_explicit(cell, value, order);
+    case ATOMIC_OR:
+      return atomic_fetch_or_explicit(cell, value, order);
+    case ATOMIC_XOR:
+      return atomic_fetch_xor_explicit(cell, value, order);
+  }
+
+  return 0;
+}
+
+// There are no floating point fetch operations, the sum is retried until no
+// other thread changed the cell in between
+static double updateFloat64(_Atomic double* cell, AtomicOperation operation,
+                            double value, memory_order order) {
+  double previous = atomic_load_explicit(cell, memory_order_relaxed);
+  double delta = operation == ATOMIC_SUB ? -value : value;
+
+  while (!atomic_compare_exchange_weak_explicit(
+      cell, &previous, previous + delta, order, memory_order_relaxed)) {
+  }
+
+  return previous;
+}
+
+double atomicUpdate(ObjAtomic* atomic, int idx, AtomicOperation operation,
+                    double value, memory_order order) {
+  switch (atomic->kind) {
+    case ATOMIC_INT64:
+      return (double)updateInt64(&atomic->as.int64[idx], operation,
+                                 (int64_t)value, order);
+    case ATOMIC_FLOAT64:
+      return updateFloat64(&atomic->as.float64[idx], operation, value, order);
+  }
+
+  return 0;
+}
+
+double atomicExchange(ObjAtomic* atomic, int idx, double value,
+                      memory_order order) {
+  switch (atomic->kind) {
+    case ATOMIC_INT64:
+      return (double)atomic_exchange_explicit(&atomic->as.int64[idx],
+                                              (int64_t)value, order);
+    case ATOMIC_FLOAT64:
+      return atomic_exchange_explicit(&atomic->as.float64[idx], value, order);
+  }
+
+  return 0;
+}
+
+double atomicCompareExchange(ObjAtomic* atomic, int idx, double expected,
+                             double desired, memory_order order) {
+  switch (atomic->kind) {
+    case ATOMIC_INT64: {
+      int64_t previous = (int64_t)expected;
+      atomic_compare_exchange_strong_explicit(&atomic->as.int64[idx],
+                                              &previous, (int64_t)desired,
+                                              order, failureOrder(order));
+      return (double)previous;
+    }
+    case ATOMIC_FLOAT64: {
+      double previous = expected;
+      atomic_compare_exchange_strong_explicit(&atomic->as.float64[idx],
+                                              &previous, desired, order,
+                                              failureOrder(order));
+      return previous;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef atomic_h
+#define atomic_h
+
+#include "object.h"
+
+typedef enum {
+  ATOMIC_ADD,
+  ATOMIC_SUB,
+  ATOMIC_AND,
+  ATOMIC_OR,
+  ATOMIC_XOR
+} AtomicOperation;
+
+// Parses "relaxed", "acquire", "release", "acq_rel" or "seq_cst"
+bool atomicOrder(ObjString* name, memory_order* order);
+
+// Numbers are stored as the cell kind, integer cells expect integers.
+void atomicStore(ObjAtomic* atomic, int idx, double value, memory_order order);
+double atomicLoad(ObjAtomic* atomic, int idx, memory_order order);
+// Read-modify-write operations return the previous value. Bitwise operations
+// are only defined on integer cells.
+double atomicUpdate(ObjAtomic* atomic, int idx, AtomicOperation operation,
+                    double value, memory_order order);
+double atomicExchange(ObjAtomic* atomic, int idx, double value,
+                      memory_order order);
+// Stores desired if the cell holds expected, returns the value held before
+double atomicCompareExchange(ObjAtomic* atomic, int idx, double expected,
+                             double desired, memory_order order);
+
+#endif
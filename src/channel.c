@@ -0,0 +1,224 @@
+#include "channel.h"
+
+#include <pthread.h>
+
+#include "memory.h"
+#include "multithreading.h"
+
+// Bounded queue by Dmitry Vyukov. Each slot sequence tells whose turn it is:
+// the sender of position p claims the slot while its sequence is 2p, and
+// publishes the value setting it to 2p + 1. The receiver of p then frees the
+// slot for the sender of p + capacity. Sequences are doubled so that a
+// single slot channel doesn't mistake its value for a free slot.
+
+static bool enqueue(ObjChannel* channel, Value value) {
+  size_t position = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+
+  for (;;) {
+    ChannelSlot* slot = &channel->slots[position % channel->capacity];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)(2 * position);
+
+    if (difference == 0) {
+      if (atomic_compare_exchange_weak_explicit(
+              &channel->tail, &position, position + 1, memory_order_relaxed,
+              memory_order_relaxed)) {
+        slot->value = value;
+        atomic_store_explicit(&slot->sequence, 2 * position + 1,
+                              memory_order_release);
+        return true;
+      }
+    } else if (difference < 0) {
+      // Full, the slot wasn't received yet
+      return false;
+    } else {
+      position = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+    }
+  }
+}
+
+static bool dequeue(ObjChannel* channel, Value* value) {
+  size_t position = atomic_load_explicit(&channel->head, memory_order_relaxed);
+
+  for (;;) {
+    ChannelSlot* slot = &channel->slots[position % channel->capacity];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)(2 * position + 1);
+
+    if (difference == 0) {
+      if (atomic_compare_exchange_weak_explicit(
+              &channel->head, &position, position + 1, memory_order_relaxed,
+              memory_order_relaxed)) {
+        *value = slot->value;
+        slot->value = NIL_VAL;
+        atomic_store_explicit(&slot->sequence,
+                              2 * (position + channel->capacity),
+                              memory_order_release);
+        return true;
+      }
+    } else if (difference < 0) {
+      // Empty, the slot wasn't sent yet
+      return false;
+    } else {
+      position = atomic_load_explicit(&channel->head, memory_order_relaxed);
+    }
+  }
+}
+
+int channelLength(ObjChannel* channel) {
+  size_t head = atomic_load(&channel->head);
+  size_t tail = atomic_load(&channel->tail);
+
+  // Claimed positions may be ahead of the values written
+  if (tail <= head) return 0;
+  return tail - head > (size_t)channel->capacity ? channel->capacity
+                                                 : (int)(tail - head);
+}
+
+static bool isReady(ObjChannel* channel) {
+  return channelLength(channel) > 0 || atomic_load(&channel->closed);
+}
+
+// Blocked threads count themselves as waiting before checking the channel
+// again under the mutex, so that either they see the change or the thread
+// changing the channel sees them.
+static void notify(ObjChannel* channel) {
+  signalWakeup(&vm.channelsWakeup);
+
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&channel->waiting) == 0) return;
+
+  pthread_mutex_lock(&vm.channelsMutex);
+  pthread_cond_broadcast(&vm.channelsCond);
+  pthread_mutex_unlock(&vm.channelsMutex);
+}
+
+ChannelStatus channelSend(Thread* program, ObjChannel* channel, Value value,
+                          bool block) {
+  for (;;) {
+    if (atomic_load(&channel->closed)) return CHANNEL_CLOSED;
+
+    if (enqueue(channel, value)) {
+      notify(channel);
+      return CHANNEL_OK;
+    }
+
+    if (!block) return CHANNEL_BUSY;
+
+    if (program->green) {
+      lockWakeup(&vm.channelsWakeup);
+      if (channelLength(channel) == channel->capacity &&
+          !atomic_load(&channel->closed)) {
+        awaitWakeup(program, &vm.channelsWakeup);
+        return CHANNEL_BUSY;
+      }
+      unlockWakeup(&vm.channelsWakeup);
+      continue;
+    }
+
+    atomic_fetch_add(&channel->waiting, 1);
+    enterGCSafezone(program);
+    pthread_mutex_lock(&vm.channelsMutex);
+    while (channelLength(channel) == channel->capacity &&
+           !atomic_load(&channel->closed)) {
+      pthread_cond_wait(&vm.channelsCond, &vm.channelsMutex);
+    }
+    pthread_mutex_unlock(&vm.channelsMutex);
+    leaveGCSafezone(program);
+    atomic_fetch_sub(&channel->waiting, 1);
+  }
+}
+
+ChannelStatus channelReceive(Thread* program, ObjChannel* channel,
+                             Value* value, bool block) {
+  Value channelValue = OBJ_VAL(channel);
+  bool closed;
+
+  if (channelSelect(program, &channelValue, 1, value, &closed, block) < 0) {
+    return CHANNEL_BUSY;
+  }
+  return closed ? CHANNEL_CLOSED : CHANNEL_OK;
+}
+
+void channelClose(ObjChannel* channel) {
+  atomic_store(&channel->closed, true);
+
+  pthread_mutex_lock(&vm.channelsMutex);
+  pthread_cond_broadcast(&vm.channelsCond);
+  pthread_mutex_unlock(&vm.channelsMutex);
+  signalWakeup(&vm.channelsWakeup);
+}
+
+static bool isAnyReady(Value* channels, int count) {
+  for (int idx = 0; idx < count; idx++) {
+    if (isReady(AS_CHANNEL(channels[idx]))) return true;
+  }
+
+  return false;
+}
+
+static int receiveAny(Value* channels, int count, Value* value,
+                      bool* closed) {
+  for (int idx = 0; idx < count; idx++) {
+    ObjChannel* channel = AS_CHANNEL(channels[idx]);
+
+    if (dequeue(channel, value)) {
+      notify(channel);
+      *closed = false;
+      return idx;
+    }
+  }
+
+  // Closed channels are done once drained, values may still be sent right
+  // before closing
+  for (int idx = 0; idx < count; idx++) {
+    ObjChannel* channel = AS_CHANNEL(channels[idx]);
+    if (!atomic_load(&channel->closed)) continue;
+
+    *closed = !dequeue(channel, value);
+    if (*closed) {
+      *value = NIL_VAL;
+    } else {
+      notify(channel);
+    }
+    return idx;
+  }
+
+  return -1;
+}
+
+int channelSelect(Thread* program, Value* channels, int count, Value* value,
+                  bool* closed, bool block) {
+  for (;;) {
+    int ready = receiveAny(channels, count, value, closed);
+    if (ready >= 0 || !block) return ready;
+
+    if (program->green) {
+      lockWakeup(&vm.channelsWakeup);
+      if (!isAnyReady(channels, count)) {
+        awaitWakeup(program, &vm.channelsWakeup);
+        return -1;
+      }
+      unlockWakeup(&vm.channelsWakeup);
+      continue;
+    }
+
+    for (int idx = 0; idx < count; idx++) {
+      atomic_fetch_add(&AS_CHANNEL(channels[idx])->waiting, 1);
+    }
+
+    enterGCSafezone(program);
+    pthread_mutex_lock(&vm.channelsMutex);
+    while (!isAnyReady(channels, count)) {
+      pthread_cond_wait(&vm.channelsCond, &vm.channelsMutex);
+    }
+    pthread_mutex_unlock(&vm.channelsMutex);
+    leaveGCSafezone(program);
+
+    for (int idx = 0; idx < count; idx++) {
+      atomic_fetch_sub(&AS_CHANNEL(channels[idx])->waiting, 1);
+    }
+  }
+}
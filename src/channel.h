@@ -0,0 +1,32 @@
+#ifndef channel_h
+#define channel_h
+
+#include "object.h"
+#include "vm.h"
+
+typedef enum {
+  CHANNEL_OK,
+  // Non-blocking operation that would block
+  CHANNEL_BUSY,
+  // Send on a closed channel, or receive on a closed and empty one
+  CHANNEL_CLOSED
+} ChannelStatus;
+
+// Blocking operations wait in a GC safezone, no objects are allocated. Green
+// threads rather fail as when not blocking and are suspended, the calling
+// native is retried once a channel changes.
+ChannelStatus channelSend(Thread* program, ObjChannel* channel, Value value,
+                          bool block);
+ChannelStatus channelReceive(Thread* program, ObjChannel* channel,
+                             Value* value, bool block);
+// Wakes up every thread blocked on the channel. Values sent before are still
+// received.
+void channelClose(ObjChannel* channel);
+int channelLength(ObjChannel* channel);
+// Receives from the first channel of channels with a value, or else closed
+// and drained, which index is returned. Fails (-1) when not blocking and none
+// is ready.
+int channelSelect(Thread* program, Value* channels, int count, Value* value,
+                  bool* closed, bool block);
+
+#endif
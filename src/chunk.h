@@ -19,6 +19,7 @@ typedef enum {
   OP_GET_ITEM,
   OP_SET_ITEM,
   OP_INVOKE,
+  OP_TAIL_INVOKE,
   OP_GET_UPVALUE,
   OP_SET_UPVALUE,
   OP_TRUE,
@@ -42,8 +43,12 @@ typedef enum {
   OP_NAMED_LOOP,
   OP_RANGED_LOOP_SETUP,
   OP_RANGED_LOOP,
+  OP_RANGED_LOOP_INT_UP,
+  OP_RANGED_LOOP_INT_DOWN,
+  OP_RANGED_LOOP_RESTART,
   OP_LOOP,
   OP_CALL,
+  OP_TAIL_CALL,
   OP_CLOSURE,
   OP_CLOSE_UPVALUE,
   OP_CLASS,
@@ -57,6 +62,7 @@ typedef enum {
   OP_THROW,
   OP_OBJECT,
   OP_SWITCH,
+  OP_SWITCH_TABLE,
   OP_SWITCH_BREAK,
   OP_SWITCH_DEFAULT,
   OP_SWITCH_END,
@@ -42,6 +42,13 @@
     #define DEBUG_LOG_GC_SAFEZONE
 #endif
 
+// Hash and scan strings a word (8 bytes) at a time when the compiler provides
+// 128-bit multiplication, otherwise fall back to byte-wise routines.
+// Build with -DSCALAR_STRINGS to force the byte-wise routines.
+#if defined(__SIZEOF_INT128__) && !defined(SCALAR_STRINGS)
+    #define WORD_STRINGS
+#endif
+
 // Total values handled by 1 byte or uint8_t 
 #define UINT8_COUNT (UINT8_MAX + 1)
 
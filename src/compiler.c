@@ -153,6 +153,10 @@ typedef struct Compiler {
 
   // Modules are expected to use the export statement just once.  
   bool hasExported; 
+
+  // Address of the last emitted call or invoke instruction. Used to detect
+  // calls in tail position.
+  int lastCall;
 } Compiler;
 
 ObjFunction* compile(const char* source, char* absPath);
@@ -340,6 +344,10 @@ static void sugaredForStatement();
 // Parse plain for statements or call sugaredForStatement
 static void forStatement();
 
+// Turn the last emitted call into a tail call if it is the last instruction of
+// the return expression
+static void markTailCall();
+
 // Parse return statement
 static void returnStatement();
 
@@ -370,6 +378,15 @@ static void throwStatement();
 // Parse break statement
 static void breakStatement();
 
+// Check if the case expression compiled from "expressionStart" is a constant
+// number or string, writing it to "key"
+static bool caseConstant(int expressionStart, Value* key);
+
+// Patch a switch whose cases are all constants into a jump table dispatch
+static void emitSwitchJumpTable(int switchJump, Value* caseKeys,
+                                int* caseGroups, int* caseStarts,
+                                int caseCount);
+
 // Parse switch statement
 static void switchStatement();
 
@@ -448,20 +465,23 @@ bool isValidIdentifier(Token* token);
 // Parse object literal
 void object(bool canAssign);
 
+// Compiler state is per thread, VMs running on different threads compile
+// independently.
+
 // Modules graph
-Modules modules;
+static _Thread_local Modules modules;
 
 // Compiler current parser
-Parser parser;
+static _Thread_local Parser parser;
 
 // Current compiler
-Compiler* current;
+static _Thread_local Compiler* current;
 
 // Current class, if defined, compiler helper
-ClassCompiler* currentClass;
+static _Thread_local ClassCompiler* currentClass;
 
 // Entry file absolute path
-char* basePath;
+static _Thread_local char* basePath;
 
 #define GLOBAL_VARIABLES() (current->scopeDepth == 0)
 
@@ -477,6 +497,7 @@ static void initCompiler(Compiler* compiler, char* absPath, FunctionType type) {
   compiler->scopeDepth = 0;
   compiler->blockStackCount = 0;
   compiler->hasExported = false;
+  compiler->lastCall = -1;
 
   current = compiler;
 
@@ -1086,14 +1107,19 @@ static void forInRangeStatement(int iterationVariableConstant) {
   // track "step" variable
   addSystemLocalVariable();
 
-  emitByte(OP_RANGED_LOOP_SETUP);
   int loopGuard = emitLoopGuard() + 2;
-  int loopStart = currentChunk()->count;
+  emitByte(OP_RANGED_LOOP_SETUP);
+
+  // The setup instruction picks one of these loop heads at runtime and stores
+  // it as the loop start address. Integral ranges, the most common ones, are
+  // counted with unboxed integers and a direction specialized comparison.
   emitByte(OP_RANGED_LOOP);
+  emitByte(OP_RANGED_LOOP_INT_UP);
+  emitByte(OP_RANGED_LOOP_INT_DOWN);
 
   statement();
 
-  emitLoop(loopStart);
+  emitByte(OP_RANGED_LOOP_RESTART);
   patchJump(loopGuard, 2);
   emitByte(OP_LOOP_GUARD_END);
 
@@ -1261,6 +1287,19 @@ static void forStatement() {
   endLoop();
 }
 
+static void markTailCall() {
+  Chunk* chunk = currentChunk();
+  int offset = current->lastCall;
+
+  if (offset < 0) return;
+
+  if (chunk->code[offset] == OP_CALL && offset + 2 == chunk->count) {
+    chunk->code[offset] = OP_TAIL_CALL;
+  } else if (chunk->code[offset] == OP_INVOKE && offset + 3 == chunk->count) {
+    chunk->code[offset] = OP_TAIL_INVOKE;
+  }
+}
+
 static void returnStatement() {
   if (current->semanticallyEnclosing == NULL) {
     error("Cannot return outside a function.");
@@ -1275,6 +1314,7 @@ static void returnStatement() {
 
     expression();
     consume(TOKEN_SEMICOLON, "Expect ';' after return expression.");
+    markTailCall();
     emitByte(OP_RETURN);
   }
 }
@@ -1490,6 +1530,55 @@ static void continueStatement() {
   consume(TOKEN_SEMICOLON, "Expect ';' after continue statement.");
 }
 
+static bool caseConstant(int expressionStart, Value* key) {
+  Chunk* chunk = currentChunk();
+  int length = chunk->count - expressionStart;
+  uint8_t* code = &chunk->code[expressionStart];
+
+  if (length < 2 || code[0] != OP_CONSTANT) return false;
+
+  Value value = chunk->constants.values[code[1]];
+
+  if (length == 2 && (IS_NUMBER(value) || IS_STRING(value))) {
+    *key = value;
+    return true;
+  }
+
+  // Negative number literals are compiled as a constant followed by a negation
+  if (length == 3 && code[2] == OP_NEGATE && IS_NUMBER(value)) {
+    *key = NUMBER_VAL(-AS_NUMBER(value));
+    return true;
+  }
+
+  return false;
+}
+
+static void emitSwitchJumpTable(int switchJump, Value* caseKeys,
+                                int* caseGroups, int* caseStarts,
+                                int caseCount) {
+  Chunk* chunk = currentChunk();
+
+  // The jump table constant index is written in place of the OP_SWITCH out
+  // offset, hence it must fit in two bytes.
+  if (chunk->constants.count > UINT16_MAX) return;
+
+  ObjJumpTable* table = newJumpTable(caseCount);
+  int tableConstant = addConstant(chunk, OBJ_VAL(table));
+  // Offsets are relative to the address right after the OP_SWITCH_TABLE
+  int switchStart = switchJump + 2;
+
+  // The out address is the OP_SWITCH_END instruction
+  table->outOffset = chunk->count - switchStart;
+
+  for (int idx = 0; idx < caseCount; idx++) {
+    jumpTableSet(table, caseKeys[idx], caseStarts[caseGroups[idx]] - switchStart);
+  }
+
+  chunk->code[switchJump - 1] = OP_SWITCH_TABLE;
+  chunk->code[switchJump] = (tableConstant >> 8) & 0xff;
+  chunk->code[switchJump + 1] = tableConstant & 0xff;
+}
+
 static void switchStatement() {
   consume(TOKEN_LEFT_PAREN, "Expect '(' before switch expression.");
 
@@ -1500,6 +1589,18 @@ static void switchStatement() {
   int switchJump = emitJump(OP_SWITCH);
   int defaultStart = -1;
 
+  // Constant cases tracking. If every case is a constant number or string,
+  // the switch is dispatched through a jump table instead of comparing each
+  // case in sequence.
+  bool constantCases = true;
+  Value caseKeys[UINT8_COUNT];
+  // Case group index of each case key
+  int caseGroups[UINT8_COUNT];
+  // Case group statement start address
+  int caseStarts[UINT8_COUNT];
+  int caseCount = 0;
+  int caseGroupCount = 0;
+
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after switch expression.");
   consume(TOKEN_LEFT_BRACE, "Expect '{' before switch body.");
 
@@ -1508,15 +1609,25 @@ static void switchStatement() {
         parser.previous.type == TOKEN_CASE ? OP_SWITCH_CASE : OP_SWITCH_DEFAULT;
 
     if (instruction == OP_SWITCH_CASE) {
-      expression();
-
-      consume(TOKEN_COLON, "Expect ':' after case expression.");
-
-      while (match(TOKEN_CASE)) {
+      do {
+        int expressionStart = currentChunk()->count;
         expression();
         consume(TOKEN_COLON, "Expect ':' after case expression.");
-      }
+
+        if (constantCases && caseCount < UINT8_COUNT &&
+            caseConstant(expressionStart, &caseKeys[caseCount])) {
+          caseGroups[caseCount++] = caseGroupCount;
+        } else {
+          constantCases = false;
+        }
+      } while (match(TOKEN_CASE));
+
       int caseJump = emitJump(OP_SWITCH_CASE);
+      if (caseGroupCount < UINT8_COUNT) {
+        caseStarts[caseGroupCount++] = currentChunk()->count;
+      } else {
+        constantCases = false;
+      }
       statement();
       patchJump(caseJump, 2);
     } else {
@@ -1539,6 +1650,12 @@ static void switchStatement() {
   }
 
   patchJump(switchJump, 2);
+
+  if (constantCases && caseCount > 0) {
+    emitSwitchJumpTable(switchJump, caseKeys, caseGroups, caseStarts,
+                        caseCount);
+  }
+
   int defaultOffset =
       defaultStart != -1 ? currentChunk()->count - defaultStart + 3 : 0;
 
@@ -1615,6 +1732,8 @@ ObjFunction* compile(const char* source, char* absPath) {
   bool hasModulesSupport = absPath != NULL;
 
   Compiler compiler;
+  struct Compiler** enclosingRoots = vm.compiler;
+  vm.compiler = &current;
   initLexer(source);
   initCompiler(&compiler, absPath, TYPE_SCRIPT);
   if (hasModulesSupport) initModules(&modules, absPath);
@@ -1632,6 +1751,7 @@ ObjFunction* compile(const char* source, char* absPath) {
 
   ObjFunction* function = (ObjFunction*)GCWhiteList((Obj*)endCompiler());
   if (hasModulesSupport) freeModules(&modules);
+  vm.compiler = enclosingRoots;
   GCPopWhiteList();
 
   if (parser.hadError) {
@@ -1643,7 +1763,9 @@ ObjFunction* compile(const char* source, char* absPath) {
 }
 
 void markCompilerRoots() {
-  Compiler* compiler = current;
+  // Called from the collector thread, the compiling thread is in the
+  // safezone
+  Compiler* compiler = vm.compiler != NULL ? *vm.compiler : NULL;
   while (compiler != NULL) {
     markObject((Obj*)compiler->function);
     compiler = compiler->enclosing;
@@ -1664,6 +1786,7 @@ static void grouping(bool canAssign) {
       block();
     } else {
       expression();
+      markTailCall();
       emitByte(OP_RETURN);
     }
 
@@ -1708,6 +1831,7 @@ static void grouping(bool canAssign) {
         block();
       } else {
         expression();
+        markTailCall();
         emitByte(OP_RETURN);
       }
 
@@ -1736,6 +1860,7 @@ static void grouping(bool canAssign) {
           block();
         } else {
           expression();
+          markTailCall();
           emitByte(OP_RETURN);
         }
 
@@ -1907,9 +2032,17 @@ static ObjString* escapeString() {
   return copyString(buffer, scapedLength);
 }
 
+// The template is split in literal segments around the placeholders, so that
+// the VM doesn't have to scan it again:
+//
+//   "a $(x) b $(y)" -> segments ["a ", " b ", ""] and the values x, y stacked.
 static void stringInterpolation(bool canAssign) {
   ObjString* template = (ObjString*)GCWhiteList((Obj*)escapeString());
-  uint8_t placeholdersCount = 0;
+  int placeholdersCount = 0;
+  // Segment i spans [segmentStarts[i], segmentEnds[i]) in the template
+  int segmentStarts[UINT8_COUNT];
+  int segmentEnds[UINT8_COUNT];
+  int segmentStart = 0;
 
   // Iterate through string template and scan/compile every placeholder
   // expression.
@@ -1917,12 +2050,15 @@ static void stringInterpolation(bool canAssign) {
     // template placeholder slot found
     if (template->chars[idx] == '$' && idx + 1 < template->length &&
         template->chars[idx + 1] == '(') {
-      placeholdersCount++;
-
-      if (placeholdersCount > UINT8_MAX) {
+      if (placeholdersCount == UINT8_MAX) {
         error("Can't have more than 255 string interpolation placeholders.");
+        break;
       }
 
+      segmentStarts[placeholdersCount] = segmentStart;
+      segmentEnds[placeholdersCount] = idx;
+      placeholdersCount++;
+
       // skip "$(" chars
       idx += 2;
       int interpolationStart = idx;
@@ -1970,11 +2106,30 @@ static void stringInterpolation(bool canAssign) {
       // setup previous lexer and parser back
       popLexer();
       parser = previousParser;
+
+      segmentStart = idx + 1;
     }
   }
 
+  segmentStarts[placeholdersCount] = segmentStart;
+  segmentEnds[placeholdersCount] = template->length;
+
+  ObjArray* segments = (ObjArray*)GCWhiteList((Obj*)newArray());
+
+  for (int idx = 0; idx <= placeholdersCount; idx++) {
+    ObjString* segment = (ObjString*)GCWhiteList(
+        (Obj*)copyString(&template->chars[segmentStarts[idx]],
+                         segmentEnds[idx] - segmentStarts[idx]));
+    writeValueArray(&segments->list, OBJ_VAL(segment));
+    GCPopWhiteList();
+  }
+
+  emitBytes(OP_STRING_INTERPOLATION, makeConstant(OBJ_VAL(segments)));
+
+  // Pop segments
+  GCPopWhiteList();
+  // Pop template
   GCPopWhiteList();
-  emitBytes(OP_STRING_INTERPOLATION, makeConstant(OBJ_VAL(template)));
 }
 
 static void string(bool canAssign) { emitConstant(OBJ_VAL(escapeString())); }
@@ -2122,6 +2277,7 @@ static uint8_t argumentsList() {
 
 static void call(bool canAssign) {
   uint8_t argCount = argumentsList();
+  current->lastCall = currentChunk()->count;
   emitBytes(OP_CALL, argCount);
 }
 
@@ -2162,6 +2318,7 @@ static void propertyGetOrSet(bool canAssign) {
     emitBytes(OP_SET_PROPERTY, name);
   } else if (match(TOKEN_LEFT_PAREN)) {
     uint8_t args = argumentsList();
+    current->lastCall = currentChunk()->count;
     emitBytes(OP_INVOKE, name);
     emitByte(args);
   } else {
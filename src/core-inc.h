@@ -92,6 +92,52 @@ char* coreExtension =
     "    return acc;     \n"
     "  }\n"
     "\n"
+    "  // Parallel operations run the callback on the workers pool, over chunks of\n"
+    "  // the array. Chunks are sized by the runtime.\n"
+    "  parallelMap(callback) {\n"
+    "    var newArray = Array.new(this.length());\n"
+    "\n"
+    "    this.__parallelChunks((start, end) -> {\n"
+    "      for idx in range(start, end) {\n"
+    "        newArray[idx] = callback(this[idx], idx, this);\n"
+    "      }\n"
+    "    });\n"
+    "\n"
+    "    return newArray;\n"
+    "  }\n"
+    "\n"
+    "  parallelForEach(callback) {\n"
+    "    this.__parallelChunks((start, end) -> {\n"
+    "      for idx in range(start, end) {\n"
+    "        callback(this[idx], idx, this);\n"
+    "      }\n"
+    "    });\n"
+    "  }\n"
+    "\n"
+    "  // The reducer must be associative, chunks are reduced apart and their\n"
+    "  // results are combined in order.\n"
+    "  parallelReduce(callback) {\n"
+    "    var partials = this.__parallelChunks((start, end) -> {\n"
+    "      var acc = this[start];\n"
+    "\n"
+    "      for idx in range(start + 1, end) {\n"
+    "        acc = callback(acc, this[idx]);\n"
+    "      }\n"
+    "\n"
+    "      return acc;\n"
+    "    });\n"
+    "\n"
+    "    return partials.reduce((acc, partial) -> callback(acc, partial));\n"
+    "  }\n"
+    "\n"
+    "  parallelReduce(callback, acc) {\n"
+    "    if (this.length() == 0) {\n"
+    "      return acc;\n"
+    "    }\n"
+    "\n"
+    "    return callback(acc, this.parallelReduce(callback));\n"
+    "  }\n"
+    "\n"
     "  sort() {\n"
     "    return this.sort((a, b) -> a < b);\n"
     "  }\n"
@@ -125,7 +171,7 @@ char* coreExtension =
     "      if (left >= right) return;\n"
     "      var pi = partition(left, right);\n"
     "      quickSort(left, pi - 1);\n"
-    "      quickSort(pi + 1, right);\n"
+    "      return quickSort(pi + 1, right);\n"
     "    } \n"
     "\n"
     "    quickSort(0, this.length() - 1);\n"
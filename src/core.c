@@ -1,19 +1,28 @@
 #include "core.h"
 
+#include <errno.h>
+#include <limits.h>
 #include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "common.h"
+#include "atomic.h"
+#include "channel.h"
+#include "isolate.h"
 #include "core-inc.h"
+#include "events.h"
+#include "fs.h"
 #include "modules-inc.h"
 #include "memory.h"
 #include "multithreading.h"
 #include "object.h"
 #include "utils.h"
 #include "value.h"
+#include "vector.h"
 
 // Return from native function
 #define NATIVE_RETURN(thread, value) \
@@ -29,6 +38,16 @@
     return false;                                  \
   } while (false)
 
+// Throw error from native function, followed by the last system call error
+#define NATIVE_SYSTEM_ERROR(thread, value)                               \
+  do {                                                                   \
+    char buffer[256];                                                    \
+    int length = snprintf(buffer, sizeof(buffer), "%s: %s.", value,      \
+                          strerror(errno));                              \
+    push(thread, OBJ_VAL(copyString(buffer, length)));                   \
+    return false;                                                        \
+  } while (false)
+
 // Safely consume next argument as number, otherwise throw error
 #define SAFE_CONSUME_NUMBER(thread, args, name)                        \
   (double)(IS_NUMBER(*(++args)) ? AS_NUMBER(*args) : ({                \
@@ -40,13 +59,13 @@
   }))
 
 // Safely consume next argument as string, otherwise throw error
-#define SAFE_CONSUME_STRING(thread, args, name)                        \
-  (ObjString *)(IS_STRING(*(++args)) ? AS_STRING(*args) : ({           \
-    char *buffer = ALLOCATE(char, 64);                                 \
-    int length = sprintf(buffer, "Expected %s to be a string.", name); \
-    push(thread, OBJ_VAL(takeString(buffer, length)));                 \
-    return false;                                                      \
-    NULL;                                                              \
+#define SAFE_CONSUME_STRING(thread, args, name)                           \
+  (ObjString *)(IS_STRING(*(++args)) ? flattenRope(AS_STRING(*args)) : ({ \
+    char *buffer = ALLOCATE(char, 64);                                    \
+    int length = sprintf(buffer, "Expected %s to be a string.", name);    \
+    push(thread, OBJ_VAL(takeString(buffer, length)));                    \
+    return false;                                                         \
+    NULL;                                                                 \
   }))
 
 // Safely consume next argument as object instance, otherwise throw error
@@ -347,7 +366,7 @@ static inline bool __nativeArrayJoin(void *thread, int argCount, Value *args) {
   // Pop tmpArray from GC white list
   GCPopWhiteList();
 
-  NATIVE_RETURN(thread, OBJ_VAL(takeString(buffer, length)));
+  NATIVE_RETURN(thread, OBJ_VAL(takeTransientString(buffer, length)));
 }
 
 static inline bool __nativeArrayReverse(void *thread, int argCount,
@@ -390,6 +409,19 @@ static inline bool __nativeArrayTake(void *thread, int argCount, Value *args) {
   NATIVE_RETURN(thread, OBJ_VAL(responseArray));
 }
 
+// Runs function(start, end) over the array chunks on the workers pool
+static inline bool __nativeArrayParallelChunks(void *thread, int argCount,
+                                               Value *args) {
+  ObjArray *array = AS_ARRAY(*args);
+  ObjClosure *function = SAFE_CONSUME_FUNCTION(thread, args, "argument");
+
+  if (!runParallel(thread, function, array->list.count)) {
+    NATIVE_ERROR(thread, "Can't spawn new thread.");
+  }
+
+  return true;
+}
+
 static inline bool __nativeStaticArrayIsArray(void *thread, int argCount,
                                               Value *args) {
   Value value = *(++args);
@@ -420,14 +452,52 @@ static inline bool __nativeStaticArrayNew(void *thread, int argCount,
 }
 
 static inline bool __nativeSystemLog(void *thread, int argCount, Value *args) {
-  printValue(*(++args));
-  printf("\n");
+  OutputBuffer *output = &((Thread *)thread)->output;
+
+  beginOutputLine(output);
+  writeValue(output, *(++args));
+  endOutputLine(&vm.output, output);
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeSystemFlush(void *thread, int argCount,
+                                       Value *args) {
+  outputFlush(&vm.output, &((Thread *)thread)->output);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool isFlushPolicy(ObjString *policy, const char *name) {
+  return policy->length == (int)strlen(name) &&
+         memcmp(policy->chars, name, policy->length) == 0;
+}
+
+static inline bool __nativeSystemFlushPolicy(void *thread, int argCount,
+                                             Value *args) {
+  ObjString *policy = SAFE_CONSUME_STRING(thread, args, "policy");
+
+  if (isFlushPolicy(policy, "line")) {
+    vm.output.policy = FLUSH_LINE;
+  } else if (isFlushPolicy(policy, "size")) {
+    vm.output.policy = FLUSH_SIZE;
+  } else if (isFlushPolicy(policy, "explicit")) {
+    vm.output.policy = FLUSH_EXPLICIT;
+  } else {
+    NATIVE_ERROR(thread,
+                 "Expected policy to be \"line\", \"size\" or \"explicit\".");
+  }
+
+  // Lines buffered under the previous policy are not held back
+  outputFlush(&vm.output, &((Thread *)thread)->output);
   NATIVE_RETURN(thread, NIL_VAL);
 }
 
 static inline bool __nativeSystemScan(void *thread, int argCount, Value *args) {
   char buffer[1024];
 
+  // Prompts must be visible before waiting for input
+  outputFlush(&vm.output, &((Thread *)thread)->output);
+
   if (fgets(buffer, 1024, stdin) == NULL) {
     fflush(stdin);
     NATIVE_ERROR(thread, "Unexpected scan error.");
@@ -437,7 +507,7 @@ static inline bool __nativeSystemScan(void *thread, int argCount, Value *args) {
   // replace new line with null terminator
   buffer[strcspn(buffer, "\n")] = 0;
 
-  NATIVE_RETURN(thread, OBJ_VAL(copyString(buffer, strlen(buffer))));
+  NATIVE_RETURN(thread, OBJ_VAL(copyTransientString(buffer, strlen(buffer))));
 }
 
 static inline bool __nativeSystemClock(void *thread, int argCount,
@@ -448,44 +518,34 @@ static inline bool __nativeSystemClock(void *thread, int argCount,
 static inline bool __nativeStringHash(void* thread, int argCount, Value *args) {
   ObjString* string = AS_STRING(*args);
   
-  NATIVE_RETURN(thread, NUMBER_VAL(string->hash));
+  NATIVE_RETURN(thread, NUMBER_VAL(stringHash(string)));
 }
 
 static inline bool __nativeStringToUpperCase(void *thread, int argCount,
                                              Value *args) {
-  ObjString *string = AS_STRING(*args);
-  char buffer[string->length];
+  ObjString *string = flattenRope(AS_STRING(*args));
+  char *buffer = ALLOCATE(char, string->length + 1);
 
-  for (int idx = 0; idx < string->length; idx++) {
-    if (string->chars[idx] >= 'a' && string->chars[idx] <= 'z') {
-      buffer[idx] = string->chars[idx] - ASCII_UPPERCASE_TO_LOWERCASE_OFFSET;
-    } else {
-      buffer[idx] = string->chars[idx];
-    }
-  }
+  copyUpperCase(buffer, string->chars, string->length);
+  buffer[string->length] = '\0';
 
-  NATIVE_RETURN(thread, OBJ_VAL(copyString(buffer, string->length)));
+  NATIVE_RETURN(thread, OBJ_VAL(takeTransientString(buffer, string->length)));
 }
 
 static inline bool __nativeStringToLowerCase(void *thread, int argCount,
                                              Value *args) {
-  ObjString *string = AS_STRING(*args);
-  char buffer[string->length];
+  ObjString *string = flattenRope(AS_STRING(*args));
+  char *buffer = ALLOCATE(char, string->length + 1);
 
-  for (int idx = 0; idx < string->length; idx++) {
-    if (string->chars[idx] >= 'A' && string->chars[idx] <= 'Z') {
-      buffer[idx] = string->chars[idx] + ASCII_UPPERCASE_TO_LOWERCASE_OFFSET;
-    } else {
-      buffer[idx] = string->chars[idx];
-    }
-  }
+  copyLowerCase(buffer, string->chars, string->length);
+  buffer[string->length] = '\0';
 
-  NATIVE_RETURN(thread, OBJ_VAL(copyString(buffer, string->length)));
+  NATIVE_RETURN(thread, OBJ_VAL(takeTransientString(buffer, string->length)));
 }
 
 static inline bool __nativeStringIncludes(void *thread, int argCount,
                                           Value *args) {
-  ObjString *string = AS_STRING(*args);
+  ObjString *string = flattenRope(AS_STRING(*args));
   ObjString *searchString = SAFE_CONSUME_STRING(thread, args, "searchString");
   int start = 0;
 
@@ -498,61 +558,55 @@ static inline bool __nativeStringIncludes(void *thread, int argCount,
     NATIVE_RETURN(thread, TRUE_VAL);
   }
 
-  for (int i = start; i < string->length; i++) {
-    int j = 0;
-    while (i + j < string->length && j < searchString->length &&
-           string->chars[i + j] == searchString->chars[j]) {
-      j++;
-    }
-
-    if (j == searchString->length) {
-      NATIVE_RETURN(thread, TRUE_VAL);
-    }
-  }
+  int index = findSubstring(string->chars, string->length, searchString->chars,
+                            searchString->length, start);
 
-  NATIVE_RETURN(thread, FALSE_VAL);
+  NATIVE_RETURN(thread, BOOL_VAL(index != -1));
 }
 
 static inline bool __nativeStringSplit(void *thread, int argCount,
                                        Value *args) {
-  ObjString *string = AS_STRING(*args);
+  ObjString *string = flattenRope(AS_STRING(*args));
   ObjString *separator = SAFE_CONSUME_STRING(thread, args, "separator");
   ObjArray *response = newArray();
 
   // push beforehand to the stack to protect from the GC
   push(thread, OBJ_VAL(response));
 
-  int k = 0;
-  for (int i = 0; i < string->length; i++) {
-    int j = 0;
-
-    while (i + j < string->length && j < separator->length &&
-           string->chars[i + j] == separator->chars[j]) {
-      j++;
-    }
-
-    // separator found
-    if (j == separator->length) {
-      ObjString *segment = (ObjString *)GCWhiteList((Obj *)copyString(
-          &string->chars[k], i - k + (separator->length == 0)));
+  // Empty separator splits every char
+  if (separator->length == 0) {
+    for (int i = 0; i < string->length; i++) {
+      ObjString *segment =
+          (ObjString *)GCWhiteList((Obj *)newStringSlice(string, i, 1));
       writeValueArray(&response->list, OBJ_VAL(segment));
       GCPopWhiteList();
-      k = i + (separator->length == 0 ? 1 : j);
-      i = i + (separator->length == 0 ? 0 : j - 1);
     }
+
+    return true;
   }
 
-  if (separator->length > 0) {
-    writeValueArray(&response->list,
-                    OBJ_VAL(copyString(&string->chars[k], string->length - k)));
+  int k = 0;
+  int i;
+  while ((i = findSubstring(string->chars, string->length, separator->chars,
+                            separator->length, k)) != -1) {
+    ObjString *segment = (ObjString *)GCWhiteList(
+        (Obj *)newStringSlice(string, k, i - k));
+    writeValueArray(&response->list, OBJ_VAL(segment));
+    GCPopWhiteList();
+    k = i + separator->length;
   }
 
+  ObjString *segment = (ObjString *)GCWhiteList(
+      (Obj *)newStringSlice(string, k, string->length - k));
+  writeValueArray(&response->list, OBJ_VAL(segment));
+  GCPopWhiteList();
+
   return true;
 }
 
 static inline bool __nativeStringSubstr(void *thread, int argCount,
                                         Value *args) {
-  ObjString *string = AS_STRING(*args);
+  ObjString *string = flattenRope(AS_STRING(*args));
   int start = 0;
   int end = string->length;
 
@@ -565,13 +619,8 @@ static inline bool __nativeStringSubstr(void *thread, int argCount,
   }
 
   int length = (end - start) > 0 ? end - start : 0;
-  char buffer[length];
-
-  for (int idx = start; idx < end; idx++) {
-    buffer[idx - start] = string->chars[idx];
-  }
 
-  NATIVE_RETURN(thread, OBJ_VAL(copyString(buffer, length)));
+  NATIVE_RETURN(thread, OBJ_VAL(newStringSlice(string, start, length)));
 }
 
 static inline bool __nativeStringLength(void *thread, int argCount,
@@ -582,7 +631,7 @@ static inline bool __nativeStringLength(void *thread, int argCount,
 
 static inline bool __nativeStringEndsWith(void *thread, int argCount,
                                           Value *args) {
-  ObjString *string = AS_STRING(*args);
+  ObjString *string = flattenRope(AS_STRING(*args));
   ObjString *searchString = SAFE_CONSUME_STRING(thread, args, "searchString");
   int start = string->length - searchString->length;
 
@@ -602,7 +651,7 @@ static inline bool __nativeStringEndsWith(void *thread, int argCount,
 
 static inline bool __nativeStringStarsWith(void *thread, int argCount,
                                            Value *args) {
-  ObjString *string = AS_STRING(*args);
+  ObjString *string = flattenRope(AS_STRING(*args));
   ObjString *searchString = SAFE_CONSUME_STRING(thread, args, "searchString");
 
   if (searchString->length > string->length) {
@@ -620,21 +669,19 @@ static inline bool __nativeStringStarsWith(void *thread, int argCount,
 
 static inline bool __nativeStringTrimEnd(void *thread, int argCount,
                                          Value *args) {
-  ObjString *string = AS_STRING(*args);
-  int idx = string->length - 1;
+  ObjString *string = flattenRope(AS_STRING(*args));
+  int length = skipTrailingSpaces(string->chars, string->length);
 
-  while (idx >= 0 && string->chars[idx] == ' ') idx--;
-
-  char buffer[idx + 2];
-  memcpy(buffer, string->chars, idx + 2);
-  buffer[idx + 1] = '\0';
+  if (length == string->length) {
+    NATIVE_RETURN(thread, OBJ_VAL(string));
+  }
 
-  NATIVE_RETURN(thread, OBJ_VAL(copyString(buffer, idx + 1)));
+  NATIVE_RETURN(thread, OBJ_VAL(newStringSlice(string, 0, length)));
 }
 
 static inline bool __nativeStringCharCodeAt(void *thread, int argCount,
                                             Value *args) {
-  ObjString *string = AS_STRING(*args);
+  ObjString *string = flattenRope(AS_STRING(*args));
   int index = SAFE_CONSUME_NUMBER(thread, args, "index");
 
   if (index < 0 || index >= string->length) {
@@ -646,16 +693,14 @@ static inline bool __nativeStringCharCodeAt(void *thread, int argCount,
 
 static inline bool __nativeStringTrimStart(void *thread, int argCount,
                                            Value *args) {
-  ObjString *string = AS_STRING(*args);
-  int idx = 0;
-
-  while (idx < string->length && string->chars[idx] == ' ') idx++;
+  ObjString *string = flattenRope(AS_STRING(*args));
+  int idx = skipLeadingSpaces(string->chars, string->length);
 
-  char buffer[string->length - idx + 1];
-  memcpy(buffer, &string->chars[idx], string->length - idx);
-  buffer[string->length - idx] = '\0';
+  if (idx == 0) {
+    NATIVE_RETURN(thread, OBJ_VAL(string));
+  }
 
-  NATIVE_RETURN(thread, OBJ_VAL(copyString(buffer, string->length - idx)));
+  NATIVE_RETURN(thread, OBJ_VAL(newStringSlice(string, idx, string->length - idx)));
 }
 
 static inline bool __nativeStringIsEmpty(void *thread, int argCount,
@@ -670,7 +715,7 @@ static inline bool __nativeStringIsEmpty(void *thread, int argCount,
 //  1:  "baseStr" is more than "compareStr"
 static inline bool __nativeStringCompare(void *thread, int argCount,
                                          Value *args) {
-  ObjString *baseStr = AS_STRING(*args);
+  ObjString *baseStr = flattenRope(AS_STRING(*args));
   ObjString *compareStr = SAFE_CONSUME_STRING(thread, args, "comparisson string");
   int length = baseStr->length > compareStr->length ? compareStr->length : baseStr->length;
 
@@ -705,6 +750,141 @@ static inline bool __nativeStaticStringIsString(void *thread, int argCount,
   NATIVE_RETURN(thread, IS_STRING(*(++args)) ? TRUE_VAL : FALSE_VAL);
 }
 
+// Strings are appended as they are, other values are stringified first.
+static void stringBuilderAppendValue(ObjStringBuilder *builder, Value value) {
+  if (IS_STRING(value)) {
+    stringBuilderAppend(builder, flattenRope(AS_STRING(value))->chars,
+                        AS_STRING(value)->length);
+    return;
+  }
+
+  // protect the temporary string while the builder buffer grows
+  ObjString *string = (ObjString *)GCWhiteList((Obj *)toString(value));
+  stringBuilderAppend(builder, string->chars, string->length);
+  GCPopWhiteList();
+}
+
+static inline bool __nativeStringBuilderAppend(void *thread, int argCount,
+                                               Value *args) {
+  ObjStringBuilder *builder = AS_STRING_BUILDER(*args);
+  stringBuilderAppendValue(builder, *(++args));
+  NATIVE_RETURN(thread, OBJ_VAL(builder));
+}
+
+static inline bool __nativeStringBuilderLength(void *thread, int argCount,
+                                               Value *args) {
+  ObjStringBuilder *builder = AS_STRING_BUILDER(*args);
+  NATIVE_RETURN(thread, NUMBER_VAL(builder->length));
+}
+
+// Keeps the buffer capacity, so that the builder can be reused without
+// reallocating.
+static inline bool __nativeStringBuilderClear(void *thread, int argCount,
+                                              Value *args) {
+  ObjStringBuilder *builder = AS_STRING_BUILDER(*args);
+  builder->length = 0;
+  NATIVE_RETURN(thread, OBJ_VAL(builder));
+}
+
+static inline bool __nativeStaticStringBuilderNew(void *thread, int argCount,
+                                                  Value *args) {
+  ObjStringBuilder *builder = newStringBuilder();
+
+  // push beforehand to the stack to protect from the GC
+  push(thread, OBJ_VAL(builder));
+
+  if (argCount == 1) {
+    stringBuilderAppendValue(builder, *(++args));
+  }
+
+  return true;
+}
+
+// Typed array static methods are either called on the class itself or, as
+// constructors, on a fresh instance of it.
+static TypedArrayKind typedArrayKind(Value receiver) {
+  ObjClass *klass =
+      IS_CLASS(receiver) ? AS_CLASS(receiver) : AS_OBJ(receiver)->klass;
+
+  for (int kind = 0; kind < TYPED_ARRAY_KINDS; kind++) {
+    if (vm.typedArrayClasses[kind] == klass) return kind;
+  }
+
+  return TYPED_ARRAY_FLOAT64;
+}
+
+static inline bool __nativeStaticTypedArrayNew(void *thread, int argCount,
+                                               Value *args) {
+  TypedArrayKind kind = typedArrayKind(*args);
+  Value source = *(++args);
+
+  if (IS_NUMBER(source)) {
+    double length = AS_NUMBER(source);
+    if (length < 0 || length > INT32_MAX || length != (int)length) {
+      NATIVE_ERROR(thread, "Expected length to be a non negative integer.");
+    }
+
+    NATIVE_RETURN(thread, OBJ_VAL(newTypedArray(kind, (int)length)));
+  }
+
+  if (IS_ARRAY(source)) {
+    ValueArray *list = &AS_ARRAY(source)->list;
+    for (int idx = 0; idx < list->count; idx++) {
+      if (!IS_NUMBER(list->values[idx])) {
+        NATIVE_ERROR(thread, "Expected array elements to be numbers.");
+      }
+    }
+
+    ObjTypedArray *array = newTypedArray(kind, list->count);
+    for (int idx = 0; idx < list->count; idx++) {
+      typedArraySet(array, idx, AS_NUMBER(list->values[idx]));
+    }
+
+    NATIVE_RETURN(thread, OBJ_VAL(array));
+  }
+
+  if (IS_TYPED_ARRAY(source)) {
+    ObjTypedArray *other = AS_TYPED_ARRAY(source);
+    ObjTypedArray *array = newTypedArray(kind, other->count);
+
+    if (other->kind == kind) {
+      memcpy(array->as.bytes, other->as.bytes,
+             typedArrayElementSize(kind) * other->count);
+    } else {
+      for (int idx = 0; idx < other->count; idx++) {
+        typedArraySet(array, idx, typedArrayGet(other, idx));
+      }
+    }
+
+    NATIVE_RETURN(thread, OBJ_VAL(array));
+  }
+
+  NATIVE_ERROR(thread, "Expected a length, an array or a typed array.");
+}
+
+static inline bool __nativeTypedArrayLength(void *thread, int argCount,
+                                            Value *args) {
+  NATIVE_RETURN(thread, NUMBER_VAL(AS_TYPED_ARRAY(*args)->count));
+}
+
+static inline bool __nativeTypedArrayToArray(void *thread, int argCount,
+                                             Value *args) {
+  ObjTypedArray *typedArray = AS_TYPED_ARRAY(*args);
+  ObjArray *array = newArray();
+
+  // push beforehand to the stack to protect from the GC
+  push(thread, OBJ_VAL(array));
+
+  array->list.values = GROW_ARRAY(Value, NULL, 0, typedArray->count);
+  array->list.capacity = typedArray->count;
+  for (int idx = 0; idx < typedArray->count; idx++) {
+    array->list.values[idx] = NUMBER_VAL(typedArrayGet(typedArray, idx));
+  }
+  array->list.count = typedArray->count;
+
+  return true;
+}
+
 static inline bool __nativeStaticNumberIsNumber(void *thread, int argCount,
                                                 Value *args) {
   NATIVE_RETURN(thread, IS_NUMBER(*(++args)) ? TRUE_VAL : FALSE_VAL);
@@ -714,7 +894,7 @@ static inline bool __nativeStaticNumberToNumber(void *thread, int argCount,
                                                 Value *args) {
   ObjString *string = SAFE_CONSUME_STRING(thread, args, "argument");
   char *end_ptr;
-  double number = strtod(string->chars, &end_ptr);
+  double number = strtod(flattenString(string)->chars, &end_ptr);
 
   // to do: better handle this parse error
   if (*end_ptr != '\0') {
@@ -730,7 +910,8 @@ static inline bool __nativeStaticNumberToInteger(void *thread, int argCount,
 
   if (IS_STRING(value)) {
     char *end_ptr;
-    double integer = strtol(AS_STRING(value)->chars, &end_ptr, 10);
+    ObjString *string = flattenString(AS_STRING(value));
+    double integer = strtol(string->chars, &end_ptr, 10);
     char *text = AS_STRING(value)->chars;
 
     // to do: better handle this parse error
@@ -807,171 +988,1466 @@ static inline bool __nativeStaticErrorNew(void *thread, int argCount,
   NATIVE_RETURN(thread, OBJ_VAL(instance));
 }
 
+// Threads are detached, they settle their future and release themselves
 void *runThread(void *ctx) {
-  Thread *programThread = (Thread *)ctx;
+  ActiveThread *thread = (ActiveThread *)ctx;
+  Thread *programThread = thread->program;
+  currentVM = programThread->machine;
   pthread_mutex_lock(&vm.GCMutex);
   vm.threadsCounter++;
   pthread_mutex_unlock(&vm.GCMutex);
 
   InterpretResult result = run(programThread);
+  outputFlush(&vm.output, &programThread->output);
 
   if (result == INTERPRET_OK) {
-    Value *returnValue = ALLOCATE(Value, 1);
-    *returnValue = peek(programThread, 0);
-
-    pthread_mutex_lock(&vm.GCMutex);
-    vm.threadsCounter--;
-    pthread_mutex_unlock(&vm.GCMutex);
-    pthread_exit(returnValue);
+    settleFuture(thread->future, FUTURE_DONE, peek(programThread, 0));
   } else {
-    pthread_mutex_lock(&vm.GCMutex);
-    vm.threadsCounter--;
-    pthread_mutex_unlock(&vm.GCMutex);
-    pthread_exit(NULL);
+    settleFuture(thread->future, FUTURE_FAILED, NIL_VAL);
   }
 
+  // Released while still counted, so that the GC isn't marking it
+  killEntryThread(thread);
+
+  pthread_mutex_lock(&vm.GCMutex);
+  vm.threadsCounter--;
+  pthread_mutex_unlock(&vm.GCMutex);
+
   return NULL;
 }
 
+// Starts function on a new thread, and pushes its future
+static bool startThread(Thread *currentThread, ObjClosure *function,
+                        Value argument) {
+  ObjFuture *future = newFuture();
+  push(currentThread, OBJ_VAL(future));
+
+  ActiveThread *thread = spawnThread(currentThread);
+  thread->future = future;
+
+  push(thread->program, OBJ_VAL(function));
+  callEntry(thread->program, function);
+  if (function->function->arity > 0) {
+    push(thread->program, argument);
+  }
+
+  // The thread may be done and released before pthread_create returns
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+  pthread_t pthreadId;
+  int error = pthread_create(&pthreadId, &attributes, runThread, thread);
+  pthread_attr_destroy(&attributes);
+
+  if (error != 0) {
+    killEntryThread(thread);
+    return false;
+  }
+
+  return true;
+}
+
 static inline bool __nativeSystemThreadingStart(void *currentThread,
                                                 int argCount, Value *args) {
   ObjClosure *function = SAFE_CONSUME_FUNCTION(currentThread, args, "argument");
-  ActiveThread *thread = spawnThread((Thread *)currentThread);
+  Value argument = argCount > 1 ? *(++args) : NIL_VAL;
+
+  if (!startThread(currentThread, function, argument)) {
+    NATIVE_ERROR(currentThread, "Can't spawn new thread.");
+  }
+
+  return true;
+}
+
+// Starts function on a green thread, and pushes its future. Continuations
+// wait for the previous future and take its value as argument.
+static bool startGreenThread(Thread *currentThread, ObjClosure *function,
+                             Value argument, ObjFuture *previous) {
+  ObjFuture *future = newFuture();
+  push(currentThread, OBJ_VAL(future));
+
+  ActiveThread *thread = spawnThread(currentThread);
+  thread->future = future;
+  thread->previous = previous;
 
   push(thread->program, OBJ_VAL(function));
   callEntry(thread->program, function);
   if (function->function->arity > 0) {
-    if (argCount > 1)
-      push(thread->program, *(++args));
-    else
-      push(thread->program, NIL_VAL);
+    push(thread->program, argument);
+  }
+
+  // The thread may be done and released before this returns
+  if (!scheduleGreenThread(thread)) {
+    killEntryThread(thread);
+    return false;
   }
 
-  if (pthread_create(&thread->pthreadId, NULL, runThread, thread->program) !=
-      0) {
+  return true;
+}
+
+static inline bool __nativeSystemThreadingSpawn(void *currentThread,
+                                                int argCount, Value *args) {
+  ObjClosure *function = SAFE_CONSUME_FUNCTION(currentThread, args, "argument");
+  Value argument = argCount > 1 ? *(++args) : NIL_VAL;
+
+  if (!startGreenThread(currentThread, function, argument, NULL)) {
     NATIVE_ERROR(currentThread, "Can't spawn new thread.");
   }
 
-  NATIVE_RETURN(currentThread, NUMBER_VAL((double)thread->id));
+  return true;
+}
+
+// Green threads let the other ready ones run, other threads go on
+static inline bool __nativeSystemThreadingYield(void *currentThread,
+                                                int argCount, Value *args) {
+  if (((Thread *)currentThread)->green) {
+    suspendGreenThread(currentThread, NULL, NULL);
+  }
+
+  NATIVE_RETURN(currentThread, NIL_VAL);
 }
 
+// Ensure the array elements are all futures, otherwise throw error
+#define SAFE_CONSUME_FUTURES(thread, args)                          \
+  ({                                                                \
+    Value futures = *(++args);                                      \
+    if (!IS_ARRAY(futures))                                         \
+      NATIVE_ERROR(thread, "Expected an array of futures.");        \
+    for (int idx = 0; idx < AS_ARRAY(futures)->list.count; idx++) { \
+      if (!IS_FUTURE(AS_ARRAY(futures)->list.values[idx]))          \
+        NATIVE_ERROR(thread, "Expected an array of futures.");      \
+    }                                                               \
+    AS_ARRAY(futures);                                              \
+  })
+
 static inline bool __nativeSystemThreadingJoin(void *currentThread,
                                                int argCount, Value *args) {
-  int threadId = (int)SAFE_CONSUME_NUMBER(currentThread, args, "thread id");
-  ActiveThread *thread = getThread(threadId);
-  void *res;
+  Value value = *(++args);
 
-  if (thread == NULL) {
-    NATIVE_ERROR(currentThread, "Can't find thread.");
+  if (!IS_FUTURE(value)) {
+    NATIVE_ERROR(currentThread, "Expected a future.");
   }
-  
-  enterGCSafezone(currentThread);
-  if (pthread_join(thread->pthreadId, &res) != 0) {
-    NATIVE_ERROR(currentThread, "Can't join thread.");
+
+  ObjFuture *future = AS_FUTURE(value);
+
+  // Green threads are suspended rather than blocking their carrier
+  if (((Thread *)currentThread)->green && !isFutureSettled(future)) {
+    suspendGreenThread(currentThread, future, "Joined thread errored.");
+    NATIVE_RETURN(currentThread, NIL_VAL);
   }
-  leaveGCSafezone(currentThread);  
 
-  if ((void *)res == NULL) {
+  awaitFutures(currentThread, &value, 1, 1, -1);
+
+  if (future->state == FUTURE_FAILED) {
     NATIVE_ERROR(currentThread, "Joined thread errored.");
   }
 
-  killThread(currentThread, threadId);
-
-  Value returnValue = *(Value *)res;
+  NATIVE_RETURN(currentThread, future->value);
+}
 
-  FREE(int *, res);
+static inline bool __nativeSystemThreadingAll(void *currentThread,
+                                              int argCount, Value *args) {
+  ObjArray *futures = SAFE_CONSUME_FUTURES(currentThread, args);
+  int count = futures->list.count;
 
-  NATIVE_RETURN(currentThread, returnValue);
-}
+  awaitFutures(currentThread, futures->list.values, count, count, -1);
 
-static inline bool __nativeStaticSystemSyncLockInit(void *thread, int argCount,
-                                                    Value *args) {
-  ObjString *lockId = SAFE_CONSUME_STRING(thread, args, "lock id");
-  initLock(thread, lockId);
-  NATIVE_RETURN(thread, NIL_VAL);
-}
+  ObjArray *values = newArray();
+  // push beforehand to the stack to protect from the GC
+  push(currentThread, OBJ_VAL(values));
 
-static inline bool __nativeStaticSystemSyncLock(void *thread, int argCount,
-                                                Value *args) {
-  ObjString *lockId = SAFE_CONSUME_STRING(thread, args, "lock id");
-  lockSection(thread, lockId);
-  NATIVE_RETURN(thread, NIL_VAL);
-}
+  for (int idx = 0; idx < count; idx++) {
+    ObjFuture *future = AS_FUTURE(futures->list.values[idx]);
+    if (future->state == FUTURE_FAILED) {
+      pop(currentThread);
+      NATIVE_ERROR(currentThread, "Joined thread errored.");
+    }
 
-static inline bool __nativeStaticSystemSyncUnlock(void *thread, int argCount,
-                                                  Value *args) {
-  ObjString *lockId = SAFE_CONSUME_STRING(thread, args, "lock id");
-  unlockSection(thread, lockId);
-  NATIVE_RETURN(thread, NIL_VAL);
-}
+    writeValueArray(&values->list, future->value);
+  }
 
-static inline bool __nativeStaticSystemSyncSemaphoreInit(void *thread,
-                                                         int argCount,
-                                                         Value *args) {
-  ObjString *semaphoreId = SAFE_CONSUME_STRING(thread, args, "semaphore id");
-  int value = (int)SAFE_CONSUME_NUMBER(thread, args, "semaphore initial value");
-  initSemaphore(thread, semaphoreId, value);
-  NATIVE_RETURN(thread, NIL_VAL);
+  return true;
 }
 
-static inline bool __nativeStaticSystemSyncSemaphorePost(void *thread,
-                                                         int argCount,
-                                                         Value *args) {
-  ObjString *semaphoreId = SAFE_CONSUME_STRING(thread, args, "semaphore id");
-  postSemaphore(thread, semaphoreId);
-  NATIVE_RETURN(thread, NIL_VAL);
-}
+// Returns the first future settled, done or failed
+static inline bool __nativeSystemThreadingAny(void *currentThread,
+                                              int argCount, Value *args) {
+  ObjArray *futures = SAFE_CONSUME_FUTURES(currentThread, args);
 
-static inline bool __nativeStaticSystemSyncSemaphoreWait(void *thread,
-                                                         int argCount,
-                                                         Value *args) {
-  ObjString *semaphoreId = SAFE_CONSUME_STRING(thread, args, "semaphore id");
-  waitSemaphore(thread, semaphoreId);
-  NATIVE_RETURN(thread, NIL_VAL);
-}
+  if (futures->list.count == 0) {
+    NATIVE_ERROR(currentThread, "Expected at least one future.");
+  }
 
-static inline bool __nativeStaticObjectKeys(void *thread, int argCount,
-                                            Value *args) {
-  ObjInstance *instance = (ObjInstance *)GCWhiteList(
-      (Obj *)SAFE_CONSUME_OBJECT_INSTANCE(thread, args, "argument"));
-  ObjArray *arr = (ObjArray *)GCWhiteList((Obj *)newArray());
+  awaitFutures(currentThread, futures->list.values, futures->list.count, 1,
+               -1);
 
-  for (int idx = 0; idx <= instance->properties.capacity; idx++) {
-    Entry *entry = &instance->properties.entries[idx];
-    if (entry->key != NULL) {
-      ObjString *string =
-          (ObjString *)GCWhiteList((Obj *)toString(OBJ_VAL(entry->key)));
-      writeValueArray(&arr->list, OBJ_VAL(string));
-      GCPopWhiteList();
+  for (int idx = 0; idx < futures->list.count; idx++) {
+    if (isFutureSettled(AS_FUTURE(futures->list.values[idx]))) {
+      NATIVE_RETURN(currentThread, futures->list.values[idx]);
     }
   }
 
-  // Pop instance
-  GCPopWhiteList();
-  // Pop array
-  GCPopWhiteList();
+  NATIVE_ERROR(currentThread, "Expected at least one future.");
+}
 
-  NATIVE_RETURN(thread, OBJ_VAL(arr));
+static inline bool __nativeFutureIsDone(void *thread, int argCount,
+                                        Value *args) {
+  NATIVE_RETURN(thread, BOOL_VAL(isFutureSettled(AS_FUTURE(*args))));
 }
 
-static inline bool __nativeStaticObjectValues(void *thread, int argCount,
-                                              Value *args) {
-  ObjInstance *instance = (ObjInstance *)GCWhiteList(
-      (Obj *)SAFE_CONSUME_OBJECT_INSTANCE(thread, args, "argument"));
-  ObjArray *arr = (ObjArray *)GCWhiteList((Obj *)newArray());
+static inline bool __nativeFutureGet(void *thread, int argCount, Value *args) {
+  Value value = *args;
+  ObjFuture *future = AS_FUTURE(value);
+  double timeout = -1;
 
-  for (int idx = 0; idx <= instance->properties.capacity; idx++) {
-    Entry *entry = &instance->properties.entries[idx];
-    if (entry->key != NULL) {
-      ObjString *string =
-          (ObjString *)GCWhiteList((Obj *)toString(entry->value));
-      writeValueArray(&arr->list, OBJ_VAL(string));
-      GCPopWhiteList();
+  if (argCount > 0) {
+    timeout = SAFE_CONSUME_NUMBER(thread, args, "timeout");
+    if (timeout < 0) {
+      NATIVE_ERROR(thread, "Expected timeout to be a positive number.");
     }
+  } else if (((Thread *)thread)->green && !isFutureSettled(future)) {
+    suspendGreenThread(thread, future, "Future thread errored.");
+    NATIVE_RETURN(thread, NIL_VAL);
   }
 
-  // Pop instance
-  GCPopWhiteList();
+  if (!awaitFutures(thread, &value, 1, 1, timeout)) {
+    NATIVE_ERROR(thread, "Future timed out.");
+  }
+
+  if (future->state == FUTURE_FAILED) {
+    NATIVE_ERROR(thread, "Future thread errored.");
+  }
+
+  NATIVE_RETURN(thread, future->value);
+}
+
+static inline bool __nativeFutureThen(void *thread, int argCount,
+                                      Value *args) {
+  ObjFuture *future = AS_FUTURE(*args);
+  ObjClosure *function = SAFE_CONSUME_FUNCTION(thread, args, "argument");
+
+  // Continuations are green threads parked on the future, nothing waits
+  // for it meanwhile
+  if (!startGreenThread(thread, function, NIL_VAL, future)) {
+    NATIVE_ERROR(thread, "Can't spawn new thread.");
+  }
+
+  return true;
+}
+
+static inline bool __nativeStaticChannelNew(void *thread, int argCount,
+                                            Value *args) {
+  double capacity = SAFE_CONSUME_NUMBER(thread, args, "capacity");
+
+  if (capacity < 1 || capacity > INT_MAX || capacity != (int)capacity) {
+    NATIVE_ERROR(thread, "Expected capacity to be a positive integer.");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(newChannel((int)capacity)));
+}
+
+// Ensure the array elements are all channels, otherwise throw error
+#define SAFE_CONSUME_CHANNELS(thread, args)                         \
+  ({                                                                \
+    Value channels = *(++args);                                     \
+    if (!IS_ARRAY(channels))                                        \
+      NATIVE_ERROR(thread, "Expected an array of channels.");       \
+    for (int idx = 0; idx < AS_ARRAY(channels)->list.count; idx++) { \
+      if (!IS_CHANNEL(AS_ARRAY(channels)->list.values[idx]))        \
+        NATIVE_ERROR(thread, "Expected an array of channels.");     \
+    }                                                               \
+    if (AS_ARRAY(channels)->list.count == 0)                        \
+      NATIVE_ERROR(thread, "Expected at least one channel.");       \
+    AS_ARRAY(channels);                                             \
+  })
+
+static bool channelSelectNative(Thread *thread, Value *args, bool block) {
+  ObjArray *channels = SAFE_CONSUME_CHANNELS(thread, args);
+  Value value;
+  bool closed;
+
+  int ready = channelSelect(thread, channels->list.values,
+                            channels->list.count, &value, &closed, block);
+  if (ready < 0) {
+    NATIVE_RETURN(thread, NIL_VAL);
+  }
+
+  // Received values are only held by the stack until returned
+  push(thread, value);
+  ObjArray *result = newArray();
+  push(thread, OBJ_VAL(result));
+  writeValueArray(&result->list, channels->list.values[ready]);
+  writeValueArray(&result->list, value);
+
+  // Natives leave only their result on the stack
+  pop(thread);
+  pop(thread);
+  NATIVE_RETURN(thread, OBJ_VAL(result));
+}
+
+// Receives from the first ready channel, returns [channel, value]. Closed and
+// drained channels are ready, with a nil value.
+static inline bool __nativeStaticChannelSelect(void *thread, int argCount,
+                                               Value *args) {
+  return channelSelectNative(thread, args, true);
+}
+
+// Same as select, but returns nil when no channel is ready
+static inline bool __nativeStaticChannelTrySelect(void *thread, int argCount,
+                                                  Value *args) {
+  return channelSelectNative(thread, args, false);
+}
+
+static inline bool __nativeChannelSend(void *thread, int argCount,
+                                       Value *args) {
+  ObjChannel *channel = AS_CHANNEL(*args);
+
+  if (channelSend(thread, channel, *(++args), true) == CHANNEL_CLOSED) {
+    NATIVE_ERROR(thread, "Channel is closed.");
+  }
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeChannelTrySend(void *thread, int argCount,
+                                          Value *args) {
+  ObjChannel *channel = AS_CHANNEL(*args);
+  ChannelStatus status = channelSend(thread, channel, *(++args), false);
+
+  if (status == CHANNEL_CLOSED) {
+    NATIVE_ERROR(thread, "Channel is closed.");
+  }
+
+  NATIVE_RETURN(thread, BOOL_VAL(status == CHANNEL_OK));
+}
+
+// Returns nil once closed and drained
+static inline bool __nativeChannelReceive(void *thread, int argCount,
+                                          Value *args) {
+  Value value = NIL_VAL;
+  channelReceive(thread, AS_CHANNEL(*args), &value, true);
+
+  NATIVE_RETURN(thread, value);
+}
+
+// Returns nil when empty
+static inline bool __nativeChannelTryReceive(void *thread, int argCount,
+                                             Value *args) {
+  Value value;
+  if (channelReceive(thread, AS_CHANNEL(*args), &value, false) !=
+      CHANNEL_OK) {
+    NATIVE_RETURN(thread, NIL_VAL);
+  }
+
+  NATIVE_RETURN(thread, value);
+}
+
+static inline bool __nativeChannelClose(void *thread, int argCount,
+                                        Value *args) {
+  channelClose(AS_CHANNEL(*args));
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeChannelIsClosed(void *thread, int argCount,
+                                           Value *args) {
+  NATIVE_RETURN(thread, BOOL_VAL(atomic_load(&AS_CHANNEL(*args)->closed)));
+}
+
+static inline bool __nativeChannelLength(void *thread, int argCount,
+                                         Value *args) {
+  NATIVE_RETURN(thread, NUMBER_VAL(channelLength(AS_CHANNEL(*args))));
+}
+
+static inline bool __nativeChannelCapacity(void *thread, int argCount,
+                                           Value *args) {
+  NATIVE_RETURN(thread, NUMBER_VAL(AS_CHANNEL(*args)->capacity));
+}
+
+static inline bool __nativeStaticIsolateSpawn(void *thread, int argCount,
+                                              Value *args) {
+  ObjString *path = SAFE_CONSUME_STRING(thread, args, "path");
+  ObjIsolate *isolate = isolateSpawn(thread, path);
+
+  if (isolate == NULL) {
+    NATIVE_SYSTEM_ERROR(thread, "Cannot spawn isolate");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(isolate));
+}
+
+// Returns nil when not running as an isolate
+static inline bool __nativeStaticIsolateParent(void *thread, int argCount,
+                                               Value *args) {
+  ObjIsolate *parent = isolateParent();
+
+  NATIVE_RETURN(thread, parent != NULL ? OBJ_VAL(parent) : NIL_VAL);
+}
+
+static inline bool __nativeIsolateSend(void *thread, int argCount,
+                                       Value *args) {
+  ObjIsolate *isolate = AS_ISOLATE(*args);
+
+  switch (isolateSend(thread, isolate, *(++args))) {
+    case ISOLATE_OK:
+      NATIVE_RETURN(thread, NIL_VAL);
+    case ISOLATE_CLOSED:
+      NATIVE_ERROR(thread, "Isolate is closed.");
+    case ISOLATE_UNCLONEABLE:
+      NATIVE_ERROR(thread,
+                   "Expected nil, bool, number, string, array, object or "
+                   "typed array values, nested up to 64 levels.");
+    case ISOLATE_SYSTEM_ERROR:
+      break;
+  }
+
+  NATIVE_SYSTEM_ERROR(thread, "Cannot send message");
+}
+
+// Returns nil once the other isolate closed and every message was received
+static inline bool __nativeIsolateReceive(void *thread, int argCount,
+                                          Value *args) {
+  Value value;
+
+  switch (isolateReceive(thread, AS_ISOLATE(*args), &value)) {
+    case ISOLATE_OK:
+      NATIVE_RETURN(thread, value);
+    case ISOLATE_CLOSED:
+      NATIVE_RETURN(thread, NIL_VAL);
+    default:
+      break;
+  }
+
+  NATIVE_SYSTEM_ERROR(thread, "Cannot receive message");
+}
+
+static inline bool __nativeIsolateClose(void *thread, int argCount,
+                                        Value *args) {
+  isolateClose(thread, AS_ISOLATE(*args));
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+// Closes the isolate and returns its exit code once it exits
+static inline bool __nativeIsolateWait(void *thread, int argCount,
+                                       Value *args) {
+  ObjIsolate *isolate = AS_ISOLATE(*args);
+
+  if (isolate->pid == 0) {
+    NATIVE_ERROR(thread, "Only spawned isolates can be waited for.");
+  }
+
+  int exitCode = isolateWait(thread, isolate);
+  if (exitCode < 0) {
+    NATIVE_SYSTEM_ERROR(thread, "Cannot wait for isolate");
+  }
+
+  NATIVE_RETURN(thread, NUMBER_VAL(exitCode));
+}
+
+// Returns a future settled with nil once seconds elapsed
+static inline bool __nativeStaticEventsTimeout(void *thread, int argCount,
+                                               Value *args) {
+  double seconds = SAFE_CONSUME_NUMBER(thread, args, "seconds");
+
+  // NaN deadlines can't be ordered, they would never fire
+  if (!isfinite(seconds) || seconds < 0) {
+    NATIVE_ERROR(thread,
+                 "Expected seconds to be a finite non-negative number.");
+  }
+
+  ObjFuture *future = newFuture();
+  if (!eventsTimeout(seconds, future)) {
+    NATIVE_SYSTEM_ERROR(thread, "Cannot start timer");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(future));
+}
+
+// Returns a future settled with the source, a file or a file descriptor
+// number, once it can be read from or written to without blocking
+static bool eventsWatchSource(Thread *thread, Value *args, bool write) {
+  Value source = *(++args);
+  ObjFuture *future = newFuture();
+  int fd;
+
+  if (IS_FILE(source)) {
+    ObjFile *file = AS_FILE(source);
+    if (file->fd < 0) NATIVE_ERROR(thread, "File is closed.");
+
+    // Buffered content is read without waiting
+    if (!write && (file->start < file->length || file->eof)) {
+      settleFuture(future, FUTURE_DONE, source);
+      NATIVE_RETURN(thread, OBJ_VAL(future));
+    }
+    fd = file->fd;
+  } else if (IS_NUMBER(source) && AS_NUMBER(source) >= 0 &&
+             AS_NUMBER(source) <= INT_MAX &&
+             AS_NUMBER(source) == (int)AS_NUMBER(source)) {
+    fd = (int)AS_NUMBER(source);
+  } else {
+    NATIVE_ERROR(thread, "Expected a file or a file descriptor.");
+  }
+
+  if (!eventsWatch(fd, write, source, future)) {
+    NATIVE_SYSTEM_ERROR(thread, "Cannot watch file descriptor");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(future));
+}
+
+static inline bool __nativeStaticEventsReadable(void *thread, int argCount,
+                                                Value *args) {
+  return eventsWatchSource(thread, args, false);
+}
+
+static inline bool __nativeStaticEventsWritable(void *thread, int argCount,
+                                                Value *args) {
+  return eventsWatchSource(thread, args, true);
+}
+
+// Calls function on a green thread once seconds elapsed, and returns its
+// future. Nothing is blocked meanwhile.
+static inline bool __nativeStaticEventsSetTimeout(void *thread, int argCount,
+                                                  Value *args) {
+  ObjClosure *function = SAFE_CONSUME_FUNCTION(thread, args, "callback");
+  double seconds = SAFE_CONSUME_NUMBER(thread, args, "seconds");
+
+  // NaN deadlines can't be ordered, they would never fire
+  if (!isfinite(seconds) || seconds < 0) {
+    NATIVE_ERROR(thread,
+                 "Expected seconds to be a finite non-negative number.");
+  }
+
+  ObjFuture *timer = newFuture();
+  if (!eventsTimeout(seconds, timer)) {
+    NATIVE_SYSTEM_ERROR(thread, "Cannot start timer");
+  }
+
+  if (!startGreenThread(thread, function, NIL_VAL, timer)) {
+    NATIVE_ERROR(thread, "Can't spawn new thread.");
+  }
+
+  return true;
+}
+
+static inline bool __nativeStaticSystemSyncLockInit(void *thread, int argCount,
+                                                    Value *args) {
+  ObjString *lockId = SAFE_CONSUME_STRING(thread, args, "lock id");
+  initLock(thread, lockId);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeStaticSystemSyncLock(void *thread, int argCount,
+                                                Value *args) {
+  ObjString *lockId = SAFE_CONSUME_STRING(thread, args, "lock id");
+
+  if (((Thread *)thread)->green) {
+    NATIVE_ERROR(thread, "Lock can't be locked by a green thread.");
+  }
+
+  lockSection(thread, lockId);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeStaticSystemSyncUnlock(void *thread, int argCount,
+                                                  Value *args) {
+  ObjString *lockId = SAFE_CONSUME_STRING(thread, args, "lock id");
+  unlockSection(thread, lockId);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeStaticSystemSyncSemaphoreInit(void *thread,
+                                                         int argCount,
+                                                         Value *args) {
+  ObjString *semaphoreId = SAFE_CONSUME_STRING(thread, args, "semaphore id");
+  int value = (int)SAFE_CONSUME_NUMBER(thread, args, "semaphore initial value");
+  initSemaphore(thread, semaphoreId, value);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeStaticSystemSyncSemaphorePost(void *thread,
+                                                         int argCount,
+                                                         Value *args) {
+  ObjString *semaphoreId = SAFE_CONSUME_STRING(thread, args, "semaphore id");
+  postSemaphore(thread, semaphoreId);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeStaticSystemSyncSemaphoreWait(void *thread,
+                                                         int argCount,
+                                                         Value *args) {
+  ObjString *semaphoreId = SAFE_CONSUME_STRING(thread, args, "semaphore id");
+
+  waitSemaphore(thread, semaphoreId);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeStaticSyncMutex(void *thread, int argCount,
+                                           Value *args) {
+  NATIVE_RETURN(thread, OBJ_VAL(newSync(SYNC_MUTEX, 0)));
+}
+
+static inline bool __nativeStaticSyncSemaphore(void *thread, int argCount,
+                                               Value *args) {
+  double value = SAFE_CONSUME_NUMBER(thread, args, "semaphore initial value");
+
+  if (value < 0 || value > SEM_VALUE_MAX || value != (unsigned int)value) {
+    NATIVE_ERROR(thread,
+                 "Expected semaphore initial value to be a non negative "
+                 "integer.");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(newSync(SYNC_SEMAPHORE, (unsigned int)value)));
+}
+
+static inline bool __nativeStaticSyncRWLock(void *thread, int argCount,
+                                            Value *args) {
+  NATIVE_RETURN(thread, OBJ_VAL(newSync(SYNC_RWLOCK, 0)));
+}
+
+static inline bool __nativeStaticSyncCondition(void *thread, int argCount,
+                                               Value *args) {
+  NATIVE_RETURN(thread, OBJ_VAL(newSync(SYNC_CONDITION, 0)));
+}
+
+// Locks are owned by the carrier, which a green thread may change once
+// suspended
+static inline bool __nativeMutexLock(void *thread, int argCount, Value *args) {
+  if (((Thread *)thread)->green) {
+    NATIVE_ERROR(thread, "Mutex can't be locked by a green thread.");
+  }
+
+  if (mutexLock(thread, AS_SYNC(*args)) != 0) {
+    NATIVE_ERROR(thread, "Mutex is already locked by this thread.");
+  }
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeMutexTryLock(void *thread, int argCount,
+                                        Value *args) {
+  NATIVE_RETURN(
+      thread, BOOL_VAL(pthread_mutex_trylock(&AS_SYNC(*args)->as.mutex) == 0));
+}
+
+static inline bool __nativeMutexUnlock(void *thread, int argCount,
+                                       Value *args) {
+  if (pthread_mutex_unlock(&AS_SYNC(*args)->as.mutex) != 0) {
+    NATIVE_ERROR(thread, "Mutex is not locked by this thread.");
+  }
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeSemaphoreWait(void *thread, int argCount,
+                                         Value *args) {
+  semaphoreWait(thread, AS_SYNC(*args));
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeSemaphoreTryWait(void *thread, int argCount,
+                                            Value *args) {
+  NATIVE_RETURN(thread,
+                BOOL_VAL(sem_trywait(&AS_SYNC(*args)->as.semaphore) == 0));
+}
+
+static inline bool __nativeSemaphorePost(void *thread, int argCount,
+                                         Value *args) {
+  if (sem_post(&AS_SYNC(*args)->as.semaphore) != 0) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't post semaphore");
+  }
+  signalWakeup(&vm.semaphoresWakeup);
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeSemaphoreValue(void *thread, int argCount,
+                                          Value *args) {
+  int value;
+  sem_getvalue(&AS_SYNC(*args)->as.semaphore, &value);
+
+  NATIVE_RETURN(thread, NUMBER_VAL(value));
+}
+
+static inline bool __nativeRWLockReadLock(void *thread, int argCount,
+                                          Value *args) {
+  if (((Thread *)thread)->green) {
+    NATIVE_ERROR(thread, "RWLock can't be locked by a green thread.");
+  }
+
+  if (rwlockLock(thread, AS_SYNC(*args), false) != 0) {
+    NATIVE_ERROR(thread, "RWLock is already write locked by this thread.");
+  }
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeRWLockWriteLock(void *thread, int argCount,
+                                           Value *args) {
+  if (((Thread *)thread)->green) {
+    NATIVE_ERROR(thread, "RWLock can't be locked by a green thread.");
+  }
+
+  if (rwlockLock(thread, AS_SYNC(*args), true) != 0) {
+    NATIVE_ERROR(thread, "RWLock is already locked by this thread.");
+  }
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeRWLockTryReadLock(void *thread, int argCount,
+                                             Value *args) {
+  NATIVE_RETURN(
+      thread,
+      BOOL_VAL(pthread_rwlock_tryrdlock(&AS_SYNC(*args)->as.rwlock) == 0));
+}
+
+static inline bool __nativeRWLockTryWriteLock(void *thread, int argCount,
+                                              Value *args) {
+  NATIVE_RETURN(
+      thread,
+      BOOL_VAL(pthread_rwlock_trywrlock(&AS_SYNC(*args)->as.rwlock) == 0));
+}
+
+static inline bool __nativeRWLockUnlock(void *thread, int argCount,
+                                        Value *args) {
+  if (pthread_rwlock_unlock(&AS_SYNC(*args)->as.rwlock) != 0) {
+    NATIVE_ERROR(thread, "RWLock is not locked by this thread.");
+  }
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+// Returns false when the timeout (in seconds) expires
+static inline bool __nativeConditionWait(void *thread, int argCount,
+                                         Value *args) {
+  ObjSync *condition = AS_SYNC(*args);
+  Value mutex = *(++args);
+  double timeout = -1;
+
+  if (!IS_SYNC(mutex) || AS_SYNC(mutex)->kind != SYNC_MUTEX) {
+    NATIVE_ERROR(thread, "Expected a mutex.");
+  }
+
+  if (((Thread *)thread)->green) {
+    NATIVE_ERROR(thread, "Condition can't be waited for by a green thread.");
+  }
+
+  if (argCount > 1) {
+    timeout = SAFE_CONSUME_NUMBER(thread, args, "timeout");
+    if (timeout < 0) {
+      NATIVE_ERROR(thread, "Expected timeout to be a positive number.");
+    }
+  }
+
+  int error = conditionWait(thread, condition, AS_SYNC(mutex), timeout);
+  if (error == EPERM) {
+    NATIVE_ERROR(thread, "Mutex is not locked by this thread.");
+  }
+
+  NATIVE_RETURN(thread, BOOL_VAL(error != ETIMEDOUT));
+}
+
+static inline bool __nativeConditionSignal(void *thread, int argCount,
+                                           Value *args) {
+  pthread_cond_signal(&AS_SYNC(*args)->as.condition);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool __nativeConditionBroadcast(void *thread, int argCount,
+                                              Value *args) {
+  pthread_cond_broadcast(&AS_SYNC(*args)->as.condition);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool isInt64(double number) {
+  return number == trunc(number) && number >= -9223372036854775808.0 &&
+         number < 9223372036854775808.0;
+}
+
+static bool atomicNew(Thread *thread, ObjClass *klass, AtomicKind kind,
+                      int argCount, Value *args) {
+  int count = 1;
+  double value = 0;
+
+  if (klass == vm.atomicArrayClass) {
+    double length = SAFE_CONSUME_NUMBER(thread, args, "length");
+    if (length < 0 || length > INT32_MAX || length != (int)length) {
+      NATIVE_ERROR(thread, "Expected length to be a non negative integer.");
+    }
+    count = (int)length;
+  } else if (argCount > 0) {
+    value = SAFE_CONSUME_NUMBER(thread, args, "value");
+    if (kind == ATOMIC_INT64 && !isInt64(value)) {
+      NATIVE_ERROR(thread, "Expected value to be an integer.");
+    }
+  }
+
+  ObjAtomic *atomic = newAtomic(klass, kind, count);
+  if (count > 0) atomicStore(atomic, 0, value, memory_order_relaxed);
+
+  NATIVE_RETURN(thread, OBJ_VAL(atomic));
+}
+
+static ObjClass *atomicClass(Value receiver) {
+  ObjClass *klass =
+      IS_CLASS(receiver) ? AS_CLASS(receiver) : AS_OBJ(receiver)->klass;
+
+  return klass == vm.atomicArrayClass ? vm.atomicArrayClass : vm.atomicClass;
+}
+
+static inline bool __nativeStaticAtomicNew(void *thread, int argCount,
+                                           Value *args) {
+  return atomicNew(thread, atomicClass(*args), ATOMIC_INT64, argCount, args);
+}
+
+static inline bool __nativeStaticAtomicFloat64(void *thread, int argCount,
+                                               Value *args) {
+  return atomicNew(thread, atomicClass(*args), ATOMIC_FLOAT64, argCount,
+                   args);
+}
+
+// AtomicArray methods take the cell index first, Atomic has a single cell
+#define SAFE_CONSUME_ATOMIC_INDEX(thread, args, atomic)                  \
+  ({                                                                     \
+    int index = 0;                                                       \
+    if ((atomic)->obj.klass == vm.atomicArrayClass) {                    \
+      double number = SAFE_CONSUME_NUMBER(thread, args, "index");        \
+      if (number < 0 || number >= (atomic)->count ||                     \
+          number != (int)number)                                         \
+        NATIVE_ERROR(thread, "Index out of bounds.");                    \
+      index = (int)number;                                               \
+    }                                                                    \
+    index;                                                               \
+  })
+
+#define SAFE_CONSUME_ATOMIC_VALUE(thread, args, atomic, name)            \
+  ({                                                                     \
+    double number = SAFE_CONSUME_NUMBER(thread, args, name);             \
+    if ((atomic)->kind == ATOMIC_INT64 && !isInt64(number))              \
+      NATIVE_ERROR(thread, "Expected value to be an integer.");          \
+    number;                                                              \
+  })
+
+// Memory order is the optional last argument, sequentially consistent by
+// default
+#define SAFE_CONSUME_ATOMIC_ORDER(thread, args, argCount, atomic, operands) \
+  ({                                                                     \
+    memory_order order = memory_order_seq_cst;                           \
+    int fixed = (operands) + ((atomic)->obj.klass == vm.atomicArrayClass); \
+    if ((argCount) > fixed &&                                            \
+        !atomicOrder(SAFE_CONSUME_STRING(thread, args, "memory order"),  \
+                     &order))                                            \
+      NATIVE_ERROR(thread,                                               \
+                   "Expected memory order to be relaxed, acquire, "      \
+                   "release, acq_rel or seq_cst.");                      \
+    order;                                                               \
+  })
+
+static inline bool __nativeAtomicLoad(void *thread, int argCount,
+                                      Value *args) {
+  ObjAtomic *atomic = AS_ATOMIC(*args);
+  int index = SAFE_CONSUME_ATOMIC_INDEX(thread, args, atomic);
+  memory_order order =
+      SAFE_CONSUME_ATOMIC_ORDER(thread, args, argCount, atomic, 0);
+
+  if (order == memory_order_release || order == memory_order_acq_rel) {
+    NATIVE_ERROR(thread, "Invalid memory order for load.");
+  }
+
+  NATIVE_RETURN(thread, NUMBER_VAL(atomicLoad(atomic, index, order)));
+}
+
+static inline bool __nativeAtomicStore(void *thread, int argCount,
+                                       Value *args) {
+  ObjAtomic *atomic = AS_ATOMIC(*args);
+  int index = SAFE_CONSUME_ATOMIC_INDEX(thread, args, atomic);
+  double value = SAFE_CONSUME_ATOMIC_VALUE(thread, args, atomic, "value");
+  memory_order order =
+      SAFE_CONSUME_ATOMIC_ORDER(thread, args, argCount, atomic, 1);
+
+  if (order == memory_order_acquire || order == memory_order_acq_rel) {
+    NATIVE_ERROR(thread, "Invalid memory order for store.");
+  }
+
+  atomicStore(atomic, index, value, order);
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static bool atomicUpdateNative(Thread *thread, int argCount, Value *args,
+                               AtomicOperation operation) {
+  ObjAtomic *atomic = AS_ATOMIC(*args);
+  int index = SAFE_CONSUME_ATOMIC_INDEX(thread, args, atomic);
+  double value = SAFE_CONSUME_ATOMIC_VALUE(thread, args, atomic, "value");
+  memory_order order =
+      SAFE_CONSUME_ATOMIC_ORDER(thread, args, argCount, atomic, 1);
+
+  if (atomic->kind != ATOMIC_INT64 && operation != ATOMIC_ADD &&
+      operation != ATOMIC_SUB) {
+    NATIVE_ERROR(thread, "Bitwise operations expect integer cells.");
+  }
+
+  NATIVE_RETURN(thread, NUMBER_VAL(atomicUpdate(atomic, index, operation,
+                                                value, order)));
+}
+
+static inline bool __nativeAtomicAdd(void *thread, int argCount,
+                                     Value *args) {
+  return atomicUpdateNative(thread, argCount, args, ATOMIC_ADD);
+}
+
+static inline bool __nativeAtomicSub(void *thread, int argCount,
+                                     Value *args) {
+  return atomicUpdateNative(thread, argCount, args, ATOMIC_SUB);
+}
+
+static inline bool __nativeAtomicAnd(void *thread, int argCount,
+                                     Value *args) {
+  return atomicUpdateNative(thread, argCount, args, ATOMIC_AND);
+}
+
+static inline bool __nativeAtomicOr(void *thread, int argCount, Value *args) {
+  return atomicUpdateNative(thread, argCount, args, ATOMIC_OR);
+}
+
+static inline bool __nativeAtomicXor(void *thread, int argCount,
+                                     Value *args) {
+  return atomicUpdateNative(thread, argCount, args, ATOMIC_XOR);
+}
+
+static inline bool __nativeAtomicExchange(void *thread, int argCount,
+                                          Value *args) {
+  ObjAtomic *atomic = AS_ATOMIC(*args);
+  int index = SAFE_CONSUME_ATOMIC_INDEX(thread, args, atomic);
+  double value = SAFE_CONSUME_ATOMIC_VALUE(thread, args, atomic, "value");
+  memory_order order =
+      SAFE_CONSUME_ATOMIC_ORDER(thread, args, argCount, atomic, 1);
+
+  NATIVE_RETURN(thread,
+                NUMBER_VAL(atomicExchange(atomic, index, value, order)));
+}
+
+// Returns the value held before, the exchange happened if it is expected
+static inline bool __nativeAtomicCompareExchange(void *thread, int argCount,
+                                                 Value *args) {
+  ObjAtomic *atomic = AS_ATOMIC(*args);
+  int index = SAFE_CONSUME_ATOMIC_INDEX(thread, args, atomic);
+  double expected =
+      SAFE_CONSUME_ATOMIC_VALUE(thread, args, atomic, "expected value");
+  double desired =
+      SAFE_CONSUME_ATOMIC_VALUE(thread, args, atomic, "desired value");
+  memory_order order =
+      SAFE_CONSUME_ATOMIC_ORDER(thread, args, argCount, atomic, 2);
+
+  NATIVE_RETURN(thread, NUMBER_VAL(atomicCompareExchange(
+                            atomic, index, expected, desired, order)));
+}
+
+static inline bool __nativeAtomicArrayLength(void *thread, int argCount,
+                                             Value *args) {
+  NATIVE_RETURN(thread, NUMBER_VAL(AS_ATOMIC(*args)->count));
+}
+
+static inline bool __nativeAtomicArrayToArray(void *thread, int argCount,
+                                              Value *args) {
+  ObjAtomic *atomic = AS_ATOMIC(*args);
+  ObjArray *array = newArray();
+
+  // push beforehand to the stack to protect from the GC
+  push(thread, OBJ_VAL(array));
+
+  array->list.values = GROW_ARRAY(Value, NULL, 0, atomic->count);
+  array->list.capacity = atomic->count;
+  for (int idx = 0; idx < atomic->count; idx++) {
+    array->list.values[idx] = NUMBER_VAL(atomicGet(atomic, idx));
+  }
+  array->list.count = atomic->count;
+
+  return true;
+}
+
+static inline bool __nativeStaticFsReadFile(void *thread, int argCount,
+                                            Value *args) {
+  ObjString *path = SAFE_CONSUME_STRING(thread, args, "path");
+  ObjString *content = fsReadFile(thread, path);
+
+  if (content == NULL) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't read file");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(content));
+}
+
+static inline bool __nativeStaticFsReadBytes(void *thread, int argCount,
+                                             Value *args) {
+  ObjString *path = SAFE_CONSUME_STRING(thread, args, "path");
+  ObjTypedArray *bytes = fsReadBytes(thread, path);
+
+  if (bytes == NULL) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't read file");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(bytes));
+}
+
+static inline bool __nativeStaticFsWriteFile(void *thread, int argCount,
+                                             Value *args) {
+  ObjString *path = SAFE_CONSUME_STRING(thread, args, "path");
+  Value value = *(++args);
+
+  // Typed arrays are written as raw bytes
+  if (IS_TYPED_ARRAY(value)) {
+    ObjTypedArray *array = AS_TYPED_ARRAY(value);
+    if (!fsWriteBytes(thread, path, array->as.bytes,
+                      typedArrayElementSize(array->kind) * array->count)) {
+      NATIVE_SYSTEM_ERROR(thread, "Can't write file");
+    }
+
+    NATIVE_RETURN(thread, NIL_VAL);
+  }
+
+  ObjString *content = toString(value);
+
+  // push beforehand to the stack to protect from the GC
+  push(thread, OBJ_VAL(content));
+  bool written = fsWriteFile(thread, path, content);
+  pop(thread);
+
+  if (!written) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't write file");
+  }
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+static inline bool fsOpenFile(void *thread, Value *args, FileMode mode,
+                              bool append) {
+  ObjString *path = SAFE_CONSUME_STRING(thread, args, "path");
+  ObjFile *file = fsOpen(thread, path, mode, append);
+
+  if (file == NULL) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't open file");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(file));
+}
+
+static inline bool __nativeStaticFsOpen(void *thread, int argCount,
+                                        Value *args) {
+  return fsOpenFile(thread, args, FILE_READER, false);
+}
+
+static inline bool __nativeStaticFsCreate(void *thread, int argCount,
+                                          Value *args) {
+  return fsOpenFile(thread, args, FILE_WRITER, false);
+}
+
+static inline bool __nativeStaticFsAppend(void *thread, int argCount,
+                                          Value *args) {
+  return fsOpenFile(thread, args, FILE_WRITER, true);
+}
+
+// Ensure the file is open in the given mode, otherwise throw error
+#define SAFE_FILE(thread, args, fileMode)                                  \
+  ({                                                                       \
+    ObjFile *file = AS_FILE(*args);                                        \
+    if (file->fd < 0) NATIVE_ERROR(thread, "File is closed.");             \
+    if (file->mode != fileMode && fileMode == FILE_READER)                 \
+      NATIVE_ERROR(thread, "File is not open for reading.");               \
+    if (file->mode != fileMode)                                            \
+      NATIVE_ERROR(thread, "File is not open for writing.");               \
+    file;                                                                  \
+  })
+
+static inline bool __nativeFileReadLine(void *thread, int argCount,
+                                        Value *args) {
+  ObjFile *file = SAFE_FILE(thread, args, FILE_READER);
+  Value line;
+
+  if (!fsReadLine(thread, file, &line)) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't read file");
+  }
+
+  NATIVE_RETURN(thread, line);
+}
+
+// Strings are written as they are, other values are stringified first.
+static bool fileWriteValue(Thread *thread, ObjFile *file, Value value) {
+  ObjString *string = toString(value);
+
+  // push beforehand to the stack to protect from the GC
+  push(thread, OBJ_VAL(string));
+  bool written = fsWrite(thread, file, string->chars, string->length);
+  pop(thread);
+
+  return written;
+}
+
+static inline bool __nativeFileWrite(void *thread, int argCount,
+                                     Value *args) {
+  ObjFile *file = SAFE_FILE(thread, args, FILE_WRITER);
+
+  if (!fileWriteValue(thread, file, *(++args))) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't write file");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(file));
+}
+
+static inline bool __nativeFileWriteLine(void *thread, int argCount,
+                                         Value *args) {
+  ObjFile *file = SAFE_FILE(thread, args, FILE_WRITER);
+
+  if ((argCount == 1 && !fileWriteValue(thread, file, *(++args))) ||
+      !fsWrite(thread, file, "\n", 1)) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't write file");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(file));
+}
+
+static inline bool __nativeFileFlush(void *thread, int argCount,
+                                     Value *args) {
+  ObjFile *file = SAFE_FILE(thread, args, FILE_WRITER);
+
+  if (!fsFlush(thread, file)) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't write file");
+  }
+
+  NATIVE_RETURN(thread, OBJ_VAL(file));
+}
+
+static inline bool __nativeFileClose(void *thread, int argCount,
+                                     Value *args) {
+  if (!fsClose(thread, AS_FILE(*args))) {
+    NATIVE_SYSTEM_ERROR(thread, "Can't close file");
+  }
+
+  NATIVE_RETURN(thread, NIL_VAL);
+}
+
+// Consume next argument as an array of numbers, otherwise throw error. The
+// operand must be released with freeVectorOperand.
+#define SAFE_CONSUME_VECTOR(thread, args, operand)            \
+  do {                                                        \
+    if (!initVectorOperand(operand, *(++args))) {             \
+      NATIVE_ERROR(thread, "Expected an array of numbers.");  \
+    }                                                         \
+  } while (false)
+
+// Consume the operands of element-wise operations. When number is given, the
+// second operand may be a single number, broadcast to every element.
+static bool consumeVectorOperands(Thread *thread, Value *args,
+                                  VectorOperand *a, VectorOperand *b,
+                                  double *number, bool *broadcast) {
+  SAFE_CONSUME_VECTOR(thread, args, a);
+
+  Value other = *(++args);
+  *broadcast = number != NULL && IS_NUMBER(other);
+  if (*broadcast) {
+    *number = AS_NUMBER(other);
+    b->values = number;
+    b->count = a->count;
+    b->scratch = NULL;
+    return true;
+  }
+
+  if (!initVectorOperand(b, other)) {
+    freeVectorOperand(a);
+    if (number != NULL) {
+      NATIVE_ERROR(thread, "Expected a number or an array of numbers.");
+    }
+    NATIVE_ERROR(thread, "Expected an array of numbers.");
+  }
+
+  if (a->count != b->count) {
+    freeVectorOperand(a);
+    freeVectorOperand(b);
+    NATIVE_ERROR(thread, "Expected arrays of the same length.");
+  }
+
+  return true;
+}
+
+static inline bool __nativeStaticVectorSum(void *thread, int argCount,
+                                           Value *args) {
+  VectorOperand values;
+  SAFE_CONSUME_VECTOR(thread, args, &values);
+
+  double sum = vectorSum(values.values, values.count);
+  freeVectorOperand(&values);
+
+  NATIVE_RETURN(thread, NUMBER_VAL(sum));
+}
+
+static inline bool __nativeStaticVectorMin(void *thread, int argCount,
+                                           Value *args) {
+  VectorOperand values;
+  SAFE_CONSUME_VECTOR(thread, args, &values);
+
+  Value min = values.count > 0
+                  ? NUMBER_VAL(vectorMin(values.values, values.count))
+                  : NIL_VAL;
+  freeVectorOperand(&values);
+
+  NATIVE_RETURN(thread, min);
+}
+
+static inline bool __nativeStaticVectorMax(void *thread, int argCount,
+                                           Value *args) {
+  VectorOperand values;
+  SAFE_CONSUME_VECTOR(thread, args, &values);
+
+  Value max = values.count > 0
+                  ? NUMBER_VAL(vectorMax(values.values, values.count))
+                  : NIL_VAL;
+  freeVectorOperand(&values);
+
+  NATIVE_RETURN(thread, max);
+}
+
+static inline bool __nativeStaticVectorDot(void *thread, int argCount,
+                                           Value *args) {
+  VectorOperand a, b;
+  bool broadcast;
+  if (!consumeVectorOperands(thread, args, &a, &b, NULL, &broadcast)) {
+    return false;
+  }
+
+  double dot = vectorDot(a.values, b.values, a.count);
+  freeVectorOperand(&a);
+  freeVectorOperand(&b);
+
+  NATIVE_RETURN(thread, NUMBER_VAL(dot));
+}
+
+static bool vectorArithmeticOperation(Thread *thread, Value *args,
+                                      VectorOperation operation) {
+  VectorOperand a, b;
+  double number;
+  bool broadcast;
+  if (!consumeVectorOperands(thread, args, &a, &b, &number, &broadcast)) {
+    return false;
+  }
+
+  double *out = beginVectorResult(thread, args[1], a.count);
+  vectorArithmetic(out, a.values, b.values, broadcast, a.count, operation);
+  endVectorResult(thread, out);
+
+  freeVectorOperand(&a);
+  freeVectorOperand(&b);
+  return true;
+}
+
+static inline bool __nativeStaticVectorAdd(void *thread, int argCount,
+                                           Value *args) {
+  return vectorArithmeticOperation(thread, args, VECTOR_ADD);
+}
+
+static inline bool __nativeStaticVectorMul(void *thread, int argCount,
+                                           Value *args) {
+  return vectorArithmeticOperation(thread, args, VECTOR_MUL);
+}
+
+static inline bool __nativeStaticVectorScale(void *thread, int argCount,
+                                             Value *args) {
+  Value source = *(++args);
+  double factor = SAFE_CONSUME_NUMBER(thread, args, "factor");
+
+  VectorOperand values;
+  if (!initVectorOperand(&values, source)) {
+    NATIVE_ERROR(thread, "Expected an array of numbers.");
+  }
+
+  double *out = beginVectorResult(thread, source, values.count);
+  vectorArithmetic(out, values.values, &factor, true, values.count,
+                   VECTOR_MUL);
+  endVectorResult(thread, out);
+
+  freeVectorOperand(&values);
+  return true;
+}
+
+static inline bool __nativeStaticVectorPrefixSum(void *thread, int argCount,
+                                                 Value *args) {
+  VectorOperand values;
+  SAFE_CONSUME_VECTOR(thread, args, &values);
+
+  double *out = beginVectorResult(thread, *args, values.count);
+  vectorPrefixSum(out, values.values, values.count);
+  endVectorResult(thread, out);
+
+  freeVectorOperand(&values);
+  return true;
+}
+
+static inline bool __nativeStaticVectorFill(void *thread, int argCount,
+                                            Value *args) {
+  Value target = *(++args);
+  double value = SAFE_CONSUME_NUMBER(thread, args, "value");
+
+  if (IS_ARRAY(target)) {
+    ValueArray *list = &AS_ARRAY(target)->list;
+    for (int idx = 0; idx < list->count; idx++) {
+      list->values[idx] = NUMBER_VAL(value);
+    }
+
+    NATIVE_RETURN(thread, target);
+  }
+
+  if (IS_TYPED_ARRAY(target)) {
+    ObjTypedArray *array = AS_TYPED_ARRAY(target);
+
+    switch (array->kind) {
+      case TYPED_ARRAY_FLOAT64:
+        vectorFill(array->as.float64, value, array->count);
+        break;
+      case TYPED_ARRAY_INT32: {
+        int32_t element = toInt32(value);
+        for (int idx = 0; idx < array->count; idx++) {
+          array->as.int32[idx] = element;
+        }
+        break;
+      }
+      case TYPED_ARRAY_UINT8:
+        memset(array->as.uint8, (uint8_t)toInt32(value), array->count);
+        break;
+    }
+
+    NATIVE_RETURN(thread, target);
+  }
+
+  NATIVE_ERROR(thread, "Expected an array or a typed array.");
+}
+
+static bool vectorRangeOperation(Thread *thread, double start, double end,
+                                 double step) {
+  if (step == 0) {
+    NATIVE_ERROR(thread, "Expected step to be a non zero number.");
+  }
+
+  double count = ceil((end - start) / step);
+  if (!(count > 0)) count = 0;
+  if (count > INT32_MAX) {
+    NATIVE_ERROR(thread, "Expected range to be smaller.");
+  }
+
+  ObjTypedArray *array = newTypedArray(TYPED_ARRAY_FLOAT64, (int)count);
+  vectorRange(array->as.float64, start, step, array->count);
+
+  NATIVE_RETURN(thread, OBJ_VAL(array));
+}
+
+static inline bool __nativeStaticVectorRange(void *thread, int argCount,
+                                             Value *args) {
+  double end = SAFE_CONSUME_NUMBER(thread, args, "end");
+
+  return vectorRangeOperation(thread, 0, end, 1);
+}
+
+static inline bool __nativeStaticVectorRangeFrom(void *thread, int argCount,
+                                                 Value *args) {
+  double start = SAFE_CONSUME_NUMBER(thread, args, "start");
+  double end = SAFE_CONSUME_NUMBER(thread, args, "end");
+
+  return vectorRangeOperation(thread, start, end, 1);
+}
+
+static inline bool __nativeStaticVectorRangeStep(void *thread, int argCount,
+                                                 Value *args) {
+  double start = SAFE_CONSUME_NUMBER(thread, args, "start");
+  double end = SAFE_CONSUME_NUMBER(thread, args, "end");
+  double step = SAFE_CONSUME_NUMBER(thread, args, "step");
+
+  return vectorRangeOperation(thread, start, end, step);
+}
+
+// Comparisons produce a mask, an Uint8Array of ones and zeros
+static bool vectorCompareOperation(Thread *thread, Value *args,
+                                   VectorComparison comparison) {
+  VectorOperand a, b;
+  double number;
+  bool broadcast;
+  if (!consumeVectorOperands(thread, args, &a, &b, &number, &broadcast)) {
+    return false;
+  }
+
+  ObjTypedArray *mask = newTypedArray(TYPED_ARRAY_UINT8, a.count);
+  vectorCompare(mask->as.uint8, a.values, b.values, broadcast, a.count,
+                comparison);
+
+  freeVectorOperand(&a);
+  freeVectorOperand(&b);
+  NATIVE_RETURN(thread, OBJ_VAL(mask));
+}
+
+static inline bool __nativeStaticVectorLess(void *thread, int argCount,
+                                            Value *args) {
+  return vectorCompareOperation(thread, args, VECTOR_LESS);
+}
+
+static inline bool __nativeStaticVectorLessEqual(void *thread, int argCount,
+                                                 Value *args) {
+  return vectorCompareOperation(thread, args, VECTOR_LESS_EQUAL);
+}
+
+static inline bool __nativeStaticVectorGreater(void *thread, int argCount,
+                                               Value *args) {
+  return vectorCompareOperation(thread, args, VECTOR_GREATER);
+}
+
+static inline bool __nativeStaticVectorGreaterEqual(void *thread,
+                                                    int argCount,
+                                                    Value *args) {
+  return vectorCompareOperation(thread, args, VECTOR_GREATER_EQUAL);
+}
+
+static inline bool __nativeStaticVectorEqual(void *thread, int argCount,
+                                             Value *args) {
+  return vectorCompareOperation(thread, args, VECTOR_EQUAL);
+}
+
+static inline bool __nativeStaticObjectKeys(void *thread, int argCount,
+                                            Value *args) {
+  ObjInstance *instance = (ObjInstance *)GCWhiteList(
+      (Obj *)SAFE_CONSUME_OBJECT_INSTANCE(thread, args, "argument"));
+  ObjArray *arr = (ObjArray *)GCWhiteList((Obj *)newArray());
+
+  for (int idx = 0; idx <= instance->properties.capacity; idx++) {
+    Entry *entry = &instance->properties.entries[idx];
+    if (entry->key != NULL) {
+      ObjString *string =
+          (ObjString *)GCWhiteList((Obj *)toString(OBJ_VAL(entry->key)));
+      writeValueArray(&arr->list, OBJ_VAL(string));
+      GCPopWhiteList();
+    }
+  }
+
+  // Pop instance
+  GCPopWhiteList();
+  // Pop array
+  GCPopWhiteList();
+
+  NATIVE_RETURN(thread, OBJ_VAL(arr));
+}
+
+static inline bool __nativeStaticObjectValues(void *thread, int argCount,
+                                              Value *args) {
+  ObjInstance *instance = (ObjInstance *)GCWhiteList(
+      (Obj *)SAFE_CONSUME_OBJECT_INSTANCE(thread, args, "argument"));
+  ObjArray *arr = (ObjArray *)GCWhiteList((Obj *)newArray());
+
+  for (int idx = 0; idx <= instance->properties.capacity; idx++) {
+    Entry *entry = &instance->properties.entries[idx];
+    if (entry->key != NULL) {
+      ObjString *string =
+          (ObjString *)GCWhiteList((Obj *)toString(entry->value));
+      writeValueArray(&arr->list, OBJ_VAL(string));
+      GCPopWhiteList();
+    }
+  }
+
+  // Pop instance
+  GCPopWhiteList();
   // Pop array
   GCPopWhiteList();
 
@@ -1047,275 +2523,450 @@ static inline void inherit(Obj *obj, ObjClass *superclass) {
   }
 }
 
-void initCore(VM *vm) {
+static void defineTypedArrayClass(VM *machine, TypedArrayKind kind,
+                                  const char *metaName, const char *name) {
+  ObjClass *metaClass = defineNewClass(metaName);
+  inherit((Obj *)metaClass, machine->klass);
+
+  bindNativeMethod(&metaClass->methods, "new", __nativeStaticTypedArrayNew,
+                   ARGS_ARITY_1);
+  bindNativeMethod(&metaClass->methods, name, __nativeStaticTypedArrayNew,
+                   ARGS_ARITY_1);
+
+  ObjClass *klass = defineNewClass(name);
+  inherit((Obj *)klass, metaClass);
+  machine->typedArrayClasses[kind] = klass;
+
+  bindNativeMethod(&klass->methods, "length", __nativeTypedArrayLength,
+                   ARGS_ARITY_0);
+  bindNativeMethod(&klass->methods, "toArray", __nativeTypedArrayToArray,
+                   ARGS_ARITY_0);
+}
+
+// AtomicArray methods share the Atomic natives, with the index as one more
+// argument
+static void defineAtomicClass(VM *machine, ObjClass **klass,
+                              const char *metaName, const char *name,
+                              int arity) {
+  ObjClass *metaClass = defineNewClass(metaName);
+  inherit((Obj *)metaClass, machine->klass);
+
+  for (int args = arity; args <= 1; args++) {
+    bindNativeMethod(&metaClass->methods, "new", __nativeStaticAtomicNew,
+                     args);
+    bindNativeMethod(&metaClass->methods, name, __nativeStaticAtomicNew,
+                     args);
+    bindNativeMethod(&metaClass->methods, "float64",
+                     __nativeStaticAtomicFloat64, args);
+  }
+
+  *klass = defineNewClass(name);
+  inherit((Obj *)*klass, metaClass);
+
+  static const struct {
+    const char *name;
+    NativeFn function;
+    int operands;
+  } methods[] = {{"load", __nativeAtomicLoad, 0},
+                 {"store", __nativeAtomicStore, 1},
+                 {"add", __nativeAtomicAdd, 1},
+                 {"sub", __nativeAtomicSub, 1},
+                 {"bitAnd", __nativeAtomicAnd, 1},
+                 {"bitOr", __nativeAtomicOr, 1},
+                 {"bitXor", __nativeAtomicXor, 1},
+                 {"exchange", __nativeAtomicExchange, 1},
+                 {"compareExchange", __nativeAtomicCompareExchange, 2}};
+
+  // Memory order is optional
+  for (size_t idx = 0; idx < sizeof(methods) / sizeof(methods[0]); idx++) {
+    bindNativeMethod(&(*klass)->methods, methods[idx].name,
+                     methods[idx].function, methods[idx].operands + arity);
+    bindNativeMethod(&(*klass)->methods, methods[idx].name,
+                     methods[idx].function, methods[idx].operands + arity + 1);
+  }
+}
+
+void initCore(VM *machine) {
   //                        System class initialization
   //
   // The order which class are initialized is extremely important to ensure the
   // propper inheritance.
 
-  vm->klass = NULL;
-  vm->metaArrayClass = NULL;
-  vm->metaStringClass = NULL;
-  vm->metaNumberClass = NULL;
-  vm->metaMathClass = NULL;
-  vm->metaErrorClass = NULL;
-  vm->metaSystemClass = NULL;
-  vm->metaObjectClass = NULL;
-  vm->nilClass = NULL;
-  vm->boolClass = NULL;
-  vm->numberClass = NULL;
-  vm->mathClass = NULL;
-  vm->stringClass = NULL;
-  vm->functionClass = NULL;
-  vm->nativeFunctionClass = NULL;
-  vm->arrayClass = NULL;
-  vm->errorClass = NULL;
-  vm->moduleExportsClass = NULL;
-  vm->systemClass = NULL;
-  vm->objectClass = NULL;
+  machine->klass = NULL;
+  machine->metaArrayClass = NULL;
+  machine->metaStringClass = NULL;
+  machine->metaNumberClass = NULL;
+  machine->metaMathClass = NULL;
+  machine->metaErrorClass = NULL;
+  machine->metaSystemClass = NULL;
+  machine->metaObjectClass = NULL;
+  machine->nilClass = NULL;
+  machine->boolClass = NULL;
+  machine->numberClass = NULL;
+  machine->mathClass = NULL;
+  machine->stringClass = NULL;
+  machine->functionClass = NULL;
+  machine->nativeFunctionClass = NULL;
+  machine->arrayClass = NULL;
+  machine->errorClass = NULL;
+  machine->moduleExportsClass = NULL;
+  machine->systemClass = NULL;
+  machine->objectClass = NULL;
+  machine->metaStringBuilderClass = NULL;
+  machine->stringBuilderClass = NULL;
+  machine->fileClass = NULL;
+  machine->futureClass = NULL;
+  machine->channelClass = NULL;
+  machine->atomicClass = NULL;
+  machine->atomicArrayClass = NULL;
+  machine->isolateClass = NULL;
+  for (int kind = 0; kind < SYNC_KINDS; kind++) {
+    machine->syncClasses[kind] = NULL;
+  }
+  for (int kind = 0; kind < TYPED_ARRAY_KINDS; kind++) {
+    machine->typedArrayClasses[kind] = NULL;
+  }
 
   // ---------------- Heap alocate structs and bind native native functions ----------------
 
-  vm->klass = defineNewClass("Class");
-  vm->metaStringClass = defineNewClass("MetaString");
-  vm->stringClass = defineNewClass("String");
-  vm->nativeFunctionClass = defineNewClass("NativeFunction");
+  machine->klass = defineNewClass("Class");
+  machine->metaStringClass = defineNewClass("MetaString");
+  machine->stringClass = defineNewClass("String");
+  machine->nativeFunctionClass = defineNewClass("NativeFunction");
 
-  bindNativeMethod(&vm->klass->methods, "toString", __nativeClassToString,
+  bindNativeMethod(&machine->klass->methods, "toString", __nativeClassToString,
                        ARGS_ARITY_0);
 
   // Class inherits from itself
-  vm->klass->obj.klass = vm->klass;
+  machine->klass->obj.klass = machine->klass;
 
-  inherit((Obj *)vm->metaStringClass, vm->klass);
+  inherit((Obj *)machine->metaStringClass, machine->klass);
 
-  bindNativeMethod(&vm->metaStringClass->methods, "isString",
+  bindNativeMethod(&machine->metaStringClass->methods, "isString",
                        __nativeStaticStringIsString, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaStringClass->methods, "new",
+  bindNativeMethod(&machine->metaStringClass->methods, "new",
                        __nativeStaticStringNew, ARGS_ARITY_0);
-  bindNativeMethod(&vm->metaStringClass->methods, "new",
+  bindNativeMethod(&machine->metaStringClass->methods, "new",
                        __nativeStaticStringNew, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaStringClass->methods, "String",
+  bindNativeMethod(&machine->metaStringClass->methods, "String",
                        __nativeStaticStringNew, ARGS_ARITY_0);
-  bindNativeMethod(&vm->metaStringClass->methods, "String",
+  bindNativeMethod(&machine->metaStringClass->methods, "String",
                        __nativeStaticStringNew, ARGS_ARITY_1);
 
-  inherit((Obj *)vm->stringClass, vm->metaStringClass);
+  inherit((Obj *)machine->stringClass, machine->metaStringClass);
 
-  bindNativeMethod(&vm->stringClass->methods, "hash", __nativeStringHash, ARGS_ARITY_0);
-  bindNativeMethod(&vm->stringClass->methods, "toUpperCase",
+  bindNativeMethod(&machine->stringClass->methods, "hash", __nativeStringHash, ARGS_ARITY_0);
+  bindNativeMethod(&machine->stringClass->methods, "toUpperCase",
                        __nativeStringToUpperCase, ARGS_ARITY_0);
-  bindNativeMethod(&vm->stringClass->methods, "toLowerCase",
+  bindNativeMethod(&machine->stringClass->methods, "toLowerCase",
                        __nativeStringToLowerCase, ARGS_ARITY_0);
-  bindNativeMethod(&vm->stringClass->methods, "includes",
+  bindNativeMethod(&machine->stringClass->methods, "includes",
                        __nativeStringIncludes, ARGS_ARITY_0);
-  bindNativeMethod(&vm->stringClass->methods, "includes",
+  bindNativeMethod(&machine->stringClass->methods, "includes",
                        __nativeStringIncludes, ARGS_ARITY_1);
-  bindNativeMethod(&vm->stringClass->methods, "split", __nativeStringSplit,
+  bindNativeMethod(&machine->stringClass->methods, "split", __nativeStringSplit,
                        ARGS_ARITY_1);
-  bindNativeMethod(&vm->stringClass->methods, "substr",
+  bindNativeMethod(&machine->stringClass->methods, "substr",
                        __nativeStringSubstr, ARGS_ARITY_1);
-  bindNativeMethod(&vm->stringClass->methods, "substr",
+  bindNativeMethod(&machine->stringClass->methods, "substr",
                        __nativeStringSubstr, ARGS_ARITY_2);
-  bindNativeMethod(&vm->stringClass->methods, "length",
+  bindNativeMethod(&machine->stringClass->methods, "length",
                        __nativeStringLength, ARGS_ARITY_0);
-  bindNativeMethod(&vm->stringClass->methods, "endsWith",
+  bindNativeMethod(&machine->stringClass->methods, "endsWith",
                        __nativeStringEndsWith, ARGS_ARITY_1);
-  bindNativeMethod(&vm->stringClass->methods, "startsWith",
+  bindNativeMethod(&machine->stringClass->methods, "startsWith",
                        __nativeStringStarsWith, ARGS_ARITY_1);
-  bindNativeMethod(&vm->stringClass->methods, "trimEnd",
+  bindNativeMethod(&machine->stringClass->methods, "trimEnd",
                        __nativeStringTrimEnd, ARGS_ARITY_0);
-  bindNativeMethod(&vm->stringClass->methods, "trimStart",
+  bindNativeMethod(&machine->stringClass->methods, "trimStart",
                        __nativeStringTrimStart, ARGS_ARITY_0);
-  bindNativeMethod(&vm->stringClass->methods, "charCodeAt",
+  bindNativeMethod(&machine->stringClass->methods, "charCodeAt",
                        __nativeStringCharCodeAt, ARGS_ARITY_1);
-  bindNativeMethod(&vm->stringClass->methods, "isEmpty",
+  bindNativeMethod(&machine->stringClass->methods, "isEmpty",
                        __nativeStringIsEmpty, ARGS_ARITY_0);
-  bindNativeMethod(&vm->stringClass->methods, "compare",
+  bindNativeMethod(&machine->stringClass->methods, "compare",
                        __nativeStringCompare, ARGS_ARITY_1);
 
-  inherit((Obj *)vm->nativeFunctionClass, vm->klass);
+  inherit((Obj *)machine->nativeFunctionClass, machine->klass);
 
-  inherit((Obj *)vm->klass->name, vm->stringClass);
-  inherit((Obj *)vm->metaStringClass->name, vm->stringClass);
-  inherit((Obj *)vm->stringClass->name, vm->stringClass);
-  inherit((Obj *)vm->nativeFunctionClass->name, vm->stringClass);
+  inherit((Obj *)machine->klass->name, machine->stringClass);
+  inherit((Obj *)machine->metaStringClass->name, machine->stringClass);
+  inherit((Obj *)machine->stringClass->name, machine->stringClass);
+  inherit((Obj *)machine->nativeFunctionClass->name, machine->stringClass);
 
-  vm->nilClass = defineNewClass("Nil");
-  inherit((Obj *)vm->nilClass, vm->klass);
+  machine->nilClass = defineNewClass("Nil");
+  inherit((Obj *)machine->nilClass, machine->klass);
 
-  vm->boolClass = defineNewClass("Bool");
-  inherit((Obj *)vm->boolClass, vm->klass);
+  machine->boolClass = defineNewClass("Bool");
+  inherit((Obj *)machine->boolClass, machine->klass);
 
-  vm->metaNumberClass = defineNewClass("MetaNumber");
-  inherit((Obj *)vm->metaNumberClass, vm->klass);
+  machine->metaNumberClass = defineNewClass("MetaNumber");
+  inherit((Obj *)machine->metaNumberClass, machine->klass);
 
   // Define Number static methods
-  bindNativeMethod(&vm->metaNumberClass->methods, "isNumber",
+  bindNativeMethod(&machine->metaNumberClass->methods, "isNumber",
                        __nativeStaticNumberIsNumber, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaNumberClass->methods, "toNumber",
+  bindNativeMethod(&machine->metaNumberClass->methods, "toNumber",
                        __nativeStaticNumberToNumber, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaNumberClass->methods, "toInteger",
+  bindNativeMethod(&machine->metaNumberClass->methods, "toInteger",
                        __nativeStaticNumberToInteger, ARGS_ARITY_1);
 
-  vm->numberClass = defineNewClass("Number");
-  inherit((Obj *)vm->numberClass, vm->metaNumberClass);
+  machine->numberClass = defineNewClass("Number");
+  inherit((Obj *)machine->numberClass, machine->metaNumberClass);
 
-  vm->metaMathClass = defineNewClass("MetaMath");
-  inherit((Obj *)vm->metaMathClass, vm->klass);
+  machine->metaMathClass = defineNewClass("MetaMath");
+  inherit((Obj *)machine->metaMathClass, machine->klass);
 
   // Define Math static methods
-  bindNativeMethod(&vm->metaMathClass->methods, "abs",
+  bindNativeMethod(&machine->metaMathClass->methods, "abs",
                        __nativeStaticMathAbs, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaMathClass->methods, "min",
+  bindNativeMethod(&machine->metaMathClass->methods, "min",
                        __nativeStaticMathMin, ARGS_ARITY_2);
-  bindNativeMethod(&vm->metaMathClass->methods, "max",
+  bindNativeMethod(&machine->metaMathClass->methods, "max",
                        __nativeStaticMathMax, ARGS_ARITY_2);
-  bindNativeMethod(&vm->metaMathClass->methods, "clamp",
+  bindNativeMethod(&machine->metaMathClass->methods, "clamp",
                        __nativeStaticMathClamp, ARGS_ARITY_3);
 
-  vm->mathClass = defineNewClass("Math");
-  inherit((Obj *)vm->mathClass, vm->metaMathClass);
+  machine->mathClass = defineNewClass("Math");
+  inherit((Obj *)machine->mathClass, machine->metaMathClass);
 
-  vm->functionClass = defineNewClass("Function");
-  inherit((Obj *)vm->functionClass, vm->klass);
+  machine->functionClass = defineNewClass("Function");
+  inherit((Obj *)machine->functionClass, machine->klass);
 
-  vm->metaArrayClass = defineNewClass("MetaArray");
-  inherit((Obj *)vm->metaArrayClass, vm->klass);
+  machine->metaArrayClass = defineNewClass("MetaArray");
+  inherit((Obj *)machine->metaArrayClass, machine->klass);
 
   // Array static methods
-  bindNativeMethod(&vm->metaArrayClass->methods, "isArray",
+  bindNativeMethod(&machine->metaArrayClass->methods, "isArray",
                        __nativeStaticArrayIsArray, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaArrayClass->methods, "new",
+  bindNativeMethod(&machine->metaArrayClass->methods, "new",
                        __nativeStaticArrayNew, ARGS_ARITY_0);
-  bindNativeMethod(&vm->metaArrayClass->methods, "new",
+  bindNativeMethod(&machine->metaArrayClass->methods, "new",
                        __nativeStaticArrayNew, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaArrayClass->methods, "Array",
+  bindNativeMethod(&machine->metaArrayClass->methods, "Array",
                        __nativeStaticArrayNew, ARGS_ARITY_0);
-  bindNativeMethod(&vm->metaArrayClass->methods, "Array",
+  bindNativeMethod(&machine->metaArrayClass->methods, "Array",
                        __nativeStaticArrayNew, ARGS_ARITY_1);
 
-  vm->arrayClass = defineNewClass("Array");
-  inherit((Obj *)vm->arrayClass, vm->metaArrayClass);
+  machine->arrayClass = defineNewClass("Array");
+  inherit((Obj *)machine->arrayClass, machine->metaArrayClass);
 
   // Array methods
-  bindNativeMethod(&vm->arrayClass->methods, "length", __nativeArrayLength,
+  bindNativeMethod(&machine->arrayClass->methods, "length", __nativeArrayLength,
                        ARGS_ARITY_0);
-  bindNativeMethod(&vm->arrayClass->methods, "push", __nativeArrayPush,
+  bindNativeMethod(&machine->arrayClass->methods, "push", __nativeArrayPush,
                        ARGS_ARITY_1);
-  bindNativeMethod(&vm->arrayClass->methods, "pop", __nativeArrayPop,
+  bindNativeMethod(&machine->arrayClass->methods, "pop", __nativeArrayPop,
                        ARGS_ARITY_0);
-  bindNativeMethod(&vm->arrayClass->methods, "unshift",
+  bindNativeMethod(&machine->arrayClass->methods, "unshift",
                        __nativeArrayUnshift, ARGS_ARITY_1);
-  bindNativeMethod(&vm->arrayClass->methods, "shift", __nativeArrayShift,
+  bindNativeMethod(&machine->arrayClass->methods, "shift", __nativeArrayShift,
                        ARGS_ARITY_0);
-  bindNativeMethod(&vm->arrayClass->methods, "slice", __nativeArraySlice,
+  bindNativeMethod(&machine->arrayClass->methods, "slice", __nativeArraySlice,
                        ARGS_ARITY_0);
-  bindNativeMethod(&vm->arrayClass->methods, "slice", __nativeArraySlice,
+  bindNativeMethod(&machine->arrayClass->methods, "slice", __nativeArraySlice,
                        ARGS_ARITY_1);
-  bindNativeMethod(&vm->arrayClass->methods, "slice", __nativeArraySlice,
+  bindNativeMethod(&machine->arrayClass->methods, "slice", __nativeArraySlice,
                        ARGS_ARITY_2);
-  bindNativeMethod(&vm->arrayClass->methods, "indexOf",
+  bindNativeMethod(&machine->arrayClass->methods, "indexOf",
                        __nativeArrayIndexOf, ARGS_ARITY_1);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_2);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_3);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_4);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_5);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_6);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_7);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_8);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_9);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_10);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_11);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_12);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_13);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_14);
-  bindNativeMethod(&vm->arrayClass->methods, "insert", __nativeArrayInsert,
+  bindNativeMethod(&machine->arrayClass->methods, "insert", __nativeArrayInsert,
                        ARGS_ARITY_15);
-  bindNativeMethod(&vm->arrayClass->methods, "remove", __nativeArrayRemove,
+  bindNativeMethod(&machine->arrayClass->methods, "remove", __nativeArrayRemove,
                        ARGS_ARITY_2);
-  bindNativeMethod(&vm->arrayClass->methods, "take", __nativeArrayTake,
+  bindNativeMethod(&machine->arrayClass->methods, "take", __nativeArrayTake,
                        ARGS_ARITY_1);
-  bindNativeMethod(&vm->arrayClass->methods, "join", __nativeArrayJoin,
+  bindNativeMethod(&machine->arrayClass->methods, "join", __nativeArrayJoin,
                        ARGS_ARITY_1);
-  bindNativeMethod(&vm->arrayClass->methods, "reverse",
+  bindNativeMethod(&machine->arrayClass->methods, "reverse",
                        __nativeArrayReverse, ARGS_ARITY_0);
-
-  vm->metaErrorClass = defineNewClass("MetaError");
-  inherit((Obj *)vm->metaErrorClass, vm->klass);
-
-  bindNativeMethod(&vm->metaErrorClass->methods, "new",
+  bindNativeMethod(&machine->arrayClass->methods, "__parallelChunks",
+                       __nativeArrayParallelChunks, ARGS_ARITY_1);
+
+  machine->metaStringBuilderClass = defineNewClass("MetaStringBuilder");
+  inherit((Obj *)machine->metaStringBuilderClass, machine->klass);
+
+  // StringBuilder static methods
+  bindNativeMethod(&machine->metaStringBuilderClass->methods, "new",
+                       __nativeStaticStringBuilderNew, ARGS_ARITY_0);
+  bindNativeMethod(&machine->metaStringBuilderClass->methods, "new",
+                       __nativeStaticStringBuilderNew, ARGS_ARITY_1);
+  bindNativeMethod(&machine->metaStringBuilderClass->methods, "StringBuilder",
+                       __nativeStaticStringBuilderNew, ARGS_ARITY_0);
+  bindNativeMethod(&machine->metaStringBuilderClass->methods, "StringBuilder",
+                       __nativeStaticStringBuilderNew, ARGS_ARITY_1);
+
+  machine->stringBuilderClass = defineNewClass("StringBuilder");
+  inherit((Obj *)machine->stringBuilderClass, machine->metaStringBuilderClass);
+
+  // StringBuilder methods
+  bindNativeMethod(&machine->stringBuilderClass->methods, "append",
+                       __nativeStringBuilderAppend, ARGS_ARITY_1);
+  bindNativeMethod(&machine->stringBuilderClass->methods, "length",
+                       __nativeStringBuilderLength, ARGS_ARITY_0);
+  bindNativeMethod(&machine->stringBuilderClass->methods, "clear",
+                       __nativeStringBuilderClear, ARGS_ARITY_0);
+
+  defineTypedArrayClass(machine, TYPED_ARRAY_FLOAT64, "MetaFloat64Array",
+                        "Float64Array");
+  defineTypedArrayClass(machine, TYPED_ARRAY_INT32, "MetaInt32Array", "Int32Array");
+  defineTypedArrayClass(machine, TYPED_ARRAY_UINT8, "MetaUint8Array", "Uint8Array");
+
+  defineAtomicClass(machine, &machine->atomicClass, "MetaAtomic", "Atomic", 0);
+  defineAtomicClass(machine, &machine->atomicArrayClass, "MetaAtomicArray",
+                    "AtomicArray", 1);
+
+  bindNativeMethod(&machine->atomicArrayClass->methods, "length",
+                   __nativeAtomicArrayLength, ARGS_ARITY_0);
+  bindNativeMethod(&machine->atomicArrayClass->methods, "toArray",
+                   __nativeAtomicArrayToArray, ARGS_ARITY_0);
+
+  machine->metaErrorClass = defineNewClass("MetaError");
+  inherit((Obj *)machine->metaErrorClass, machine->klass);
+
+  bindNativeMethod(&machine->metaErrorClass->methods, "new",
                        __nativeStaticErrorNew, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaErrorClass->methods, "Error",
+  bindNativeMethod(&machine->metaErrorClass->methods, "Error",
                        __nativeStaticErrorNew, ARGS_ARITY_1);
 
-  vm->errorClass = defineNewClass("Error");
-  inherit((Obj *)vm->errorClass, vm->metaErrorClass);
+  machine->errorClass = defineNewClass("Error");
+  inherit((Obj *)machine->errorClass, machine->metaErrorClass);
 
-  vm->moduleExportsClass = defineNewClass("Exports");
-  inherit((Obj *)vm->moduleExportsClass, vm->klass);
+  machine->moduleExportsClass = defineNewClass("Exports");
+  inherit((Obj *)machine->moduleExportsClass, machine->klass);
 
-  vm->metaSystemClass = defineNewClass("MetaSystem");
-  inherit((Obj *)vm->metaSystemClass, vm->klass);
+  machine->metaSystemClass = defineNewClass("MetaSystem");
+  inherit((Obj *)machine->metaSystemClass, machine->klass);
 
-  bindNativeMethod(&vm->metaSystemClass->methods, "clock",
+  bindNativeMethod(&machine->metaSystemClass->methods, "clock",
                        __nativeSystemClock, ARGS_ARITY_0);
-  bindNativeMethod(&vm->metaSystemClass->methods, "log", __nativeSystemLog,
+  bindNativeMethod(&machine->metaSystemClass->methods, "log", __nativeSystemLog,
                        ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaSystemClass->methods, "scan",
+  bindNativeMethod(&machine->metaSystemClass->methods, "scan",
                        __nativeSystemScan, ARGS_ARITY_0);
+  bindNativeMethod(&machine->metaSystemClass->methods, "flush",
+                       __nativeSystemFlush, ARGS_ARITY_0);
+  bindNativeMethod(&machine->metaSystemClass->methods, "flushPolicy",
+                       __nativeSystemFlushPolicy, ARGS_ARITY_1);
 
-  vm->systemClass = defineNewClass("System");
-  inherit((Obj *)vm->systemClass, vm->metaSystemClass);
+  machine->systemClass = defineNewClass("System");
+  inherit((Obj *)machine->systemClass, machine->metaSystemClass);
 
-  vm->metaObjectClass = defineNewClass("MetaObject");
-  inherit((Obj *)vm->metaObjectClass, vm->klass);
+  machine->metaObjectClass = defineNewClass("MetaObject");
+  inherit((Obj *)machine->metaObjectClass, machine->klass);
 
   // Object static methods
-  bindNativeMethod(&vm->metaObjectClass->methods, "keys",
+  bindNativeMethod(&machine->metaObjectClass->methods, "keys",
                        __nativeStaticObjectKeys, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaObjectClass->methods, "values",
+  bindNativeMethod(&machine->metaObjectClass->methods, "values",
                        __nativeStaticObjectValues, ARGS_ARITY_1);
-  bindNativeMethod(&vm->metaObjectClass->methods, "entries",
+  bindNativeMethod(&machine->metaObjectClass->methods, "entries",
                        __nativeStaticObjectEntries, ARGS_ARITY_1);
 
-  vm->objectClass = defineNewClass("Object");
-  inherit((Obj *)vm->objectClass, vm->metaObjectClass);
+  machine->objectClass = defineNewClass("Object");
+  inherit((Obj *)machine->objectClass, machine->metaObjectClass);
 
   // -------------------------------- Bind native modules to native modules table ---------
 
-  initTable(&vm->modules);
+  initTable(&machine->modules);
 
   // Bind "threads" module
 
   ObjClass* metaThreadsClass = defineNewClass("MetaThreads");
-  inherit((Obj *)metaThreadsClass, vm->klass);
+  inherit((Obj *)metaThreadsClass, machine->klass);
 
   bindNativeMethod(&metaThreadsClass->methods, "start", __nativeSystemThreadingStart, ARGS_ARITY_1);
+  bindNativeMethod(&metaThreadsClass->methods, "spawn", __nativeSystemThreadingSpawn, ARGS_ARITY_1);
+  bindNativeMethod(&metaThreadsClass->methods, "yield", __nativeSystemThreadingYield, ARGS_ARITY_0);
   bindNativeMethod(&metaThreadsClass->methods, "join", __nativeSystemThreadingJoin, ARGS_ARITY_1);
+  bindNativeMethod(&metaThreadsClass->methods, "all", __nativeSystemThreadingAll, ARGS_ARITY_1);
+  bindNativeMethod(&metaThreadsClass->methods, "any", __nativeSystemThreadingAny, ARGS_ARITY_1);
 
   ObjClass* threadsClass = defineNewClass("Threads");
   inherit((Obj* ) threadsClass, metaThreadsClass);
 
-  tableSet(&vm->modules, CONSTANT_STRING("threads"), OBJ_VAL(threadsClass));
+  tableSet(&machine->modules, CONSTANT_STRING("threads"), OBJ_VAL(threadsClass));
+
+  machine->futureClass = defineNewClass("Future");
+  inherit((Obj *)machine->futureClass, machine->klass);
+
+  // Future methods
+  bindNativeMethod(&machine->futureClass->methods, "isDone", __nativeFutureIsDone,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&machine->futureClass->methods, "get", __nativeFutureGet,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&machine->futureClass->methods, "get", __nativeFutureGet,
+                       ARGS_ARITY_1);
+  bindNativeMethod(&machine->futureClass->methods, "then", __nativeFutureThen,
+                       ARGS_ARITY_1);
+
+  // Bind "channel" module
+
+  ObjClass* metaChannelClass = defineNewClass("MetaChannel");
+  inherit((Obj *)metaChannelClass, machine->klass);
+
+  bindNativeMethod(&metaChannelClass->methods, "new",
+                       __nativeStaticChannelNew, ARGS_ARITY_1);
+  bindNativeMethod(&metaChannelClass->methods, "Channel",
+                       __nativeStaticChannelNew, ARGS_ARITY_1);
+  bindNativeMethod(&metaChannelClass->methods, "select",
+                       __nativeStaticChannelSelect, ARGS_ARITY_1);
+  bindNativeMethod(&metaChannelClass->methods, "trySelect",
+                       __nativeStaticChannelTrySelect, ARGS_ARITY_1);
+
+  machine->channelClass = defineNewClass("Channel");
+  inherit((Obj *)machine->channelClass, metaChannelClass);
+
+  // Channel methods
+  bindNativeMethod(&machine->channelClass->methods, "send", __nativeChannelSend,
+                       ARGS_ARITY_1);
+  bindNativeMethod(&machine->channelClass->methods, "trySend",
+                       __nativeChannelTrySend, ARGS_ARITY_1);
+  bindNativeMethod(&machine->channelClass->methods, "receive",
+                       __nativeChannelReceive, ARGS_ARITY_0);
+  bindNativeMethod(&machine->channelClass->methods, "tryReceive",
+                       __nativeChannelTryReceive, ARGS_ARITY_0);
+  bindNativeMethod(&machine->channelClass->methods, "close", __nativeChannelClose,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&machine->channelClass->methods, "isClosed",
+                       __nativeChannelIsClosed, ARGS_ARITY_0);
+  bindNativeMethod(&machine->channelClass->methods, "length",
+                       __nativeChannelLength, ARGS_ARITY_0);
+  bindNativeMethod(&machine->channelClass->methods, "capacity",
+                       __nativeChannelCapacity, ARGS_ARITY_0);
+
+  tableSet(&machine->modules, CONSTANT_STRING("channel"), OBJ_VAL(machine->channelClass));
 
   // Bind "sync" module
 
   ObjClass* metaSystemSyncClass = defineNewClass("MetaSync");
-  inherit((Obj *)metaSystemSyncClass, vm->klass);
+  inherit((Obj *)metaSystemSyncClass, machine->klass);
 
   bindNativeMethod(&metaSystemSyncClass->methods, "lockInit",
                        __nativeStaticSystemSyncLockInit, ARGS_ARITY_1);
@@ -1330,32 +2981,282 @@ void initCore(VM *vm) {
   bindNativeMethod(&metaSystemSyncClass->methods, "semWait",
                        __nativeStaticSystemSyncSemaphoreWait, ARGS_ARITY_1);
 
+  bindNativeMethod(&metaSystemSyncClass->methods, "mutex",
+                       __nativeStaticSyncMutex, ARGS_ARITY_0);
+  bindNativeMethod(&metaSystemSyncClass->methods, "semaphore",
+                       __nativeStaticSyncSemaphore, ARGS_ARITY_1);
+  bindNativeMethod(&metaSystemSyncClass->methods, "rwlock",
+                       __nativeStaticSyncRWLock, ARGS_ARITY_0);
+  bindNativeMethod(&metaSystemSyncClass->methods, "condition",
+                       __nativeStaticSyncCondition, ARGS_ARITY_0);
+
   ObjClass* syncClass = defineNewClass("Sync");
   inherit((Obj *)syncClass, metaSystemSyncClass);
 
-  tableSet(&vm->modules, CONSTANT_STRING("sync"), OBJ_VAL(syncClass));
+  ObjClass* mutexClass = defineNewClass("Mutex");
+  inherit((Obj *)mutexClass, machine->klass);
+  machine->syncClasses[SYNC_MUTEX] = mutexClass;
+
+  bindNativeMethod(&mutexClass->methods, "lock", __nativeMutexLock,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&mutexClass->methods, "tryLock", __nativeMutexTryLock,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&mutexClass->methods, "unlock", __nativeMutexUnlock,
+                       ARGS_ARITY_0);
+
+  ObjClass* semaphoreClass = defineNewClass("Semaphore");
+  inherit((Obj *)semaphoreClass, machine->klass);
+  machine->syncClasses[SYNC_SEMAPHORE] = semaphoreClass;
+
+  bindNativeMethod(&semaphoreClass->methods, "wait", __nativeSemaphoreWait,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&semaphoreClass->methods, "tryWait",
+                       __nativeSemaphoreTryWait, ARGS_ARITY_0);
+  bindNativeMethod(&semaphoreClass->methods, "post", __nativeSemaphorePost,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&semaphoreClass->methods, "value", __nativeSemaphoreValue,
+                       ARGS_ARITY_0);
+
+  ObjClass* rwlockClass = defineNewClass("RWLock");
+  inherit((Obj *)rwlockClass, machine->klass);
+  machine->syncClasses[SYNC_RWLOCK] = rwlockClass;
+
+  bindNativeMethod(&rwlockClass->methods, "readLock", __nativeRWLockReadLock,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&rwlockClass->methods, "writeLock",
+                       __nativeRWLockWriteLock, ARGS_ARITY_0);
+  bindNativeMethod(&rwlockClass->methods, "tryReadLock",
+                       __nativeRWLockTryReadLock, ARGS_ARITY_0);
+  bindNativeMethod(&rwlockClass->methods, "tryWriteLock",
+                       __nativeRWLockTryWriteLock, ARGS_ARITY_0);
+  bindNativeMethod(&rwlockClass->methods, "unlock", __nativeRWLockUnlock,
+                       ARGS_ARITY_0);
+
+  ObjClass* conditionClass = defineNewClass("Condition");
+  inherit((Obj *)conditionClass, machine->klass);
+  machine->syncClasses[SYNC_CONDITION] = conditionClass;
+
+  bindNativeMethod(&conditionClass->methods, "wait", __nativeConditionWait,
+                       ARGS_ARITY_1);
+  bindNativeMethod(&conditionClass->methods, "wait", __nativeConditionWait,
+                       ARGS_ARITY_2);
+  bindNativeMethod(&conditionClass->methods, "signal",
+                       __nativeConditionSignal, ARGS_ARITY_0);
+  bindNativeMethod(&conditionClass->methods, "broadcast",
+                       __nativeConditionBroadcast, ARGS_ARITY_0);
+
+  tableSet(&machine->modules, CONSTANT_STRING("sync"), OBJ_VAL(syncClass));
+
+  // Bind "isolate" module
+
+  ObjClass *metaIsolateClass = defineNewClass("MetaIsolate");
+  inherit((Obj *)metaIsolateClass, machine->klass);
+
+  bindNativeMethod(&metaIsolateClass->methods, "spawn",
+                   __nativeStaticIsolateSpawn, ARGS_ARITY_1);
+  bindNativeMethod(&metaIsolateClass->methods, "parent",
+                   __nativeStaticIsolateParent, ARGS_ARITY_0);
+
+  machine->isolateClass = defineNewClass("Isolate");
+  inherit((Obj *)machine->isolateClass, metaIsolateClass);
+
+  // Isolate methods
+  bindNativeMethod(&machine->isolateClass->methods, "send", __nativeIsolateSend,
+                   ARGS_ARITY_1);
+  bindNativeMethod(&machine->isolateClass->methods, "receive",
+                   __nativeIsolateReceive, ARGS_ARITY_0);
+  bindNativeMethod(&machine->isolateClass->methods, "close", __nativeIsolateClose,
+                   ARGS_ARITY_0);
+  bindNativeMethod(&machine->isolateClass->methods, "wait", __nativeIsolateWait,
+                   ARGS_ARITY_0);
+
+  tableSet(&machine->modules, CONSTANT_STRING("isolate"), OBJ_VAL(machine->isolateClass));
+
+  // Bind "events" module
+
+  ObjClass* metaEventsClass = defineNewClass("MetaEvents");
+  inherit((Obj *)metaEventsClass, machine->klass);
+
+  bindNativeMethod(&metaEventsClass->methods, "timeout",
+                       __nativeStaticEventsTimeout, ARGS_ARITY_1);
+  bindNativeMethod(&metaEventsClass->methods, "readable",
+                       __nativeStaticEventsReadable, ARGS_ARITY_1);
+  bindNativeMethod(&metaEventsClass->methods, "writable",
+                       __nativeStaticEventsWritable, ARGS_ARITY_1);
+  bindNativeMethod(&metaEventsClass->methods, "setTimeout",
+                       __nativeStaticEventsSetTimeout, ARGS_ARITY_2);
+
+  ObjClass* eventsClass = defineNewClass("Events");
+  inherit((Obj *)eventsClass, metaEventsClass);
+
+  tableSet(&machine->modules, CONSTANT_STRING("events"), OBJ_VAL(eventsClass));
+
+  // Bind "fs" module
+
+  ObjClass* metaFsClass = defineNewClass("MetaFs");
+  inherit((Obj *)metaFsClass, machine->klass);
+
+  bindNativeMethod(&metaFsClass->methods, "readFile",
+                       __nativeStaticFsReadFile, ARGS_ARITY_1);
+  bindNativeMethod(&metaFsClass->methods, "readBytes",
+                       __nativeStaticFsReadBytes, ARGS_ARITY_1);
+  bindNativeMethod(&metaFsClass->methods, "writeFile",
+                       __nativeStaticFsWriteFile, ARGS_ARITY_2);
+  bindNativeMethod(&metaFsClass->methods, "open", __nativeStaticFsOpen,
+                       ARGS_ARITY_1);
+  bindNativeMethod(&metaFsClass->methods, "create", __nativeStaticFsCreate,
+                       ARGS_ARITY_1);
+  bindNativeMethod(&metaFsClass->methods, "append", __nativeStaticFsAppend,
+                       ARGS_ARITY_1);
+
+  ObjClass* fsClass = defineNewClass("Fs");
+  inherit((Obj *)fsClass, metaFsClass);
+
+  tableSet(&machine->modules, CONSTANT_STRING("fs"), OBJ_VAL(fsClass));
+
+  machine->fileClass = defineNewClass("File");
+  inherit((Obj *)machine->fileClass, machine->klass);
+
+  // File methods
+  bindNativeMethod(&machine->fileClass->methods, "readLine", __nativeFileReadLine,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&machine->fileClass->methods, "write", __nativeFileWrite,
+                       ARGS_ARITY_1);
+  bindNativeMethod(&machine->fileClass->methods, "writeLine",
+                       __nativeFileWriteLine, ARGS_ARITY_0);
+  bindNativeMethod(&machine->fileClass->methods, "writeLine",
+                       __nativeFileWriteLine, ARGS_ARITY_1);
+  bindNativeMethod(&machine->fileClass->methods, "flush", __nativeFileFlush,
+                       ARGS_ARITY_0);
+  bindNativeMethod(&machine->fileClass->methods, "close", __nativeFileClose,
+                       ARGS_ARITY_0);
+
+  // Bind "vector" module
+
+  initVectorKernels();
+
+  ObjClass* metaVectorClass = defineNewClass("MetaVector");
+  inherit((Obj *)metaVectorClass, machine->klass);
+
+  bindNativeMethod(&metaVectorClass->methods, "sum", __nativeStaticVectorSum,
+                       ARGS_ARITY_1);
+  bindNativeMethod(&metaVectorClass->methods, "min", __nativeStaticVectorMin,
+                       ARGS_ARITY_1);
+  bindNativeMethod(&metaVectorClass->methods, "max", __nativeStaticVectorMax,
+                       ARGS_ARITY_1);
+  bindNativeMethod(&metaVectorClass->methods, "dot", __nativeStaticVectorDot,
+                       ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "add", __nativeStaticVectorAdd,
+                       ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "mul", __nativeStaticVectorMul,
+                       ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "scale",
+                       __nativeStaticVectorScale, ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "prefixSum",
+                       __nativeStaticVectorPrefixSum, ARGS_ARITY_1);
+  bindNativeMethod(&metaVectorClass->methods, "fill",
+                       __nativeStaticVectorFill, ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "range",
+                       __nativeStaticVectorRange, ARGS_ARITY_1);
+  bindNativeMethod(&metaVectorClass->methods, "range",
+                       __nativeStaticVectorRangeFrom, ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "range",
+                       __nativeStaticVectorRangeStep, ARGS_ARITY_3);
+  bindNativeMethod(&metaVectorClass->methods, "less",
+                       __nativeStaticVectorLess, ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "lessEqual",
+                       __nativeStaticVectorLessEqual, ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "greater",
+                       __nativeStaticVectorGreater, ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "greaterEqual",
+                       __nativeStaticVectorGreaterEqual, ARGS_ARITY_2);
+  bindNativeMethod(&metaVectorClass->methods, "equal",
+                       __nativeStaticVectorEqual, ARGS_ARITY_2);
+
+  ObjClass* vectorClass = defineNewClass("Vector");
+  inherit((Obj *)vectorClass, metaVectorClass);
+
+  tableSet(&machine->modules, CONSTANT_STRING("vector"), OBJ_VAL(vectorClass));
 
   // -------------------------------- Extending core --------------------------------
   
-  vm->state = EXTENDING_CORE;
+  machine->state = EXTENDING_CORE;
   
   interpret(coreExtension, NULL);
 
-  tableSet(&vm->program.global, vm->errorClass->name, OBJ_VAL(vm->errorClass));
-  tableSet(&vm->program.global, vm->stringClass->name,
-           OBJ_VAL(vm->stringClass));
-  tableSet(&vm->program.global, vm->numberClass->name,
-           OBJ_VAL(vm->numberClass));
-  tableSet(&vm->program.global, vm->mathClass->name, OBJ_VAL(vm->mathClass));
-  tableSet(&vm->program.global, vm->arrayClass->name, OBJ_VAL(vm->arrayClass));
-  tableSet(&vm->program.global, vm->systemClass->name,
-           OBJ_VAL(vm->systemClass));
-  tableSet(&vm->program.global, vm->objectClass->name,
-           OBJ_VAL(vm->objectClass));
+  tableSet(&machine->program.global, machine->errorClass->name, OBJ_VAL(machine->errorClass));
+  tableSet(&machine->program.global, machine->stringClass->name,
+           OBJ_VAL(machine->stringClass));
+  tableSet(&machine->program.global, machine->numberClass->name,
+           OBJ_VAL(machine->numberClass));
+  tableSet(&machine->program.global, machine->mathClass->name, OBJ_VAL(machine->mathClass));
+  tableSet(&machine->program.global, machine->arrayClass->name, OBJ_VAL(machine->arrayClass));
+  tableSet(&machine->program.global, machine->stringBuilderClass->name,
+           OBJ_VAL(machine->stringBuilderClass));
+  for (int kind = 0; kind < TYPED_ARRAY_KINDS; kind++) {
+    tableSet(&machine->program.global, machine->typedArrayClasses[kind]->name,
+             OBJ_VAL(machine->typedArrayClasses[kind]));
+  }
+  tableSet(&machine->program.global, machine->atomicClass->name,
+           OBJ_VAL(machine->atomicClass));
+  tableSet(&machine->program.global, machine->atomicArrayClass->name,
+           OBJ_VAL(machine->atomicArrayClass));
+  tableSet(&machine->program.global, machine->systemClass->name,
+           OBJ_VAL(machine->systemClass));
+  tableSet(&machine->program.global, machine->objectClass->name,
+           OBJ_VAL(machine->objectClass));
 
   // -------------------------------- Extending modules --------------------------------
            
-  vm->state = EXTENDING_MODULES;
+  machine->state = EXTENDING_MODULES;
 
   interpret(modulesExtension, NULL);
 }
+
+void defineHostFunction(VM *machine, const char *name, NativeFn function,
+                        Arity arity) {
+  ObjString *string = copyString(name, strlen(name));
+  ObjNativeFn *native = newNativeFunction(function, string, arity);
+  Value value;
+
+  // Overloading an existing host function
+  if (tableGet(&machine->program.global, string, &value) &&
+      IS_BOUND_OVERLOADED_METHOD(value) &&
+      AS_BOUND_OVERLOADED_METHOD(value)->overloadedMethod->type ==
+          NATIVE_METHOD) {
+    AS_BOUND_OVERLOADED_METHOD(value)
+        ->overloadedMethod->as.nativeMethods[arity] = native;
+    return;
+  }
+
+  // Host functions are natives bound to nil
+  ObjOverloadedMethod *overloadedMethod = newNativeOverloadedMethod(string);
+  overloadedMethod->as.nativeMethods[arity] = native;
+  tableSet(&machine->program.global, string,
+           OBJ_VAL(newBoundOverloadedMethod(NIL_VAL, overloadedMethod)));
+}
+
+void defineHostModuleFunction(VM *machine, const char *module,
+                              const char *name, NativeFn function,
+                              Arity arity) {
+  ObjString *moduleName = copyString(module, strlen(module));
+  Value value;
+
+  // Host modules are classes of static methods, like the native modules
+  if (!tableGet(&machine->modules, moduleName, &value)) {
+    char metaName[256];
+    snprintf(metaName, sizeof(metaName), "Meta%s", module);
+
+    ObjClass *metaClass = defineNewClass(metaName);
+    inherit((Obj *)metaClass, machine->klass);
+
+    ObjClass *klass = newClass(moduleName);
+    inherit((Obj *)klass, metaClass);
+
+    value = OBJ_VAL(klass);
+    tableSet(&machine->modules, moduleName, value);
+  }
+
+  bindNativeMethod(&AS_CLASS(value)->obj.klass->methods, name, function,
+                   arity);
+}
@@ -3,6 +3,13 @@
 
 #include "vm.h"
 
-void initCore(VM* vm);
+void initCore(VM* machine);
+// Defines a global native function, visible to scripts loaded afterwards
+void defineHostFunction(VM* machine, const char* name, NativeFn function,
+                        Arity arity);
+// Binds a native function to the module, scripts import it by its name
+void defineHostModuleFunction(VM* machine, const char* module,
+                              const char* name, NativeFn function,
+                              Arity arity);
 
 #endif
\ No newline at end of file
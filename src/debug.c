@@ -78,6 +78,16 @@ static int constantInstruction(const char* name, Chunk* chunk, int offset) {
   return offset + 2;
 }
 
+static int shortConstantInstruction(const char* name, Chunk* chunk,
+                                    int offset) {
+  uint16_t constantIdx =
+      (uint16_t)(chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+  printf("%-16s %4d '", name, constantIdx);
+  printValue(chunk->constants.values[constantIdx]);
+  printf("'\n");
+  return offset + 3;
+}
+
 static int flaggedConstantInstruction(const char* name, Chunk* chunk,
                                       int offset) {
   uint8_t constantIdx = chunk->code[offset + 1];
@@ -132,10 +142,14 @@ int disassembleInstruction(Chunk* chunk, int offset) {
       return byteInstruction("OP_SET_UPVALUE", chunk, offset);
     case OP_CALL:
       return byteInstruction("OP_CALL", chunk, offset);
+    case OP_TAIL_CALL:
+      return byteInstruction("OP_TAIL_CALL", chunk, offset);
     case OP_ARRAY:
       return byteInstruction("OP_ARRAY", chunk, offset);
     case OP_INVOKE:
       return invokeInstruction("OP_INVOKE", chunk, offset);
+    case OP_TAIL_INVOKE:
+      return invokeInstruction("OP_TAIL_INVOKE", chunk, offset);
     case OP_CLOSURE: {
       offset++;
       uint8_t constant = chunk->code[offset++];
@@ -202,12 +216,20 @@ int disassembleInstruction(Chunk* chunk, int offset) {
       return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
     case OP_SWITCH:
       return jumpInstruction("OP_SWITCH", 1, chunk, offset);
+    case OP_SWITCH_TABLE:
+      return shortConstantInstruction("OP_SWITCH_TABLE", chunk, offset);
     case OP_SWITCH_CASE:
       return jumpInstruction("OP_SWITCH_CASE", 1, chunk, offset);
     case OP_RANGED_LOOP_SETUP:
       return simpleInstruction("OP_RANGED_LOOP_SETUP", offset);
     case OP_RANGED_LOOP:
       return simpleInstruction("OP_RANGED_LOOP", offset);
+    case OP_RANGED_LOOP_INT_UP:
+      return simpleInstruction("OP_RANGED_LOOP_INT_UP", offset);
+    case OP_RANGED_LOOP_INT_DOWN:
+      return simpleInstruction("OP_RANGED_LOOP_INT_DOWN", offset);
+    case OP_RANGED_LOOP_RESTART:
+      return simpleInstruction("OP_RANGED_LOOP_RESTART", offset);
     case OP_NAMED_LOOP:
       return simpleInstruction("OP_NAMED_LOOP", offset);
     case OP_LOOP:
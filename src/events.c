@@ -0,0 +1,374 @@
+#include "events.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "multithreading.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define EVENTS_EPOLL
+#endif
+
+void initEventLoop(EventLoop* events) {
+  pthread_mutex_init(&events->mutex, NULL);
+  pthread_cond_init(&events->pollerDone, NULL);
+  events->epollFd = -1;
+  events->wakeFd = -1;
+  events->timers = NULL;
+  events->timersCount = 0;
+  events->timersCapacity = 0;
+  events->watches = NULL;
+  events->running = false;
+  events->stopping = false;
+}
+
+#ifdef EVENTS_EPOLL
+
+static double monotonicNow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void wakePoller(EventLoop* events) {
+  uint64_t one = 1;
+  // Only fails when the counter is about to overflow, pending anyway
+  (void)!write(events->wakeFd, &one, sizeof(one));
+}
+
+// Registrations outlive the duplicate while the source is open, so they are
+// removed first
+static void releaseWatch(EventLoop* events, EventWatch* watch) {
+  epoll_ctl(events->epollFd, EPOLL_CTL_DEL, watch->fd, NULL);
+  close(watch->fd);
+  FREE(EventWatch, watch);
+}
+
+// Caller must hold the events mutex
+static void pushTimer(EventLoop* events, EventTimer timer) {
+  if (events->timersCount == events->timersCapacity) {
+    int oldCapacity = events->timersCapacity;
+    events->timersCapacity = GROW_CAPACITY(oldCapacity);
+    events->timers = GROW_ARRAY(EventTimer, events->timers, oldCapacity,
+                                events->timersCapacity);
+  }
+
+  int idx = events->timersCount++;
+  while (idx > 0) {
+    int parent = (idx - 1) / 2;
+    if (events->timers[parent].deadline <= timer.deadline) break;
+
+    events->timers[idx] = events->timers[parent];
+    idx = parent;
+  }
+  events->timers[idx] = timer;
+}
+
+// Caller must hold the events mutex, and there must be a timer
+static EventTimer popTimer(EventLoop* events) {
+  EventTimer first = events->timers[0];
+  EventTimer last = events->timers[--events->timersCount];
+  int count = events->timersCount;
+
+  int idx = 0;
+  for (;;) {
+    int child = 2 * idx + 1;
+    if (child >= count) break;
+    if (child + 1 < count &&
+        events->timers[child + 1].deadline < events->timers[child].deadline) {
+      child++;
+    }
+    if (last.deadline <= events->timers[child].deadline) break;
+
+    events->timers[idx] = events->timers[child];
+    idx = child;
+  }
+  if (count > 0) events->timers[idx] = last;
+
+  return first;
+}
+
+// Caller must hold the events mutex. Milliseconds to the next deadline,
+// rounded up so that timers never fire early, or -1 to wait for a wakeup.
+static int nextTimeout(EventLoop* events) {
+  if (events->timersCount == 0) return -1;
+
+  double remaining = events->timers[0].deadline - monotonicNow();
+  if (remaining <= 0) return 0;
+  if (remaining > INT_MAX / 1000) return INT_MAX;
+
+  return (int)ceil(remaining * 1000);
+}
+
+// Fired watches and timers are taken out of the loop first, and settled once
+// unlocked. The poller isn't in a safezone, so the GC can't miss them.
+static void settleFired(EventLoop* events, struct epoll_event* fired,
+                        int count) {
+  EventWatch* ready = NULL;
+
+  pthread_mutex_lock(&events->mutex);
+  for (int idx = 0; idx < count; idx++) {
+    EventWatch* watch = fired[idx].data.ptr;
+
+    // Wakeups only interrupt the wait, the counter is reset
+    if (watch == NULL) {
+      uint64_t counter;
+      (void)!read(events->wakeFd, &counter, sizeof(counter));
+      continue;
+    }
+
+    // One shot registrations fire once, the watch can't be seen twice
+    if (watch->previous == NULL) {
+      events->watches = watch->next;
+    } else {
+      watch->previous->next = watch->next;
+    }
+    if (watch->next != NULL) watch->next->previous = watch->previous;
+
+    watch->next = ready;
+    ready = watch;
+  }
+  pthread_mutex_unlock(&events->mutex);
+
+  while (ready != NULL) {
+    EventWatch* watch = ready;
+    ready = watch->next;
+
+    settleFuture(watch->future, FUTURE_DONE, watch->source);
+    releaseWatch(events, watch);
+  }
+
+  double now = monotonicNow();
+  for (;;) {
+    pthread_mutex_lock(&events->mutex);
+    if (events->timersCount == 0 || events->timers[0].deadline > now) {
+      pthread_mutex_unlock(&events->mutex);
+      break;
+    }
+    EventTimer timer = popTimer(events);
+    pthread_mutex_unlock(&events->mutex);
+
+    settleFuture(timer.future, FUTURE_DONE, NIL_VAL);
+  }
+}
+
+static void* runPoller(void* ctx) {
+  ActiveThread* thread = (ActiveThread*)ctx;
+  Thread* program = thread->program;
+  currentVM = program->machine;
+  EventLoop* events = &vm.events;
+  struct epoll_event fired[EVENTS_BATCH];
+
+  pthread_mutex_lock(&vm.GCMutex);
+  vm.threadsCounter++;
+  pthread_mutex_unlock(&vm.GCMutex);
+
+  pthread_mutex_lock(&events->mutex);
+  while (!events->stopping) {
+    int timeout = nextTimeout(events);
+    pthread_mutex_unlock(&events->mutex);
+
+    enterGCSafezone(program);
+    int count = epoll_wait(events->epollFd, fired, EVENTS_BATCH, timeout);
+    leaveGCSafezone(program);
+
+    settleFired(events, fired, count > 0 ? count : 0);
+
+    pthread_mutex_lock(&events->mutex);
+  }
+  pthread_mutex_unlock(&events->mutex);
+
+  killThread(thread);
+
+  pthread_mutex_lock(&vm.GCMutex);
+  vm.threadsCounter--;
+  pthread_mutex_unlock(&vm.GCMutex);
+
+  // The VM may be freed as soon as the poller is gone
+  pthread_mutex_lock(&events->mutex);
+  events->running = false;
+  pthread_cond_broadcast(&events->pollerDone);
+  pthread_mutex_unlock(&events->mutex);
+
+  return NULL;
+}
+
+// Caller must hold the events mutex
+static bool startPoller(EventLoop* events) {
+  if (events->running) return true;
+
+  if (events->epollFd < 0) {
+    events->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (events->epollFd < 0) return false;
+
+    events->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+
+    if (events->wakeFd < 0 ||
+        epoll_ctl(events->epollFd, EPOLL_CTL_ADD, events->wakeFd, &event) <
+            0) {
+      int error = errno;
+      if (events->wakeFd >= 0) close(events->wakeFd);
+      close(events->epollFd);
+      events->epollFd = -1;
+      events->wakeFd = -1;
+      errno = error;
+      return false;
+    }
+  }
+
+  ActiveThread* activeThread = newActiveThread();
+
+  int error = pthread_create(&activeThread->pthreadId, NULL, runPoller,
+                             activeThread);
+  if (error != 0) {
+    killThread(activeThread);
+    errno = error;
+    return false;
+  }
+  pthread_detach(activeThread->pthreadId);
+
+  events->running = true;
+  return true;
+}
+
+bool eventsTimeout(double seconds, ObjFuture* future) {
+  EventLoop* events = &vm.events;
+  EventTimer timer = {.deadline = monotonicNow() + seconds, .future = future};
+
+  pthread_mutex_lock(&events->mutex);
+  if (!startPoller(events)) {
+    pthread_mutex_unlock(&events->mutex);
+    return false;
+  }
+
+  pushTimer(events, timer);
+  // The poller sleeps until the previous first deadline
+  if (events->timers[0].future == future) {
+    wakePoller(events);
+  }
+  pthread_mutex_unlock(&events->mutex);
+
+  return true;
+}
+
+bool eventsWatch(int fd, bool write, Value source, ObjFuture* future) {
+  EventLoop* events = &vm.events;
+  EventWatch* watch = ALLOCATE(EventWatch, 1);
+
+  // Duplicated, so that the same descriptor can be watched many times and
+  // closed while watched
+  watch->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  watch->future = future;
+  watch->source = source;
+  watch->previous = NULL;
+
+  if (watch->fd < 0) {
+    FREE(EventWatch, watch);
+    return false;
+  }
+
+  pthread_mutex_lock(&events->mutex);
+  if (!startPoller(events)) {
+    int error = errno;
+    pthread_mutex_unlock(&events->mutex);
+    close(watch->fd);
+    FREE(EventWatch, watch);
+    errno = error;
+    return false;
+  }
+
+  struct epoll_event event = {.events = (write ? EPOLLOUT : EPOLLIN) |
+                                        EPOLLONESHOT,
+                              .data.ptr = watch};
+
+  // Linked before registering, it may fire right away
+  watch->next = events->watches;
+  if (events->watches != NULL) events->watches->previous = watch;
+  events->watches = watch;
+
+  if (epoll_ctl(events->epollFd, EPOLL_CTL_ADD, watch->fd, &event) < 0) {
+    int error = errno;
+
+    events->watches = watch->next;
+    if (watch->next != NULL) watch->next->previous = NULL;
+    pthread_mutex_unlock(&events->mutex);
+
+    close(watch->fd);
+    FREE(EventWatch, watch);
+
+    // Regular files and directories can't be polled, they never block
+    if (error == EPERM) {
+      settleFuture(future, FUTURE_DONE, source);
+      return true;
+    }
+
+    errno = error;
+    return false;
+  }
+  pthread_mutex_unlock(&events->mutex);
+
+  return true;
+}
+
+void stopEventLoop(EventLoop* events) {
+  pthread_mutex_lock(&events->mutex);
+  events->stopping = true;
+  if (events->running) wakePoller(events);
+  pthread_mutex_unlock(&events->mutex);
+
+  // The poller may need a collection to leave its safezone
+  enterGCSafezone(&vm.program);
+  pthread_mutex_lock(&events->mutex);
+  while (events->running) {
+    pthread_cond_wait(&events->pollerDone, &events->mutex);
+  }
+  pthread_mutex_unlock(&events->mutex);
+  leaveGCSafezone(&vm.program);
+
+  while (events->watches != NULL) {
+    EventWatch* watch = events->watches;
+    events->watches = watch->next;
+    releaseWatch(events, watch);
+  }
+  FREE_ARRAY(EventTimer, events->timers, events->timersCapacity);
+
+  if (events->epollFd >= 0) {
+    close(events->wakeFd);
+    close(events->epollFd);
+  }
+
+  pthread_mutex_destroy(&events->mutex);
+  pthread_cond_destroy(&events->pollerDone);
+}
+
+#else
+
+// No event loop without epoll, registrations fail with ENOSYS
+
+bool eventsTimeout(double seconds, ObjFuture* future) {
+  errno = ENOSYS;
+  return false;
+}
+
+bool eventsWatch(int fd, bool write, Value source, ObjFuture* future) {
+  errno = ENOSYS;
+  return false;
+}
+
+void stopEventLoop(EventLoop* events) {
+  pthread_mutex_destroy(&events->mutex);
+  pthread_cond_destroy(&events->pollerDone);
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef events_h
+#define events_h
+
+#include "object.h"
+#include "vm.h"
+
+// Wakeups handled by the poller at once
+#define EVENTS_BATCH 64
+
+void initEventLoop(EventLoop* events);
+// Waits for the poller to exit, pending futures are never settled
+void stopEventLoop(EventLoop* events);
+// Settles future with nil in seconds. Fails with errno set.
+bool eventsTimeout(double seconds, ObjFuture* future);
+// Settles future with source once fd is readable, or writable when write is
+// set. Regular files are always ready. Fails with errno set.
+bool eventsWatch(int fd, bool write, Value source, ObjFuture* future);
+
+#endif
@@ -0,0 +1,324 @@
+#include "fs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/mman.h>
+#define FS_MMAP
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+#include "memory.h"
+#include "object.h"
+
+// Blocking system calls run inside a forced GC safezone, so that a thread
+// waiting on the disk doesn't hold back the collector. Objects must not be
+// allocated (or buffers grown) while in the safezone. errno is preserved.
+#define BLOCKING_CALL(program, call)          \
+  ({                                          \
+    __typeof__(call) result;                  \
+    enterGCSafezone(program);                 \
+    do {                                      \
+      result = (call);                        \
+    } while (result < 0 && errno == EINTR);   \
+    int error = errno;                        \
+    leaveGCSafezone(program);                 \
+    errno = error;                            \
+    result;                                   \
+  })
+
+static bool writeAll(Thread* program, int fd, const char* chars,
+                     size_t length) {
+  while (length > 0) {
+    ssize_t written = BLOCKING_CALL(program, write(fd, chars, length));
+    if (written < 0) return false;
+
+    chars += written;
+    length -= written;
+  }
+
+  return true;
+}
+
+// close is not retried on EINTR, the descriptor is released either way
+static void closeFile(int fd) {
+  int error = errno;
+  close(fd);
+  errno = error;
+}
+
+// Reads until the end of the file into a buffer of exactly length + 1 bytes,
+// the last one left for a null terminator. The size is only a hint, files
+// may change while read.
+static char* readAll(Thread* program, int fd, int size, int* length) {
+  int capacity = size > 0 ? size + 1 : FS_CHUNK_SIZE;
+  char* chars = ALLOCATE(char, capacity);
+  *length = 0;
+
+  for (;;) {
+    if (capacity - *length == 1) {
+      if (capacity >= INT_MAX / 2) {
+        FREE_ARRAY(char, chars, capacity);
+        errno = EFBIG;
+        return NULL;
+      }
+      chars = GROW_ARRAY(char, chars, capacity, capacity * 2);
+      capacity *= 2;
+    }
+
+    ssize_t count = BLOCKING_CALL(
+        program, read(fd, chars + *length, capacity - *length - 1));
+    if (count < 0) {
+      FREE_ARRAY(char, chars, capacity);
+      return NULL;
+    }
+    if (count == 0) break;
+    *length += count;
+  }
+
+  return GROW_ARRAY(char, chars, capacity, *length + 1);
+}
+
+ObjString* fsReadFile(Thread* program, ObjString* path) {
+  flattenString(path);
+
+  int fd = BLOCKING_CALL(program, open(path->chars, O_RDONLY | O_CLOEXEC));
+  if (fd < 0) return NULL;
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    closeFile(fd);
+    return NULL;
+  }
+
+  // Pipes and special files report no size, they are read until the end
+  bool regular = S_ISREG(info.st_mode) && info.st_size > 0;
+  if (regular && info.st_size >= INT_MAX) {
+    closeFile(fd);
+    errno = EFBIG;
+    return NULL;
+  }
+
+#ifdef FS_MMAP
+  // The mapping is zero filled past the end of the file up to the page end,
+  // which gives the string its null terminator for free. Files filling their
+  // last page are copied instead.
+  long pageSize = sysconf(_SC_PAGESIZE);
+  if (regular && info.st_size >= FS_MAP_THRESHOLD &&
+      info.st_size % pageSize != 0) {
+    char* chars = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (chars != MAP_FAILED) {
+      closeFile(fd);
+      return takeMappedString(chars, (int)info.st_size);
+    }
+  }
+#endif
+
+  int length;
+  char* chars = readAll(program, fd, regular ? (int)info.st_size : 0, &length);
+  closeFile(fd);
+  if (chars == NULL) return NULL;
+
+  chars[length] = '\0';
+  return takeTransientString(chars, length);
+}
+
+ObjTypedArray* fsReadBytes(Thread* program, ObjString* path) {
+  flattenString(path);
+
+  int fd = BLOCKING_CALL(program, open(path->chars, O_RDONLY | O_CLOEXEC));
+  if (fd < 0) return NULL;
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    closeFile(fd);
+    return NULL;
+  }
+
+  bool regular = S_ISREG(info.st_mode) && info.st_size > 0;
+  if (regular && info.st_size >= INT_MAX) {
+    closeFile(fd);
+    errno = EFBIG;
+    return NULL;
+  }
+
+  int length;
+  char* bytes = readAll(program, fd, regular ? (int)info.st_size : 0, &length);
+  closeFile(fd);
+  if (bytes == NULL) return NULL;
+
+  // Typed arrays own exactly their elements size
+  bytes = GROW_ARRAY(char, bytes, length + 1, length);
+  return takeTypedArray(TYPED_ARRAY_UINT8, bytes, length);
+}
+
+bool fsWriteFile(Thread* program, ObjString* path, ObjString* content) {
+  return fsWriteBytes(program, path, content->chars, content->length);
+}
+
+bool fsWriteBytes(Thread* program, ObjString* path, const void* bytes,
+                  size_t length) {
+  flattenString(path);
+
+  int fd = BLOCKING_CALL(program, open(path->chars,
+                                       O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                       0666));
+  if (fd < 0) return false;
+
+  bool written = writeAll(program, fd, bytes, length);
+  closeFile(fd);
+
+  return written;
+}
+
+ObjFile* fsOpen(Thread* program, ObjString* path, FileMode mode, bool append) {
+  flattenString(path);
+
+  int flags = O_RDONLY;
+  if (mode == FILE_WRITER) {
+    flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+  }
+
+  int fd = BLOCKING_CALL(program, open(path->chars, flags | O_CLOEXEC, 0666));
+  if (fd < 0) return NULL;
+
+  return newFile(fd, mode);
+}
+
+// Reads the next chunk after the bytes not consumed yet. Lines longer than
+// the buffer make it grow.
+static bool fillBuffer(Thread* program, ObjFile* file) {
+  int pending = file->length - file->start;
+  if (file->start > 0) {
+    memmove(file->buffer, file->buffer + file->start, pending);
+    file->start = 0;
+    file->length = pending;
+  }
+
+  if (file->capacity - file->length < FS_CHUNK_SIZE) {
+    int oldCapacity = file->capacity;
+    int capacity = oldCapacity == 0 ? FS_CHUNK_SIZE * 2 : oldCapacity;
+    while (capacity - file->length < FS_CHUNK_SIZE) {
+      capacity *= 2;
+    }
+
+    file->buffer = GROW_ARRAY(char, file->buffer, oldCapacity, capacity);
+    file->capacity = capacity;
+  }
+
+  ssize_t count =
+      BLOCKING_CALL(program, read(file->fd, file->buffer + file->length,
+                                  file->capacity - file->length));
+  if (count < 0) return false;
+
+  file->eof = count == 0;
+  file->length += count;
+  return true;
+}
+
+// Lines are returned without the line break ("\n" or "\r\n")
+static ObjString* copyLine(const char* chars, int length) {
+  if (length > 0 && chars[length - 1] == '\r') length--;
+
+  return copyTransientString(chars, length);
+}
+
+bool fsReadLine(Thread* program, ObjFile* file, Value* line) {
+  for (;;) {
+    int pending = file->length - file->start;
+    char* start = file->buffer + file->start;
+    char* end = pending > 0 ? memchr(start, '\n', pending) : NULL;
+
+    if (end != NULL) {
+      file->start += end - start + 1;
+      *line = OBJ_VAL(copyLine(start, end - start));
+      return true;
+    }
+
+    // Last line may not end with a line break
+    if (file->eof) {
+      file->start = file->length;
+      *line = pending > 0 ? OBJ_VAL(copyLine(start, pending)) : NIL_VAL;
+      return true;
+    }
+
+    if (!fillBuffer(program, file)) return false;
+  }
+}
+
+bool fsWrite(Thread* program, ObjFile* file, const char* chars, int length) {
+  if (file->capacity == 0 && length > 0) {
+    file->buffer = GROW_ARRAY(char, file->buffer, 0, FS_CHUNK_SIZE);
+    file->capacity = FS_CHUNK_SIZE;
+  }
+
+  // Content is always copied to the buffer, the caller memory is not touched
+  // while in the GC safezone.
+  while (length > 0) {
+    if (file->length == file->capacity && !fsFlush(program, file)) {
+      return false;
+    }
+
+    int count = file->capacity - file->length;
+    if (count > length) count = length;
+
+    memcpy(file->buffer + file->length, chars, count);
+    file->length += count;
+    chars += count;
+    length -= count;
+  }
+
+  return true;
+}
+
+bool fsFlush(Thread* program, ObjFile* file) {
+  if (file->mode != FILE_WRITER || file->length == 0) return true;
+
+  bool written = writeAll(program, file->fd, file->buffer, file->length);
+  file->length = 0;
+
+  return written;
+}
+
+bool fsClose(Thread* program, ObjFile* file) {
+  if (file->fd < 0) return true;
+
+  bool flushed = fsFlush(program, file);
+  int error = errno;
+  bool closed = close(file->fd) == 0;
+  if (!flushed) errno = error;
+
+  file->fd = -1;
+  FREE_ARRAY(char, file->buffer, file->capacity);
+  file->buffer = NULL;
+  file->capacity = 0;
+  file->start = 0;
+  file->length = 0;
+
+  return flushed && closed;
+}
+
+// Runs on the GC thread, while every program thread is in a safezone. Pending
+// writes are dropped: a blocking write to a slow pipe would stall the whole
+// collection. Writers must be flushed or closed by their owner.
+void finalizeFile(ObjFile* file) {
+  if (file->fd < 0) return;
+
+  close(file->fd);
+  file->fd = -1;
+}
+
+void unmapString(ObjString* string) {
+#ifdef FS_MMAP
+  munmap(string->chars, string->length);
+#endif
+}
@@ -0,0 +1,26 @@
+#ifndef fs_h
+#define fs_h
+
+#include "vm.h"
+
+// Files are read and written in chunks of this size
+#define FS_CHUNK_SIZE (64 * 1024)
+// Whole file reads from this size on map the file instead of copying it
+#define FS_MAP_THRESHOLD (64 * 1024)
+
+// Functions returning false (or NULL) failed with errno set.
+ObjString* fsReadFile(Thread* program, ObjString* path);
+ObjTypedArray* fsReadBytes(Thread* program, ObjString* path);
+bool fsWriteFile(Thread* program, ObjString* path, ObjString* content);
+bool fsWriteBytes(Thread* program, ObjString* path, const void* bytes,
+                  size_t length);
+ObjFile* fsOpen(Thread* program, ObjString* path, FileMode mode, bool append);
+bool fsReadLine(Thread* program, ObjFile* file, Value* line);
+bool fsWrite(Thread* program, ObjFile* file, const char* chars, int length);
+bool fsFlush(Thread* program, ObjFile* file);
+bool fsClose(Thread* program, ObjFile* file);
+// Closes a file collected by the GC, unflushed writes are lost
+void finalizeFile(ObjFile* file);
+void unmapString(ObjString* string);
+
+#endif
@@ -0,0 +1,157 @@
+#include "interning.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "object.h"
+
+#define INTERNING_MAX_LOAD .75
+#define INTERNING_INITIAL_CAPACITY 64
+
+// Marks a removed entry, so that probing sequences are not broken
+static ObjString tombstone;
+#define TOMBSTONE (&tombstone)
+
+// Shards storage is managed with plain malloc/free instead of reallocate.
+// A shard lock may be taken while a thread holds the memory allocation mutex
+// (e.g, under GCWhiteList), so taking that mutex under a shard lock could
+// deadlock.
+//
+// The GC walks the shards without locking them: it only runs once every
+// program thread reached a safezone, which never happens mid insertion.
+
+static inline InterningShard* findShard(InterningTable* table, uint32_t hash) {
+  return &table->shards[hash >> (32 - INTERNING_SHARDS_BITS)];
+}
+
+void initInterningTable(InterningTable* table) {
+  for (int idx = 0; idx < INTERNING_SHARDS; idx++) {
+    InterningShard* shard = &table->shards[idx];
+    pthread_mutex_init(&shard->mutex, NULL);
+    shard->count = 0;
+    shard->capacity = 0;
+    shard->entries = NULL;
+  }
+}
+
+void freeInterningTable(InterningTable* table) {
+  for (int idx = 0; idx < INTERNING_SHARDS; idx++) {
+    InterningShard* shard = &table->shards[idx];
+    pthread_mutex_destroy(&shard->mutex);
+    free(shard->entries);
+    shard->count = 0;
+    shard->capacity = 0;
+    shard->entries = NULL;
+  }
+}
+
+static ObjString* findInShard(InterningShard* shard, const char* chars,
+                              int length, uint32_t hash) {
+  if (shard->capacity == 0) return NULL;
+
+  uint32_t mask = shard->capacity - 1;
+  uint32_t idx = hash & mask;
+
+  for (;;) {
+    ObjString* entry = shard->entries[idx];
+
+    if (entry == NULL) return NULL;
+
+    if (entry != TOMBSTONE && entry->length == length && entry->hash == hash &&
+        memcmp(entry->chars, chars, length) == 0) {
+      return entry;
+    }
+
+    idx = (idx + 1) & mask;
+  }
+}
+
+// Returns whether the string took an empty slot (instead of a tombstone).
+static bool insertInShard(ObjString** entries, int capacity,
+                          ObjString* string) {
+  uint32_t mask = capacity - 1;
+  uint32_t idx = string->hash & mask;
+
+  while (entries[idx] != NULL && entries[idx] != TOMBSTONE) {
+    idx = (idx + 1) & mask;
+  }
+
+  bool isEmpty = entries[idx] == NULL;
+  entries[idx] = string;
+  return isEmpty;
+}
+
+// Rehashing drops tombstones, so the count is recomputed.
+static void adjustShardCapacity(InterningShard* shard, int capacity) {
+  ObjString** entries = calloc(capacity, sizeof(ObjString*));
+
+  if (entries == NULL) exit(1);
+
+  shard->count = 0;
+  for (int idx = 0; idx < shard->capacity; idx++) {
+    ObjString* entry = shard->entries[idx];
+
+    if (entry == NULL || entry == TOMBSTONE) continue;
+
+    insertInShard(entries, capacity, entry);
+    shard->count++;
+  }
+
+  free(shard->entries);
+  shard->entries = entries;
+  shard->capacity = capacity;
+}
+
+ObjString* interningTableFind(InterningTable* table, const char* chars,
+                              int length, uint32_t hash) {
+  InterningShard* shard = findShard(table, hash);
+
+  pthread_mutex_lock(&shard->mutex);
+  ObjString* interned = findInShard(shard, chars, length, hash);
+  pthread_mutex_unlock(&shard->mutex);
+
+  return interned;
+}
+
+// Another thread may have interned the same string since the caller lookup,
+// in that case the existing string is returned instead.
+ObjString* interningTableAdd(InterningTable* table, ObjString* string) {
+  InterningShard* shard = findShard(table, string->hash);
+
+  pthread_mutex_lock(&shard->mutex);
+
+  ObjString* interned =
+      findInShard(shard, string->chars, string->length, string->hash);
+
+  if (interned == NULL) {
+    if (shard->count + 1 > shard->capacity * INTERNING_MAX_LOAD) {
+      adjustShardCapacity(shard, shard->capacity < INTERNING_INITIAL_CAPACITY
+                                     ? INTERNING_INITIAL_CAPACITY
+                                     : shard->capacity * 2);
+    }
+
+    if (insertInShard(shard->entries, shard->capacity, string)) {
+      shard->count++;
+    }
+    string->interned = true;
+    interned = string;
+  }
+
+  pthread_mutex_unlock(&shard->mutex);
+
+  return interned;
+}
+
+void interningTableRemoveNotReferenced(InterningTable* table) {
+  for (int idx = 0; idx < INTERNING_SHARDS; idx++) {
+    InterningShard* shard = &table->shards[idx];
+
+    for (int entryIdx = 0; entryIdx < shard->capacity; entryIdx++) {
+      ObjString* entry = shard->entries[entryIdx];
+
+      if (entry != NULL && entry != TOMBSTONE && !entry->obj.isMarked) {
+        shard->entries[entryIdx] = TOMBSTONE;
+      }
+    }
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef interning_h
+#define interning_h
+
+#include <pthread.h>
+
+#include "common.h"
+#include "value.h"
+
+// The strings interning table is split in shards, selected by the string hash
+// high bits, so that threads creating different strings rarely compete for
+// the same lock.
+#define INTERNING_SHARDS_BITS 5
+#define INTERNING_SHARDS (1 << INTERNING_SHARDS_BITS)
+
+typedef struct {
+  pthread_mutex_t mutex;
+  // Live entries plus tombstones
+  int count;
+  // Always a power of two (or zero)
+  int capacity;
+  ObjString** entries;
+} InterningShard;
+
+typedef struct {
+  InterningShard shards[INTERNING_SHARDS];
+} InterningTable;
+
+void initInterningTable(InterningTable* table);
+void freeInterningTable(InterningTable* table);
+ObjString* interningTableFind(InterningTable* table, const char* chars,
+                              int length, uint32_t hash);
+ObjString* interningTableAdd(InterningTable* table, ObjString* string);
+void interningTableRemoveNotReferenced(InterningTable* table);
+
+#endif
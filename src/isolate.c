@@ -0,0 +1,597 @@
+#include "isolate.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "utils.h"
+
+extern char** environ;
+
+// Spawned isolates run vm.isolateExecutable, receiving messages on
+// ISOLATE_IN_FD and sending them on ISOLATE_OUT_FD
+#define ISOLATE_ENV "SIMPL_ISOLATE"
+#define ISOLATE_IN_FD 3
+#define ISOLATE_OUT_FD 4
+
+// Messages are framed by their length, followed by the tagged values. Both
+// sides run on the same machine, numbers are written in native byte order.
+typedef enum {
+  MESSAGE_NIL,
+  MESSAGE_FALSE,
+  MESSAGE_TRUE,
+  MESSAGE_NUMBER,
+  MESSAGE_STRING,
+  MESSAGE_ARRAY,
+  MESSAGE_OBJECT,
+  MESSAGE_TYPED_ARRAY
+} MessageTag;
+
+// Message buffers are plain C memory, so that they can be read and written
+// inside a GC safezone.
+typedef struct {
+  size_t length;
+  size_t capacity;
+  uint8_t* bytes;
+} Message;
+
+typedef struct {
+  const uint8_t* bytes;
+  size_t length;
+  size_t position;
+} MessageReader;
+
+static void writeBytes(Message* message, const void* bytes, size_t length) {
+  if (message->capacity < message->length + length) {
+    size_t capacity = message->capacity > 0 ? message->capacity : 64;
+    while (capacity < message->length + length) capacity *= 2;
+
+    uint8_t* grown = realloc(message->bytes, capacity);
+    if (grown == NULL) {
+      fprintf(stderr, "Not enough memory to clone message.\n");
+      exit(1);
+    }
+
+    message->bytes = grown;
+    message->capacity = capacity;
+  }
+
+  memcpy(message->bytes + message->length, bytes, length);
+  message->length += length;
+}
+
+static void writeTag(Message* message, MessageTag tag) {
+  uint8_t byte = tag;
+  writeBytes(message, &byte, sizeof(byte));
+}
+
+static void writeCount(Message* message, uint32_t count) {
+  writeBytes(message, &count, sizeof(count));
+}
+
+static void cloneString(Message* message, ObjString* string) {
+  writeTag(message, MESSAGE_STRING);
+  writeCount(message, string->length);
+  writeBytes(message, flattenRope(string)->chars, string->length);
+}
+
+static bool cloneValue(Message* message, Value value, int depth) {
+  if (depth > ISOLATE_MAX_DEPTH) return false;
+
+  if (IS_NIL(value)) {
+    writeTag(message, MESSAGE_NIL);
+    return true;
+  }
+
+  if (IS_BOOL(value)) {
+    writeTag(message, AS_BOOL(value) ? MESSAGE_TRUE : MESSAGE_FALSE);
+    return true;
+  }
+
+  if (IS_NUMBER(value)) {
+    double number = AS_NUMBER(value);
+    writeTag(message, MESSAGE_NUMBER);
+    writeBytes(message, &number, sizeof(number));
+    return true;
+  }
+
+  if (IS_STRING(value)) {
+    cloneString(message, AS_STRING(value));
+    return true;
+  }
+
+  if (IS_ARRAY(value)) {
+    ValueArray* list = &AS_ARRAY(value)->list;
+    writeTag(message, MESSAGE_ARRAY);
+    writeCount(message, list->count);
+
+    for (int idx = 0; idx < list->count; idx++) {
+      if (!cloneValue(message, list->values[idx], depth + 1)) return false;
+    }
+    return true;
+  }
+
+  // Only object literals, instances of user classes would lose their methods
+  if (IS_INSTANCE(value) && AS_OBJ(value)->klass == vm.klass) {
+    Table* properties = &AS_INSTANCE(value)->properties;
+    uint32_t count = 0;
+    for (int idx = 0; idx <= properties->capacity; idx++) {
+      if (properties->entries[idx].key != NULL) count++;
+    }
+
+    writeTag(message, MESSAGE_OBJECT);
+    writeCount(message, count);
+    for (int idx = 0; idx <= properties->capacity; idx++) {
+      Entry* entry = &properties->entries[idx];
+      if (entry->key == NULL) continue;
+
+      cloneString(message, entry->key);
+      if (!cloneValue(message, entry->value, depth + 1)) return false;
+    }
+    return true;
+  }
+
+  if (IS_TYPED_ARRAY(value)) {
+    ObjTypedArray* array = AS_TYPED_ARRAY(value);
+    uint8_t kind = array->kind;
+    writeTag(message, MESSAGE_TYPED_ARRAY);
+    writeBytes(message, &kind, sizeof(kind));
+    writeCount(message, array->count);
+    writeBytes(message, array->as.bytes,
+               typedArrayElementSize(array->kind) * array->count);
+    return true;
+  }
+
+  return false;
+}
+
+static bool readBytes(MessageReader* reader, void* bytes, size_t length) {
+  if (reader->length - reader->position < length) return false;
+
+  memcpy(bytes, reader->bytes + reader->position, length);
+  reader->position += length;
+  return true;
+}
+
+static bool readCount(MessageReader* reader, uint32_t* count) {
+  return readBytes(reader, count, sizeof(*count));
+}
+
+static bool restoreString(MessageReader* reader, ObjString** string) {
+  uint8_t tag;
+  uint32_t length;
+  if (!readBytes(reader, &tag, sizeof(tag)) || tag != MESSAGE_STRING ||
+      !readCount(reader, &length) ||
+      reader->length - reader->position < length) {
+    return false;
+  }
+
+  *string =
+      copyString((const char*)reader->bytes + reader->position, (int)length);
+  reader->position += length;
+  return true;
+}
+
+// Restored objects are kept on the program stack until they are reachable
+// from their parent, as the GC may run in between.
+static bool restoreValue(Thread* program, MessageReader* reader,
+                         Value* value) {
+  uint8_t tag;
+  if (!readBytes(reader, &tag, sizeof(tag))) return false;
+
+  switch (tag) {
+    case MESSAGE_NIL:
+      *value = NIL_VAL;
+      return true;
+    case MESSAGE_FALSE:
+      *value = FALSE_VAL;
+      return true;
+    case MESSAGE_TRUE:
+      *value = TRUE_VAL;
+      return true;
+    case MESSAGE_NUMBER: {
+      double number;
+      if (!readBytes(reader, &number, sizeof(number))) return false;
+
+      *value = NUMBER_VAL(number);
+      return true;
+    }
+    case MESSAGE_STRING: {
+      ObjString* string;
+      reader->position--;
+      if (!restoreString(reader, &string)) return false;
+
+      *value = OBJ_VAL(string);
+      return true;
+    }
+    case MESSAGE_ARRAY: {
+      uint32_t count;
+      if (!readCount(reader, &count)) return false;
+
+      ObjArray* array = newArray();
+      push(program, OBJ_VAL(array));
+
+      for (uint32_t idx = 0; idx < count; idx++) {
+        Value element;
+        if (!restoreValue(program, reader, &element)) {
+          pop(program);
+          return false;
+        }
+
+        push(program, element);
+        writeValueArray(&array->list, element);
+        pop(program);
+      }
+
+      *value = pop(program);
+      return true;
+    }
+    case MESSAGE_OBJECT: {
+      uint32_t count;
+      if (!readCount(reader, &count)) return false;
+
+      ObjInstance* object = newInstance(vm.klass);
+      push(program, OBJ_VAL(object));
+
+      for (uint32_t idx = 0; idx < count; idx++) {
+        ObjString* key;
+        Value property;
+        if (!restoreString(reader, &key)) {
+          pop(program);
+          return false;
+        }
+
+        push(program, OBJ_VAL(key));
+        if (!restoreValue(program, reader, &property)) {
+          pop(program);
+          pop(program);
+          return false;
+        }
+
+        push(program, property);
+        tableSet(&object->properties, key, property);
+        pop(program);
+        pop(program);
+      }
+
+      *value = pop(program);
+      return true;
+    }
+    case MESSAGE_TYPED_ARRAY: {
+      uint8_t kind;
+      uint32_t count;
+      if (!readBytes(reader, &kind, sizeof(kind)) ||
+          kind >= TYPED_ARRAY_KINDS || !readCount(reader, &count) ||
+          count > INT32_MAX) {
+        return false;
+      }
+
+      size_t size = typedArrayElementSize(kind) * count;
+      if (reader->length - reader->position < size) return false;
+
+      ObjTypedArray* array = newTypedArray(kind, (int)count);
+      readBytes(reader, array->as.bytes, size);
+
+      *value = OBJ_VAL(array);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool writeAll(int fd, const void* bytes, size_t length) {
+  const uint8_t* cursor = bytes;
+
+  while (length > 0) {
+    ssize_t written = write(fd, cursor, length);
+    if (written < 0 && errno == EINTR) continue;
+    if (written < 0) return false;
+
+    cursor += written;
+    length -= written;
+  }
+
+  return true;
+}
+
+// Returns the bytes read, fewer than length only at the end of the pipe
+static ssize_t readAll(int fd, void* bytes, size_t length) {
+  uint8_t* cursor = bytes;
+  size_t total = 0;
+
+  while (total < length) {
+    ssize_t result = read(fd, cursor + total, length - total);
+    if (result < 0 && errno == EINTR) continue;
+    if (result < 0) return -1;
+    if (result == 0) break;
+
+    total += result;
+  }
+
+  return total;
+}
+
+// Child pipe ends are moved above the descriptors they are duplicated to, as
+// duplicating a descriptor onto itself keeps it closed on exec
+static int moveDescriptor(int fd) {
+  int moved = fcntl(fd, F_DUPFD_CLOEXEC, ISOLATE_OUT_FD + 1);
+  int error = errno;
+  close(fd);
+  errno = error;
+  return moved;
+}
+
+static void closePipe(int fds[2]) {
+  int error = errno;
+  if (fds[0] >= 0) close(fds[0]);
+  if (fds[1] >= 0) close(fds[1]);
+  errno = error;
+}
+
+static bool openPipe(int fds[2]) {
+  if (pipe(fds) != 0) return false;
+
+  if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) != 0 ||
+      fcntl(fds[1], F_SETFD, FD_CLOEXEC) != 0) {
+    closePipe(fds);
+    return false;
+  }
+
+  return true;
+}
+
+// Parent environment, marking the child as an isolate
+static char** isolateEnvironment() {
+  int count = 0;
+  while (environ[count] != NULL) count++;
+
+  char** environment = malloc(sizeof(char*) * (count + 2));
+  int length = 0;
+  for (int idx = 0; idx < count; idx++) {
+    if (strncmp(environ[idx], ISOLATE_ENV "=", sizeof(ISOLATE_ENV)) != 0) {
+      environment[length++] = environ[idx];
+    }
+  }
+  environment[length++] = ISOLATE_ENV "=1";
+  environment[length] = NULL;
+
+  return environment;
+}
+
+static char* resolveIsolatePath(ObjString* path) {
+  const char* chars = flattenString(path)->chars;
+
+  if (chars[0] == '/' || vm.entryPath == NULL) {
+    char* resolved = malloc(path->length + 1);
+    memcpy(resolved, chars, path->length + 1);
+    return resolved;
+  }
+
+  char* directory = removeLastPathFragment(vm.entryPath);
+  char* resolved = malloc(strlen(directory) + path->length + 1);
+  sprintf(resolved, "%s%s", directory, chars);
+  free(directory);
+
+  return resolved;
+}
+
+void setIsolateExecutable(VM* machine, const char* path) {
+  free(machine->isolateExecutable);
+  machine->isolateExecutable = path != NULL ? strdup(path) : NULL;
+}
+
+ObjIsolate* isolateSpawn(Thread* program, ObjString* path) {
+  if (vm.isolateExecutable == NULL) {
+    errno = ENOSYS;
+    return NULL;
+  }
+
+  char* file = resolveIsolatePath(path);
+  if (access(file, R_OK) != 0) {
+    int error = errno;
+    free(file);
+    errno = error;
+    return NULL;
+  }
+
+  int toChild[2];
+  int fromChild[2];
+  if (!openPipe(toChild)) {
+    free(file);
+    return NULL;
+  }
+  if (!openPipe(fromChild)) {
+    closePipe(toChild);
+    free(file);
+    return NULL;
+  }
+
+  toChild[0] = moveDescriptor(toChild[0]);
+  fromChild[1] = moveDescriptor(fromChild[1]);
+  if (toChild[0] < 0 || fromChild[1] < 0) {
+    closePipe(toChild);
+    closePipe(fromChild);
+    free(file);
+    return NULL;
+  }
+
+  // Writes to an exited isolate fail with EPIPE instead
+  signal(SIGPIPE, SIG_IGN);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, toChild[0], ISOLATE_IN_FD);
+  posix_spawn_file_actions_adddup2(&actions, fromChild[1], ISOLATE_OUT_FD);
+
+  char* argv[] = {vm.isolateExecutable, file, NULL};
+  char** environment = isolateEnvironment();
+  pid_t pid;
+  int result = posix_spawn(&pid, vm.isolateExecutable, &actions, NULL, argv,
+                           environment);
+
+  posix_spawn_file_actions_destroy(&actions);
+  free(environment);
+  free(file);
+  close(toChild[0]);
+  close(fromChild[1]);
+
+  if (result != 0) {
+    close(toChild[1]);
+    close(fromChild[0]);
+    errno = result;
+    return NULL;
+  }
+
+  return newIsolate(pid, fromChild[0], toChild[1]);
+}
+
+ObjIsolate* isolateParent() {
+  pthread_mutex_lock(&vm.memoryAllocationMutex);
+
+  if (vm.parentIsolate == NULL && getenv(ISOLATE_ENV) != NULL) {
+    signal(SIGPIPE, SIG_IGN);
+    // Isolates spawned from this one don't inherit the parent pipes
+    fcntl(ISOLATE_IN_FD, F_SETFD, FD_CLOEXEC);
+    fcntl(ISOLATE_OUT_FD, F_SETFD, FD_CLOEXEC);
+
+    vm.parentIsolate = newIsolate(0, ISOLATE_IN_FD, ISOLATE_OUT_FD);
+  }
+
+  pthread_mutex_unlock(&vm.memoryAllocationMutex);
+
+  return vm.parentIsolate;
+}
+
+IsolateStatus isolateSend(Thread* program, ObjIsolate* isolate, Value value) {
+  Message message = {0, 0, NULL};
+  uint32_t length = 0;
+
+  writeBytes(&message, &length, sizeof(length));
+  if (!cloneValue(&message, value, 0)) {
+    free(message.bytes);
+    return ISOLATE_UNCLONEABLE;
+  }
+
+  if (message.length - sizeof(length) > UINT32_MAX) {
+    free(message.bytes);
+    return ISOLATE_UNCLONEABLE;
+  }
+  length = message.length - sizeof(length);
+  memcpy(message.bytes, &length, sizeof(length));
+
+  IsolateStatus status = ISOLATE_OK;
+  enterGCSafezone(program);
+  pthread_mutex_lock(&isolate->sendMutex);
+
+  if (isolate->out < 0) {
+    status = ISOLATE_CLOSED;
+  } else if (!writeAll(isolate->out, message.bytes, message.length)) {
+    status = errno == EPIPE ? ISOLATE_CLOSED : ISOLATE_SYSTEM_ERROR;
+  }
+
+  pthread_mutex_unlock(&isolate->sendMutex);
+  int error = errno;
+  leaveGCSafezone(program);
+  errno = error;
+
+  free(message.bytes);
+  return status;
+}
+
+IsolateStatus isolateReceive(Thread* program, ObjIsolate* isolate,
+                             Value* value) {
+  IsolateStatus status = ISOLATE_OK;
+  uint32_t length = 0;
+  uint8_t* bytes = NULL;
+
+  enterGCSafezone(program);
+  pthread_mutex_lock(&isolate->receiveMutex);
+
+  ssize_t result = isolate->in < 0 ? 0
+                                   : readAll(isolate->in, &length,
+                                             sizeof(length));
+  if (result == 0) {
+    status = ISOLATE_CLOSED;
+  } else if (result < 0) {
+    status = ISOLATE_SYSTEM_ERROR;
+  } else if (result < (ssize_t)sizeof(length) ||
+             (bytes = malloc(length > 0 ? length : 1)) == NULL ||
+             readAll(isolate->in, bytes, length) != (ssize_t)length) {
+    // Truncated message, the other side exited while sending
+    status = ISOLATE_SYSTEM_ERROR;
+    errno = EBADMSG;
+  }
+
+  pthread_mutex_unlock(&isolate->receiveMutex);
+  int error = errno;
+  leaveGCSafezone(program);
+  errno = error;
+
+  if (status == ISOLATE_OK) {
+    MessageReader reader = {bytes, length, 0};
+    if (!restoreValue(program, &reader, value) ||
+        reader.position != reader.length) {
+      status = ISOLATE_SYSTEM_ERROR;
+      errno = EBADMSG;
+    }
+  }
+
+  free(bytes);
+  return status;
+}
+
+void isolateClose(Thread* program, ObjIsolate* isolate) {
+  enterGCSafezone(program);
+  pthread_mutex_lock(&isolate->sendMutex);
+
+  if (isolate->out >= 0) {
+    close(isolate->out);
+    isolate->out = -1;
+  }
+
+  pthread_mutex_unlock(&isolate->sendMutex);
+  leaveGCSafezone(program);
+}
+
+int isolateWait(Thread* program, ObjIsolate* isolate) {
+  isolateClose(program, isolate);
+  if (isolate->exitCode >= 0) return isolate->exitCode;
+
+  int status;
+  pid_t result;
+  enterGCSafezone(program);
+  do {
+    result = waitpid(isolate->pid, &status, 0);
+  } while (result < 0 && errno == EINTR);
+  int error = errno;
+  leaveGCSafezone(program);
+
+  if (result < 0) {
+    errno = error;
+    return -1;
+  }
+
+  isolate->exitCode =
+      WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  return isolate->exitCode;
+}
+
+void finalizeIsolate(ObjIsolate* isolate) {
+  if (isolate->in >= 0) close(isolate->in);
+  if (isolate->out >= 0) close(isolate->out);
+
+  // Reaps the child if it already exited, it is left running otherwise
+  if (isolate->pid > 0 && isolate->exitCode < 0) {
+    waitpid(isolate->pid, NULL, WNOHANG);
+  }
+
+  pthread_mutex_destroy(&isolate->sendMutex);
+  pthread_mutex_destroy(&isolate->receiveMutex);
+}
@@ -0,0 +1,49 @@
+#ifndef isolate_h
+#define isolate_h
+
+#include "object.h"
+#include "vm.h"
+
+// Isolates are scripts spawned as child processes running the interpreter,
+// each with its own VM. Nothing is shared: values sent between isolates are
+// structured clones of nil, bools, numbers, strings, arrays, plain objects and
+// typed arrays.
+//
+// VMs could share a process now that each thread has its own current VM, but
+// uncaught errors exit the whole process and an isolate has an exit code of
+// its own, so isolates stay processes.
+
+// Nesting deeper than this fails to clone, which also stops cyclic values
+#define ISOLATE_MAX_DEPTH 64
+
+typedef enum {
+  ISOLATE_OK,
+  // Send to an isolate which exited or was closed, or receive after the other
+  // side closed
+  ISOLATE_CLOSED,
+  // Value isn't cloneable
+  ISOLATE_UNCLONEABLE,
+  // Failed system call, errno is set
+  ISOLATE_SYSTEM_ERROR
+} IsolateStatus;
+
+// Interpreter executable spawned by isolates, copied. NULL disables them.
+void setIsolateExecutable(VM* machine, const char* path);
+// Relative paths are resolved from the entry script directory. Fails (NULL)
+// with errno set, ENOSYS when no interpreter executable is set.
+ObjIsolate* isolateSpawn(Thread* program, ObjString* path);
+// Isolate this process was spawned by, NULL when not spawned as one.
+ObjIsolate* isolateParent();
+// Blocking operations wait in a GC safezone.
+IsolateStatus isolateSend(Thread* program, ObjIsolate* isolate, Value value);
+IsolateStatus isolateReceive(Thread* program, ObjIsolate* isolate,
+                             Value* value);
+// Closes the sending side, the other isolate receives nil once drained.
+void isolateClose(Thread* program, ObjIsolate* isolate);
+// Waits for a spawned isolate to exit, returning its exit code. Fails (-1)
+// with errno set.
+int isolateWait(Thread* program, ObjIsolate* isolate);
+// Closes the pipes of an isolate collected by the GC
+void finalizeIsolate(ObjIsolate* isolate);
+
+#endif
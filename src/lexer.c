@@ -5,8 +5,8 @@
 
 #include "common.h"
 
-Lexer globalLexer;
-Lexer* lexer;
+static _Thread_local Lexer globalLexer;
+_Thread_local Lexer* lexer;
 
 void initLexer(const char* source) {
   lexer = &globalLexer;
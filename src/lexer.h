@@ -105,7 +105,7 @@ typedef struct Lexer {
 } Lexer;
 
 // The current lexer is "exported" to the compiler 
-extern Lexer* lexer;
+extern _Thread_local Lexer* lexer;
 
 // Initialize a lexer from a source code
 void initLexer(const char* source);
@@ -1,9 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "chunk.h"
 #include "common.h"
 #include "debug.h"
+#include "isolate.h"
 #include "utils.h"
 #include "vm.h"
 
@@ -29,6 +31,7 @@ static void runFile(const char *path) {
   InterpretResult result = interpret(source, absPath);
   free(source);
   free(absPath);
+  outputFlushAll(&vm.output);
 
   if (result == INTERPRET_COMPILE_ERROR) {
     exit(65);
@@ -39,7 +42,14 @@ static void runFile(const char *path) {
 }
 
 int main(int argc, char const *argv[]) {
-  initVM();
+  VM *machine = newVM();
+
+  // Isolates run this interpreter again
+#ifdef __linux__
+  setIsolateExecutable(machine, "/proc/self/exe");
+#else
+  if (strchr(argv[0], '/') != NULL) setIsolateExecutable(machine, argv[0]);
+#endif
 
   if (argc == 1) {
     repl();
@@ -49,6 +59,6 @@ int main(int argc, char const *argv[]) {
     fprintf(stderr, "Usage: simpl [path]\n");
   }
 
-  freeVM();
+  freeVM(machine);
   return 0;
 }
\ No newline at end of file
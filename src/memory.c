@@ -5,6 +5,8 @@
 #include <stdlib.h>
 
 #include "compiler.h"
+#include "fs.h"
+#include "isolate.h"
 #include "vm.h"
 
 #ifdef DEBUG_LOG_GC
@@ -91,7 +93,12 @@ static void freeObject(Obj* object) {
     }
     case OBJ_STRING: {
       ObjString* string = (ObjString*)object;
-      FREE_ARRAY(char, string->chars, string->length + 1);
+      // Slices don't own their buffer, ropes don't have one until flattened
+      if (string->mapped) {
+        unmapString(string);
+      } else if (string->parent == NULL && string->chars != NULL) {
+        FREE_ARRAY(char, string->chars, string->length + 1);
+      }
       FREE(ObjString, object);
       break;
     }
@@ -115,6 +122,63 @@ static void freeObject(Obj* object) {
       FREE(ObjUpValue, object);
       break;
     }
+    case OBJ_JUMP_TABLE: {
+      ObjJumpTable* table = (ObjJumpTable*)object;
+      FREE_ARRAY(JumpTableEntry, table->entries, table->capacity);
+      FREE(ObjJumpTable, table);
+      break;
+    }
+    case OBJ_STRING_BUILDER: {
+      ObjStringBuilder* builder = (ObjStringBuilder*)object;
+      FREE_ARRAY(char, builder->chars, builder->capacity);
+      FREE(ObjStringBuilder, builder);
+      break;
+    }
+    case OBJ_TYPED_ARRAY: {
+      ObjTypedArray* array = (ObjTypedArray*)object;
+      FREE_ARRAY(char, array->as.bytes,
+                 typedArrayElementSize(array->kind) * array->count);
+      FREE(ObjTypedArray, array);
+      break;
+    }
+    case OBJ_FILE: {
+      ObjFile* file = (ObjFile*)object;
+      // Pending writes of unreachable files are not lost
+      finalizeFile(file);
+      FREE_ARRAY(char, file->buffer, file->capacity);
+      FREE(ObjFile, file);
+      break;
+    }
+    case OBJ_FUTURE: {
+      FREE(ObjFuture, object);
+      break;
+    }
+    case OBJ_CHANNEL: {
+      ObjChannel* channel = (ObjChannel*)object;
+      FREE_ARRAY(ChannelSlot, channel->slots, channel->capacity);
+      FREE(ObjChannel, channel);
+      break;
+    }
+    case OBJ_SYNC: {
+      freeSync((ObjSync*)object);
+      FREE(ObjSync, object);
+      break;
+    }
+    case OBJ_ISOLATE: {
+      finalizeIsolate((ObjIsolate*)object);
+      FREE(ObjIsolate, object);
+      break;
+    }
+    case OBJ_ATOMIC: {
+      ObjAtomic* atomic = (ObjAtomic*)object;
+      if (atomic->kind == ATOMIC_INT64) {
+        FREE_ARRAY(_Atomic int64_t, atomic->as.int64, atomic->count);
+      } else {
+        FREE_ARRAY(_Atomic double, atomic->as.float64, atomic->count);
+      }
+      FREE(ObjAtomic, atomic);
+      break;
+    }
   }
 }
 
@@ -189,6 +253,8 @@ static void markProgram(Thread* program) {
        upvalue = upvalue->next) {
     markObject((Obj*)upvalue);
   }
+
+  markObject((Obj*)program->awaiting);
 }
 
 static void markThreads() {
@@ -196,16 +262,38 @@ static void markThreads() {
 
   while (thread != NULL) {
     markProgram(thread->program);
+    markObject((Obj*)thread->future);
+    markObject((Obj*)thread->previous);
     thread = thread->next;
   }
 }
 
+static void markEventLoop() {
+  EventLoop* events = &vm.events;
+
+  for (int idx = 0; idx < events->timersCount; idx++) {
+    markObject((Obj*)events->timers[idx].future);
+  }
+
+  for (EventWatch* watch = events->watches; watch != NULL;
+       watch = watch->next) {
+    markObject((Obj*)watch->future);
+    markValue(watch->source);
+  }
+}
+
 static void markRoots() {
   markTable(&vm.modules);
   markProgram(&vm.program);
   markThreads();
+  markEventLoop();
+  markObject((Obj*)vm.channelsWakeup.future);
+  markObject((Obj*)vm.semaphoresWakeup.future);
   markGCWhiteList();
   markCompilerRoots();
+  for (Script* script = vm.scripts; script != NULL; script = script->next) {
+    markTable(&script->namespace);
+  }
   markObject((Obj*)vm.lambdaFunctionName);
   markObject((Obj*)vm.klass);
   markObject((Obj*)vm.metaArrayClass);
@@ -215,6 +303,7 @@ static void markRoots() {
   markObject((Obj*)vm.metaErrorClass);
   markObject((Obj*)vm.metaSystemClass);
   markObject((Obj*)vm.metaObjectClass);
+  markObject((Obj*)vm.metaStringBuilderClass);
   markObject((Obj*)vm.nilClass);
   markObject((Obj*)vm.boolClass);
   markObject((Obj*)vm.numberClass);
@@ -223,6 +312,20 @@ static void markRoots() {
   markObject((Obj*)vm.functionClass);
   markObject((Obj*)vm.nativeFunctionClass);
   markObject((Obj*)vm.arrayClass);
+  markObject((Obj*)vm.stringBuilderClass);
+  markObject((Obj*)vm.fileClass);
+  markObject((Obj*)vm.futureClass);
+  markObject((Obj*)vm.channelClass);
+  markObject((Obj*)vm.atomicClass);
+  markObject((Obj*)vm.atomicArrayClass);
+  markObject((Obj*)vm.isolateClass);
+  markObject((Obj*)vm.parentIsolate);
+  for (int idx = 0; idx < SYNC_KINDS; idx++) {
+    markObject((Obj*)vm.syncClasses[idx]);
+  }
+  for (int idx = 0; idx < TYPED_ARRAY_KINDS; idx++) {
+    markObject((Obj*)vm.typedArrayClasses[idx]);
+  }
   markObject((Obj*)vm.errorClass);
   markObject((Obj*)vm.moduleExportsClass);
   markObject((Obj*)vm.systemClass);
@@ -306,7 +409,34 @@ static void blackenObject(Obj* obj) {
       markObject((Obj*)((ObjNativeFn*)obj)->name);
       break;
     }
+    case OBJ_JUMP_TABLE: {
+      ObjJumpTable* table = (ObjJumpTable*)obj;
+      for (int idx = 0; idx < table->capacity; idx++) {
+        markValue(table->entries[idx].key);
+      }
+      break;
+    }
     case OBJ_STRING:
+      markObject((Obj*)((ObjString*)obj)->parent);
+      markObject((Obj*)((ObjString*)obj)->left);
+      markObject((Obj*)((ObjString*)obj)->right);
+      break;
+    case OBJ_FUTURE:
+      markValue(((ObjFuture*)obj)->value);
+      break;
+    case OBJ_CHANNEL: {
+      ObjChannel* channel = (ObjChannel*)obj;
+      for (int idx = 0; idx < channel->capacity; idx++) {
+        markValue(channel->slots[idx].value);
+      }
+      break;
+    }
+    case OBJ_STRING_BUILDER:
+    case OBJ_FILE:
+    case OBJ_TYPED_ARRAY:
+    case OBJ_SYNC:
+    case OBJ_ATOMIC:
+    case OBJ_ISOLATE:
       break;
   }
 }
@@ -344,10 +474,12 @@ static void sweep() {
 
 void triggerGarbageCollector() {
   pthread_t threadId;
-  if (pthread_create(&threadId, NULL, startGarbageCollector, NULL) != 0) {
+  if (pthread_create(&threadId, NULL, startGarbageCollector, currentVM) != 0) {
     fprintf(stderr, "Can't spawn garbage collector thread\n");
     exit(1);
   }
+  // Never joined, VMs created and freed over and over must not leak them
+  pthread_detach(threadId);
 
   vm.GCTriggered = true;
 #if defined(DEBUG_LOG_GC) || defined(DEBUG_LOG_GC_SAFEZONE)
@@ -355,7 +487,8 @@ void triggerGarbageCollector() {
 #endif
 }
 
-void* startGarbageCollector() {
+void* startGarbageCollector(void* machine) {
+  currentVM = machine;
   pthread_mutex_lock(&vm.GCMutex);
   vm.GCThreadSpawned = true;
 #if defined(DEBUG_LOG_GC) || defined(DEBUG_LOG_GC_SAFEZONE)
@@ -388,7 +521,7 @@ void* startGarbageCollector() {
 
   markRoots();
   crawlReferences();
-  tableRemoveNotReferenced(&vm.strings);
+  interningTableRemoveNotReferenced(&vm.strings);
   sweep();
 
   vm.GCThreshold = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
@@ -402,8 +535,10 @@ void* startGarbageCollector() {
   printf(" program threads about to be released\n");
 #endif
 
-  pthread_mutex_unlock(&vm.GCMutex);
+  // Broadcast while locked: once unlocked, the VM may be freed by a thread
+  // awaiting the collector
   pthread_cond_broadcast(&vm.GCSafezoneCond);
+  pthread_mutex_unlock(&vm.GCMutex);
 
   return NULL;
 }
@@ -441,4 +576,16 @@ void leaveGCSafezone(Thread* thread) {
             thread->id, vm.safezoneCounter, vm.threadsCounter);
   #endif
   pthread_mutex_unlock(&vm.GCMutex);
-}
\ No newline at end of file
+}
+
+void awaitGarbageCollector(Thread* thread) {
+  enterGCSafezone(thread);
+
+  pthread_mutex_lock(&vm.GCMutex);
+  while (vm.GCTriggered) {
+    pthread_cond_wait(&vm.GCSafezoneCond, &vm.GCMutex);
+  }
+  pthread_mutex_unlock(&vm.GCMutex);
+
+  leaveGCSafezone(thread);
+}
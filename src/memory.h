@@ -43,11 +43,14 @@ void markObject(Obj* obj);
 void triggerGarbageCollector();
 
 // GC thread entry point
-void* startGarbageCollector();
+// Collector thread entry, machine is the VM to collect
+void* startGarbageCollector(void* machine);
 
 // Run a standard GC safezone 
 void static inline passGCSafezone(Thread* thread) {
-  if (!vm.GCThreadSpawned) return;
+  if (!atomic_load_explicit(&vm.GCThreadSpawned, memory_order_relaxed)) {
+    return;
+  }
   
   pthread_mutex_lock(&vm.GCMutex);
 
@@ -84,4 +87,7 @@ void enterGCSafezone(Thread *thread);
 // Leave forced GC safe zone
 void leaveGCSafezone(Thread *thread);
 
+// Let a triggered collection run to its end, other threads must be idle
+void awaitGarbageCollector(Thread *thread);
+
 #endif
\ No newline at end of file
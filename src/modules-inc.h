@@ -25,7 +25,7 @@ char* modulesExtension =
 	"    \n"
 	"        if (this.keyExtractor(this.arr[idx]) < this.keyExtractor(this.arr[parentIdx])) {\n"
 	"            this.__swap(idx, parentIdx);\n"
-	"            this.__bubbleUp(parentIdx);\n"
+	"            return this.__bubbleUp(parentIdx);\n"
 	"        }\n"
 	"    }\n"
 	"\n"
@@ -48,7 +48,7 @@ char* modulesExtension =
 	"\n"
 	"        if (lowestValueIdx != idx) {\n"
 	"            this.__swap(lowestValueIdx, idx);\n"
-	"            this.__heapify(lowestValueIdx);\n"
+	"            return this.__heapify(lowestValueIdx);\n"
 	"        }\n"
 	"    }\n"
 	"\n"
@@ -1,25 +1,37 @@
 #include "multithreading.h"
 
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "memory.h"
 #include "pthread.h"
 #include "semaphore.h"
 #include "vm.h"
 
-ActiveThread* spawnThread(Thread* program) {
+// Chunks handed out per worker, so that uneven chunks are balanced out
+#define CHUNKS_PER_WORKER 4
+// Longer timeouts, about 30 years, wait forever. Their deadline may not fit
+// in a time_t.
+#define TIMEOUT_MAX 1e9
+
+ActiveThread* newActiveThread() {
   // Lock memory allocation area
   pthread_mutex_lock(&vm.memoryAllocationMutex);
 
   ActiveThread* activeThread = ALLOCATE(ActiveThread, 1);
-  Thread* workerThread = ALLOCATE(Thread, 1);
-
-  initProgram(workerThread);
-  tableAddAll(&program->frame->namespace, &workerThread->global);
+  Thread* program = ALLOCATE(Thread, 1);
 
+  initProgram(program);
   activeThread->id = vm.threadsIdCounter++;
-  activeThread->program = workerThread;
-  workerThread->id = activeThread->id; 
+  activeThread->program = program;
+  activeThread->future = NULL;
+  activeThread->previous = NULL;
+  program->id = activeThread->id;
 
+  activeThread->prev = NULL;
   activeThread->next = vm.threads;
+  if (vm.threads != NULL) vm.threads->prev = activeThread;
   vm.threads = activeThread;
 
   // Unlock memory allocation area
@@ -27,6 +39,13 @@ ActiveThread* spawnThread(Thread* program) {
   return activeThread;
 }
 
+ActiveThread* spawnThread(Thread* program) {
+  ActiveThread* activeThread = newActiveThread();
+  tableAddAll(&program->frame->namespace, &activeThread->program->global);
+
+  return activeThread;
+}
+
 ActiveThread* getThread(uint32_t threadId) {
   // Lock memory allocation area
   pthread_mutex_lock(&vm.memoryAllocationMutex);
@@ -41,44 +60,581 @@ ActiveThread* getThread(uint32_t threadId) {
   return thread;
 }
 
-void killThread(Thread* program, uint32_t threadId) {
+void killThread(ActiveThread* thread) {
   // Lock memory allocation area
   pthread_mutex_lock(&vm.memoryAllocationMutex);
 
-  ActiveThread* tmp = vm.threads;
-  ActiveThread* prev = NULL;
+  if (thread->prev == NULL) {
+    vm.threads = thread->next;
+  } else {
+    thread->prev->next = thread->next;
+  }
+  if (thread->next != NULL) thread->next->prev = thread->prev;
+
+  freeProgram(thread->program);
+  FREE(Thread, thread->program);
+  FREE(ActiveThread, thread);
 
-  while (tmp != NULL && tmp->id != threadId) {
-    prev = tmp;
-    tmp = tmp->next;
+  // Unlock memory allocation area
+  pthread_mutex_unlock(&vm.memoryAllocationMutex);
+}
+
+void killEntryThread(ActiveThread* thread) {
+  freeTable(&thread->program->frames[0].namespace);
+  killThread(thread);
+}
+
+// Negative, infinite and too long timeouts wait forever
+static bool isTimeoutForever(double timeout) {
+  return timeout < 0 || !(timeout < TIMEOUT_MAX);
+}
+
+// Absolute time for pthreads timed waits, timeout seconds from now
+static struct timespec deadlineAfter(double timeout) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+
+  double seconds = deadline.tv_nsec / 1e9 + timeout;
+  deadline.tv_sec += (time_t)seconds;
+  deadline.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9);
+
+  return deadline;
+}
+
+// Caller must hold the scheduler mutex
+static void scheduleReady(Scheduler* scheduler, ActiveThread* thread) {
+  thread->nextReady = NULL;
+
+  if (scheduler->lastReady == NULL) {
+    scheduler->ready = thread;
+  } else {
+    scheduler->lastReady->nextReady = thread;
+  }
+  scheduler->lastReady = thread;
+  pthread_cond_signal(&scheduler->readyAvailable);
+}
+
+void settleFuture(ObjFuture* future, FutureState state, Value value) {
+  pthread_mutex_lock(&vm.futuresMutex);
+  future->state = state;
+  future->value = value;
+  pthread_cond_broadcast(&vm.futuresCond);
+
+  // Suspended green threads are ready again
+  if (future->waiters != NULL) {
+    pthread_mutex_lock(&vm.scheduler.mutex);
+    while (future->waiters != NULL) {
+      ActiveThread* thread = future->waiters;
+      future->waiters = thread->nextReady;
+      scheduleReady(&vm.scheduler, thread);
+    }
+    pthread_mutex_unlock(&vm.scheduler.mutex);
+  }
+
+  pthread_mutex_unlock(&vm.futuresMutex);
+}
+
+bool isFutureSettled(ObjFuture* future) {
+  pthread_mutex_lock(&vm.futuresMutex);
+  bool settled = future->state != FUTURE_PENDING;
+  pthread_mutex_unlock(&vm.futuresMutex);
+
+  return settled;
+}
+
+static int settledFutures(Value* futures, int length) {
+  int settled = 0;
+
+  for (int idx = 0; idx < length; idx++) {
+    if (AS_FUTURE(futures[idx])->state != FUTURE_PENDING) settled++;
+  }
+
+  return settled;
+}
+
+bool awaitFutures(Thread* program, Value* futures, int length, int count,
+                  double timeout) {
+  struct timespec deadline;
+  bool forever = isTimeoutForever(timeout);
+  if (!forever) deadline = deadlineAfter(timeout);
+
+  bool timedOut = false;
+
+  enterGCSafezone(program);
+  pthread_mutex_lock(&vm.futuresMutex);
+  while (!timedOut && settledFutures(futures, length) < count) {
+    if (forever) {
+      pthread_cond_wait(&vm.futuresCond, &vm.futuresMutex);
+    } else {
+      timedOut = pthread_cond_timedwait(&vm.futuresCond, &vm.futuresMutex,
+                                        &deadline) == ETIMEDOUT;
+    }
+  }
+  // Settled right at the deadline
+  if (timedOut) timedOut = settledFutures(futures, length) < count;
+  pthread_mutex_unlock(&vm.futuresMutex);
+  leaveGCSafezone(program);
+
+  return !timedOut;
+}
+
+void initWorkersPool(WorkersPool* pool) {
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->workAvailable, NULL);
+  pthread_cond_init(&pool->taskDone, NULL);
+  pool->tasks = NULL;
+  pool->lastTask = NULL;
+  pool->workersCount = 0;
+  pool->idleWorkers = 0;
+  pool->stopping = false;
+}
+
+void stopWorkersPool(WorkersPool* pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->workAvailable);
+  while (pool->workersCount > 0) {
+    pthread_cond_wait(&pool->taskDone, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->workAvailable);
+  pthread_cond_destroy(&pool->taskDone);
+}
+
+static int workersPoolSize() {
+  long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  return processors > 0 ? (int)processors : 1;
+}
+
+static void runChunk(Thread* program, ParallelTask* task, int chunk) {
+  int start = chunk * task->chunkSize;
+  int end = start + task->chunkSize;
+  if (end > task->count) end = task->count;
+
+  push(program, OBJ_VAL(task->function));
+  push(program, NUMBER_VAL(start));
+  push(program, NUMBER_VAL(end));
+  callSharedEntry(program, task->function, &task->namespace, 2);
+  run(program);
+
+  // Chunks are stored apart, no lock is needed
+  task->results->list.values[chunk] = peek(program, 0);
+  program->stackTop = program->stack;
+
+  outputFlush(&vm.output, &program->output);
+}
+
+static void* runWorker(void* ctx) {
+  ActiveThread* thread = (ActiveThread*)ctx;
+  Thread* program = thread->program;
+  currentVM = program->machine;
+  WorkersPool* pool = &vm.workers;
+
+  pthread_mutex_lock(&vm.GCMutex);
+  vm.threadsCounter++;
+  pthread_mutex_unlock(&vm.GCMutex);
+
+  for (;;) {
+    enterGCSafezone(program);
+    pthread_mutex_lock(&pool->mutex);
+
+    while (pool->tasks == NULL && !pool->stopping) {
+      pthread_cond_wait(&pool->workAvailable, &pool->mutex);
+    }
+    if (pool->tasks == NULL) break;
+    pool->idleWorkers--;
+
+    ParallelTask* task = pool->tasks;
+    int chunk = task->nextChunk++;
+    if (task->nextChunk == task->chunksCount) {
+      pool->tasks = task->next;
+      if (pool->tasks == NULL) pool->lastTask = NULL;
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    leaveGCSafezone(program);
+
+    runChunk(program, task, chunk);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (--task->pendingChunks == 0) {
+      pthread_cond_broadcast(&pool->taskDone);
+    }
+    pool->idleWorkers++;
+    pthread_mutex_unlock(&pool->mutex);
+  }
+
+  // Stopping, still in the safezone with the pool locked
+  pthread_mutex_unlock(&pool->mutex);
+  leaveGCSafezone(program);
+
+  killThread(thread);
+
+  pthread_mutex_lock(&vm.GCMutex);
+  vm.threadsCounter--;
+  pthread_mutex_unlock(&vm.GCMutex);
+
+  // The VM may be freed as soon as the last worker is gone
+  pthread_mutex_lock(&pool->mutex);
+  pool->workersCount--;
+  pool->idleWorkers--;
+  pthread_cond_broadcast(&pool->taskDone);
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+// Caller must hold the pool mutex. Workers count as idle from the start.
+static bool spawnWorker(WorkersPool* pool) {
+  ActiveThread* activeThread = newActiveThread();
+
+  if (pthread_create(&activeThread->pthreadId, NULL, runWorker,
+                     activeThread) != 0) {
+    killThread(activeThread);
+    return false;
   }
+  pthread_detach(activeThread->pthreadId);
+
+  pool->workersCount++;
+  pool->idleWorkers++;
+  return true;
+}
+
+bool runParallel(Thread* program, ObjClosure* function, int count) {
+  WorkersPool* pool = &vm.workers;
+  int poolSize = workersPoolSize();
+
+  // Grain size: a few chunks per worker, never empty
+  int chunksCount = poolSize * CHUNKS_PER_WORKER;
+  if (chunksCount > count) chunksCount = count;
+  int chunkSize = chunksCount > 0 ? (count + chunksCount - 1) / chunksCount : 0;
+  if (chunkSize > 0) chunksCount = (count + chunkSize - 1) / chunkSize;
 
-  if (tmp == NULL) return;
+  ObjArray* results = newArray();
+  // push beforehand to the stack to protect from the GC
+  push(program, OBJ_VAL(results));
 
-  if (prev == NULL) {
-    vm.threads = vm.threads->next;
+  results->list.values = GROW_ARRAY(Value, NULL, 0, chunksCount);
+  results->list.capacity = chunksCount;
+  for (int idx = 0; idx < chunksCount; idx++) {
+    results->list.values[idx] = NIL_VAL;
+  }
+  results->list.count = chunksCount;
+
+  if (chunksCount == 0) return true;
+
+  // Lines logged before the operation come before the workers lines
+  outputFlush(&vm.output, &program->output);
+
+  ParallelTask task;
+  task.function = function;
+  task.namespace = program->frame->namespace;
+  task.results = results;
+  task.count = count;
+  task.chunkSize = chunkSize;
+  task.chunksCount = chunksCount;
+  task.nextChunk = 0;
+  task.pendingChunks = chunksCount;
+  task.next = NULL;
+
+  pthread_mutex_lock(&pool->mutex);
+
+  // Workers waiting on nested parallel operations don't take work, an idle
+  // worker must always be left so that the queue makes progress.
+  while (pool->workersCount < poolSize || pool->idleWorkers == 0) {
+    if (!spawnWorker(pool)) {
+      pthread_mutex_unlock(&pool->mutex);
+      return false;
+    }
+  }
+
+  if (pool->lastTask == NULL) {
+    pool->tasks = &task;
   } else {
-    prev->next = tmp->next;
+    pool->lastTask->next = &task;
   }
+  pool->lastTask = &task;
+  pthread_cond_broadcast(&pool->workAvailable);
+  pthread_mutex_unlock(&pool->mutex);
 
-  freeProgram(tmp->program);
-  FREE(Thread, tmp->program);
-  FREE(ActiveThread, tmp);
+  enterGCSafezone(program);
+  pthread_mutex_lock(&pool->mutex);
+  while (task.pendingChunks > 0) {
+    pthread_cond_wait(&pool->taskDone, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  leaveGCSafezone(program);
 
-  // Unlock memory allocation area
-  pthread_mutex_unlock(&vm.memoryAllocationMutex);
+  return true;
+}
+
+void initScheduler(Scheduler* scheduler) {
+  pthread_mutex_init(&scheduler->mutex, NULL);
+  pthread_cond_init(&scheduler->readyAvailable, NULL);
+  pthread_cond_init(&scheduler->carrierDone, NULL);
+  scheduler->ready = NULL;
+  scheduler->lastReady = NULL;
+  scheduler->carriersCount = 0;
+  scheduler->carriersMax = workersPoolSize();
+  scheduler->idleCarriers = 0;
+  scheduler->stopping = false;
+}
+
+void stopScheduler(Scheduler* scheduler) {
+  // Carriers may need a collection to finish their slice
+  enterGCSafezone(&vm.program);
+  pthread_mutex_lock(&scheduler->mutex);
+  scheduler->stopping = true;
+  pthread_cond_broadcast(&scheduler->readyAvailable);
+  while (scheduler->carriersCount > 0) {
+    pthread_cond_wait(&scheduler->carrierDone, &scheduler->mutex);
+  }
+  pthread_mutex_unlock(&scheduler->mutex);
+  leaveGCSafezone(&vm.program);
+
+  pthread_mutex_destroy(&scheduler->mutex);
+  pthread_cond_destroy(&scheduler->readyAvailable);
+  pthread_cond_destroy(&scheduler->carrierDone);
+}
+
+void suspendGreenThread(Thread* program, ObjFuture* future,
+                        const char* error) {
+  program->awaiting = future;
+  program->awaitingError = error;
+  program->suspending = true;
+}
+
+void retryGreenThread(Thread* program, ObjFuture* future) {
+  suspendGreenThread(program, future, NULL);
+  program->retrying = true;
+}
+
+void initWakeup(Wakeup* wakeup) {
+  pthread_mutex_init(&wakeup->mutex, NULL);
+  wakeup->future = NULL;
+  atomic_init(&wakeup->pending, false);
+}
+
+void lockWakeup(Wakeup* wakeup) {
+  pthread_mutex_lock(&wakeup->mutex);
+  atomic_store(&wakeup->pending, true);
+}
+
+void unlockWakeup(Wakeup* wakeup) { pthread_mutex_unlock(&wakeup->mutex); }
+
+void awaitWakeup(Thread* program, Wakeup* wakeup) {
+  if (wakeup->future == NULL) {
+    wakeup->future = newFuture();
+  }
+
+  retryGreenThread(program, wakeup->future);
+  pthread_mutex_unlock(&wakeup->mutex);
+}
+
+void signalWakeup(Wakeup* wakeup) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!atomic_load(&wakeup->pending)) return;
+
+  pthread_mutex_lock(&wakeup->mutex);
+  atomic_store(&wakeup->pending, false);
+  if (wakeup->future != NULL) {
+    settleFuture(wakeup->future, FUTURE_DONE, NIL_VAL);
+    wakeup->future = NULL;
+  }
+  pthread_mutex_unlock(&wakeup->mutex);
+}
+
+// The awaited future value stands for the result of the suspending call,
+// unless the native is retried
+static void resumeGreenThread(Thread* program) {
+  ObjFuture* future = program->awaiting;
+  if (future == NULL) return;
+
+  program->awaiting = NULL;
+  if (program->retryNative != NULL) {
+    retryNativeCall(program);
+  } else if (future->state == FUTURE_FAILED) {
+    recoverableRuntimeError(program, "%s", program->awaitingError);
+  } else {
+    program->stackTop[-1] = future->value;
+  }
+}
+
+// Waits for future, or goes back to the run queue when there is none or it's
+// settled already
+static void parkGreenThread(ActiveThread* thread, ObjFuture* future) {
+  if (future != NULL) {
+    pthread_mutex_lock(&vm.futuresMutex);
+    if (future->state == FUTURE_PENDING) {
+      thread->nextReady = future->waiters;
+      future->waiters = thread;
+      pthread_mutex_unlock(&vm.futuresMutex);
+      return;
+    }
+    pthread_mutex_unlock(&vm.futuresMutex);
+  }
+
+  pthread_mutex_lock(&vm.scheduler.mutex);
+  scheduleReady(&vm.scheduler, thread);
+  pthread_mutex_unlock(&vm.scheduler.mutex);
+}
+
+// Runs a green thread until it suspends or returns. Once parked, another
+// carrier may resume it at any time.
+static void runSlice(ActiveThread* thread) {
+  Thread* program = thread->program;
+
+  pthread_mutex_lock(&vm.GCMutex);
+  vm.threadsCounter++;
+  pthread_mutex_unlock(&vm.GCMutex);
+
+  // Continuations are called with the previous future value, or fail along
+  // with it
+  ObjFuture* previous = thread->previous;
+  thread->previous = NULL;
+  InterpretResult result = INTERPRET_RUNTIME_ERROR;
+
+  if (previous == NULL || previous->state != FUTURE_FAILED) {
+    if (previous != NULL &&
+        program->frame->as.closure->function->arity > 0) {
+      program->frame->slots[1] = previous->value;
+    }
+
+    // Retried natives may suspend again right away
+    resumeGreenThread(program);
+    if (program->suspending) {
+      program->suspending = false;
+      result = INTERPRET_SUSPENDED;
+    } else {
+      result = run(program);
+    }
+    outputFlush(&vm.output, &program->output);
+  }
+
+  if (result == INTERPRET_SUSPENDED) {
+    parkGreenThread(thread, program->awaiting);
+  } else if (result == INTERPRET_OK) {
+    settleFuture(thread->future, FUTURE_DONE, peek(program, 0));
+  } else {
+    settleFuture(thread->future, FUTURE_FAILED, NIL_VAL);
+  }
+
+  // Released while still counted, so that the GC isn't marking it
+  if (result != INTERPRET_SUSPENDED) {
+    killEntryThread(thread);
+  }
+
+  pthread_mutex_lock(&vm.GCMutex);
+  vm.threadsCounter--;
+  pthread_mutex_unlock(&vm.GCMutex);
+}
+
+static void* runCarrier(void* machine) {
+  currentVM = machine;
+  Scheduler* scheduler = &vm.scheduler;
+
+  pthread_mutex_lock(&scheduler->mutex);
+  for (;;) {
+    while (scheduler->ready == NULL && !scheduler->stopping) {
+      pthread_cond_wait(&scheduler->readyAvailable, &scheduler->mutex);
+    }
+    if (scheduler->stopping) break;
+
+    ActiveThread* thread = scheduler->ready;
+    scheduler->ready = thread->nextReady;
+    if (scheduler->ready == NULL) scheduler->lastReady = NULL;
+    scheduler->idleCarriers--;
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    runSlice(thread);
+
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->idleCarriers++;
+  }
+
+  // The VM may be freed as soon as the last carrier is gone
+  scheduler->carriersCount--;
+  scheduler->idleCarriers--;
+  pthread_cond_broadcast(&scheduler->carrierDone);
+  pthread_mutex_unlock(&scheduler->mutex);
+
+  return NULL;
+}
+
+// Caller must hold the scheduler mutex. Carriers count as idle from the start.
+static bool spawnCarrier(Scheduler* scheduler) {
+  pthread_t pthreadId;
+
+  if (pthread_create(&pthreadId, NULL, runCarrier, currentVM) != 0) {
+    return false;
+  }
+  pthread_detach(pthreadId);
+
+  scheduler->carriersCount++;
+  scheduler->idleCarriers++;
+  return true;
+}
+
+bool scheduleGreenThread(ActiveThread* thread) {
+  Scheduler* scheduler = &vm.scheduler;
+  thread->program->green = true;
+
+  pthread_mutex_lock(&scheduler->mutex);
+
+  // Carriers are started on demand, the ready threads wait for a free one
+  // once all are busy
+  if (scheduler->idleCarriers == 0 &&
+      scheduler->carriersCount < scheduler->carriersMax &&
+      !spawnCarrier(scheduler) && scheduler->carriersCount == 0) {
+    pthread_mutex_unlock(&scheduler->mutex);
+    return false;
+  }
+
+  pthread_mutex_unlock(&scheduler->mutex);
+
+  // Continuations are ready once the previous future is settled
+  parkGreenThread(thread, thread->previous);
+
+  return true;
+}
+
+// Green threads take the semaphore only when available, or else are retried
+// on the next post of any semaphore
+static void waitSemaphoreValue(Thread* program, sem_t* semaphore) {
+  if (program->green) {
+    Wakeup* wakeup = &vm.semaphoresWakeup;
+    int value;
+
+    for (;;) {
+      if (sem_trywait(semaphore) == 0) return;
+
+      lockWakeup(wakeup);
+      sem_getvalue(semaphore, &value);
+      if (value == 0) break;
+      unlockWakeup(wakeup);
+    }
+
+    awaitWakeup(program, wakeup);
+    return;
+  }
+
+  enterGCSafezone(program);
+  while (sem_wait(semaphore) != 0 && errno == EINTR);
+  leaveGCSafezone(program);
 }
 
 void initLock(Thread* program, ObjString* lockId) {
   ThreadLock* tmp = vm.locks;
 
-  while (tmp != NULL && tmp->id != lockId) {
+  while (tmp != NULL && !stringsEqual(tmp->id, lockId)) {
     tmp = tmp->next;
   }
 
   if (tmp != NULL) {
-    return recoverableRuntimeError(program, "Lock %s is already defined.",
-                                   lockId->chars);
+    return recoverableRuntimeError(program, "Lock %.*s is already defined.",
+                                   lockId->length, lockId->chars);
   }
 
   pthread_mutex_lock(&vm.memoryAllocationMutex);
@@ -95,13 +651,14 @@ void initLock(Thread* program, ObjString* lockId) {
 void lockSection(Thread* program, ObjString* lockId) {
   ThreadLock* tmp = vm.locks;
 
-  while (tmp != NULL && tmp->id != lockId) {
+  while (tmp != NULL && !stringsEqual(tmp->id, lockId)) {
     tmp = tmp->next;
   }
 
   if (tmp == NULL) {
     return recoverableRuntimeError(
-        program, "Unable to unlock undefined %s lock", lockId->chars);
+        program, "Unable to unlock undefined %.*s lock", lockId->length,
+        lockId->chars);
   }
 
   enterGCSafezone(program);
@@ -112,13 +669,14 @@ void lockSection(Thread* program, ObjString* lockId) {
 void unlockSection(Thread* program, ObjString* lockId) {
   ThreadLock* tmp = vm.locks;
 
-  while (tmp != NULL && tmp->id != lockId) {
+  while (tmp != NULL && !stringsEqual(tmp->id, lockId)) {
     tmp = tmp->next;
   }
 
   if (tmp == NULL) {
     return recoverableRuntimeError(
-        program, "Unable to unlock undefined %s lock", lockId->chars);
+        program, "Unable to unlock undefined %.*s lock", lockId->length,
+        lockId->chars);
   }
 
   pthread_mutex_unlock(&tmp->mutex);
@@ -127,15 +685,17 @@ void unlockSection(Thread* program, ObjString* lockId) {
 void initSemaphore(Thread* program, ObjString* semaphoreId, int value) {
   ThreadSemaphore* tmp = vm.semaphores;
 
-  while (tmp != NULL && tmp->id != semaphoreId) {
+  while (tmp != NULL && !stringsEqual(tmp->id, semaphoreId)) {
     tmp = tmp->next;
   }
 
   if (tmp != NULL) {
-    recoverableRuntimeError(program, "Semaphore %s is already initialized.",
-                            semaphoreId->chars);
+    return recoverableRuntimeError(program,
+                                   "Semaphore %.*s is already initialized.",
+                                   semaphoreId->length, semaphoreId->chars);
   }
 
+  pthread_mutex_lock(&vm.memoryAllocationMutex);
   tmp = ALLOCATE(ThreadSemaphore, 1);
 
   tmp->id = semaphoreId;
@@ -143,34 +703,74 @@ void initSemaphore(Thread* program, ObjString* semaphoreId, int value) {
 
   tmp->next = vm.semaphores;
   vm.semaphores = tmp;
+  pthread_mutex_unlock(&vm.memoryAllocationMutex);
 }
 
 void postSemaphore(Thread* program, ObjString* semaphoreId) {
   ThreadSemaphore* tmp = vm.semaphores;
 
-  while (tmp != NULL && tmp->id != semaphoreId) {
+  while (tmp != NULL && !stringsEqual(tmp->id, semaphoreId)) {
     tmp = tmp->next;
   }
 
   if (tmp == NULL) {
-    recoverableRuntimeError(program, "Semaphore %s not found.",
-                            semaphoreId->chars);
+    return recoverableRuntimeError(program, "Semaphore %.*s not found.",
+                                   semaphoreId->length, semaphoreId->chars);
   }
 
   sem_post(&tmp->semaphore);
+  signalWakeup(&vm.semaphoresWakeup);
 }
 
 void waitSemaphore(Thread* program, ObjString* semaphoreId) {
   ThreadSemaphore* tmp = vm.semaphores;
 
-  while (tmp != NULL && tmp->id != semaphoreId) {
+  while (tmp != NULL && !stringsEqual(tmp->id, semaphoreId)) {
     tmp = tmp->next;
   }
 
   if (tmp == NULL) {
-    recoverableRuntimeError(program, "Semaphore %s not found.",
-                            semaphoreId->chars);
+    return recoverableRuntimeError(program, "Semaphore %.*s not found.",
+                                   semaphoreId->length, semaphoreId->chars);
   }
 
-  sem_wait(&tmp->semaphore);
+  waitSemaphoreValue(program, &tmp->semaphore);
+}
+
+int mutexLock(Thread* program, ObjSync* mutex) {
+  enterGCSafezone(program);
+  int error = pthread_mutex_lock(&mutex->as.mutex);
+  leaveGCSafezone(program);
+
+  return error;
+}
+
+void semaphoreWait(Thread* program, ObjSync* semaphore) {
+  waitSemaphoreValue(program, &semaphore->as.semaphore);
+}
+
+int rwlockLock(Thread* program, ObjSync* rwlock, bool write) {
+  enterGCSafezone(program);
+  int error = write ? pthread_rwlock_wrlock(&rwlock->as.rwlock)
+                    : pthread_rwlock_rdlock(&rwlock->as.rwlock);
+  leaveGCSafezone(program);
+
+  return error;
+}
+
+int conditionWait(Thread* program, ObjSync* condition, ObjSync* mutex,
+                  double timeout) {
+  struct timespec deadline;
+  bool forever = isTimeoutForever(timeout);
+  if (!forever) deadline = deadlineAfter(timeout);
+
+  enterGCSafezone(program);
+  int error = forever
+                  ? pthread_cond_wait(&condition->as.condition,
+                                      &mutex->as.mutex)
+                  : pthread_cond_timedwait(&condition->as.condition,
+                                           &mutex->as.mutex, &deadline);
+  leaveGCSafezone(program);
+
+  return error;
 }
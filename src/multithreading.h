@@ -3,14 +3,67 @@
 
 #include "vm.h"
 
+// Registers a new thread in vm.threads, with no globals
+ActiveThread* newActiveThread();
+// New thread with the globals of program current frame
 ActiveThread* spawnThread(Thread* program);
 ActiveThread* getThread(uint32_t threadId);
-void killThread(Thread* program, uint32_t threadId);
+void killThread(ActiveThread* thread);
+// Same as killThread for threads started with callEntry, which own their
+// entry frame namespace
+void killEntryThread(ActiveThread* thread);
+// Wakes up every thread awaiting the future
+void settleFuture(ObjFuture* future, FutureState state, Value value);
+bool isFutureSettled(ObjFuture* future);
+// Waits for count of the futures to be settled, at most timeout seconds when
+// it isn't negative, infinite or huge. Fails on timeout.
+bool awaitFutures(Thread* program, Value* futures, int length, int count,
+                  double timeout);
+void initWorkersPool(WorkersPool* pool);
+// Waits for every worker to exit, they must be idle
+void stopWorkersPool(WorkersPool* pool);
+// Calls function(start, end) for chunks of [0, count) on the workers pool and
+// pushes the array of their return values, in chunks order. Fails if the
+// workers can't be started.
+bool runParallel(Thread* program, ObjClosure* function, int count);
+void initScheduler(Scheduler* scheduler);
+// Waits for every carrier to be done with its slice, green threads left are
+// never resumed
+void stopScheduler(Scheduler* scheduler);
+// Hands a green thread to the carriers, it runs once its previous future is
+// settled if any. Fails if no carrier can be started.
+bool scheduleGreenThread(ActiveThread* thread);
+// Flags the calling green thread to suspend once the native returns, until
+// future is settled (error is thrown if it failed) or right away to yield
+// when future is NULL
+void suspendGreenThread(Thread* program, ObjFuture* future, const char* error);
+// Flags the calling green thread to suspend until future is settled, and to
+// call the native again on resume. Its return value is dropped.
+void retryGreenThread(Thread* program, ObjFuture* future);
+void initWakeup(Wakeup* wakeup);
+// Green threads announce themselves first and then check again what they
+// wait for, so that either they see the change or the changing thread sees
+// them. Once locked, the wakeup must be either awaited or unlocked.
+void lockWakeup(Wakeup* wakeup);
+void unlockWakeup(Wakeup* wakeup);
+// Retries the calling native once the wakeup is signaled, and unlocks it
+void awaitWakeup(Thread* program, Wakeup* wakeup);
+// Resumes every green thread awaiting the wakeup, called after each change
+void signalWakeup(Wakeup* wakeup);
 void initLock(Thread* program, ObjString* lockId);
 void lockSection(Thread* program, ObjString* lockId);
 void unlockSection(Thread* program, ObjString* lockId);
 void initSemaphore(Thread* program, ObjString* semaphoreId, int value);
 void postSemaphore(Thread* program, ObjString* semaphoreId);
 void waitSemaphore(Thread* program, ObjString* semaphoreId);
+// Blocking operations on "sync" module primitives wait in a GC safezone, they
+// return 0 or the pthreads error.
+int mutexLock(Thread* program, ObjSync* mutex);
+void semaphoreWait(Thread* program, ObjSync* semaphore);
+int rwlockLock(Thread* program, ObjSync* rwlock, bool write);
+// Waits at most timeout seconds when it isn't negative, infinite or huge
+// (ETIMEDOUT)
+int conditionWait(Thread* program, ObjSync* condition, ObjSync* mutex,
+                  double timeout);
 
 #endif
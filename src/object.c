@@ -73,6 +73,79 @@ ObjOverloadedMethod *newOverloadedMethod(ObjString *name) {
   return overloadedMethod;
 }
 
+ObjJumpTable *newJumpTable(int count) {
+  // Keep the load factor under 0.5, the table is never resized.
+  int capacity = 8;
+  while (capacity < count * 2) capacity *= 2;
+
+  // Entries are allocated before the object, so that a garbage collection
+  // triggered by this allocation can't sweep the unreferenced table.
+  JumpTableEntry *entries = ALLOCATE(JumpTableEntry, capacity);
+
+  for (int idx = 0; idx < capacity; idx++) {
+    entries[idx].key = NIL_VAL;
+    entries[idx].offset = 0;
+  }
+
+  ObjJumpTable *table = ALLOCATE_OBJ(OBJ_JUMP_TABLE, ObjJumpTable);
+  table->outOffset = 0;
+  table->count = 0;
+  table->capacity = capacity;
+  table->entries = entries;
+
+  return table;
+}
+
+static uint32_t hashJumpTableKey(Value key) {
+  if (IS_STRING(key)) return stringHash(AS_STRING(key));
+
+  // Numbers keys, +0 and -0 share the same slot
+  double number = AS_NUMBER(key);
+  if (number == 0) return 0;
+
+  uint64_t bits;
+  memcpy(&bits, &number, sizeof(bits));
+  bits *= 0x9E3779B97F4A7C15u;
+  return (uint32_t)(bits >> 32);
+}
+
+static JumpTableEntry *findJumpTableEntry(ObjJumpTable *table, Value key) {
+  uint32_t mask = table->capacity - 1;
+  uint32_t index = hashJumpTableKey(key) & mask;
+
+  for (;;) {
+    JumpTableEntry *entry = &table->entries[index];
+
+    if (IS_NIL(entry->key) || valuesEqual(entry->key, key)) {
+      return entry;
+    }
+
+    index = (index + 1) & mask;
+  }
+}
+
+bool jumpTableSet(ObjJumpTable *table, Value key, int offset) {
+  JumpTableEntry *entry = findJumpTableEntry(table, key);
+
+  // The first case that matches a key wins
+  if (!IS_NIL(entry->key)) return false;
+
+  entry->key = key;
+  entry->offset = offset;
+  table->count++;
+  return true;
+}
+
+bool jumpTableGet(ObjJumpTable *table, Value key, int *offset) {
+  if (!IS_NUMBER(key) && !IS_STRING(key)) return false;
+
+  JumpTableEntry *entry = findJumpTableEntry(table, key);
+  if (IS_NIL(entry->key)) return false;
+
+  *offset = entry->offset;
+  return true;
+}
+
 ObjArray *newArray() {
   ObjArray *array = ALLOCATE_OBJ(OBJ_ARRAY, ObjArray);
   initValueArray(&array->list);
@@ -81,6 +154,189 @@ ObjArray *newArray() {
   return array;
 }
 
+ObjStringBuilder *newStringBuilder() {
+  ObjStringBuilder *builder =
+      ALLOCATE_OBJ(OBJ_STRING_BUILDER, ObjStringBuilder);
+  builder->length = 0;
+  builder->capacity = 0;
+  builder->chars = NULL;
+  builder->obj.klass = vm.stringBuilderClass;
+
+  return builder;
+}
+
+// The builder must be reachable by the GC, since growing the buffer may
+// trigger a collection.
+void stringBuilderAppend(ObjStringBuilder *builder, const char *chars,
+                         int length) {
+  if (builder->length + length > builder->capacity) {
+    int oldCapacity = builder->capacity;
+
+    while (builder->capacity < builder->length + length) {
+      builder->capacity = GROW_CAPACITY(builder->capacity);
+    }
+
+    builder->chars =
+        GROW_ARRAY(char, builder->chars, oldCapacity, builder->capacity);
+  }
+
+  memcpy(builder->chars + builder->length, chars, length);
+  builder->length += length;
+}
+
+ObjFile *newFile(int fd, FileMode mode) {
+  ObjFile *file = ALLOCATE_OBJ(OBJ_FILE, ObjFile);
+  file->mode = mode;
+  file->fd = fd;
+  file->eof = false;
+  file->start = 0;
+  file->length = 0;
+  file->capacity = 0;
+  file->buffer = NULL;
+  file->obj.klass = vm.fileClass;
+
+  return file;
+}
+
+// Elements start zeroed. Empty arrays have no bytes, NULL.
+ObjTypedArray *newTypedArray(TypedArrayKind kind, int count) {
+  size_t size = typedArrayElementSize(kind) * count;
+  char *bytes = NULL;
+
+  if (size > 0) {
+    bytes = ALLOCATE(char, size);
+    memset(bytes, 0, size);
+  }
+
+  return takeTypedArray(kind, bytes, count);
+}
+
+// The bytes must be allocated with the exact elements size
+ObjTypedArray *takeTypedArray(TypedArrayKind kind, void *bytes, int count) {
+  ObjTypedArray *array = ALLOCATE_OBJ(OBJ_TYPED_ARRAY, ObjTypedArray);
+  array->kind = kind;
+  array->count = count;
+  array->as.bytes = bytes;
+  array->obj.klass = vm.typedArrayClasses[kind];
+
+  return array;
+}
+
+ObjFuture *newFuture() {
+  ObjFuture *future = ALLOCATE_OBJ(OBJ_FUTURE, ObjFuture);
+  future->state = FUTURE_PENDING;
+  future->value = NIL_VAL;
+  future->waiters = NULL;
+  future->obj.klass = vm.futureClass;
+
+  return future;
+}
+
+ObjChannel *newChannel(int capacity) {
+  ChannelSlot *slots = ALLOCATE(ChannelSlot, capacity);
+  for (int idx = 0; idx < capacity; idx++) {
+    atomic_init(&slots[idx].sequence, 2 * idx);
+    slots[idx].value = NIL_VAL;
+  }
+
+  ObjChannel *channel = ALLOCATE_OBJ(OBJ_CHANNEL, ObjChannel);
+  channel->capacity = capacity;
+  channel->slots = slots;
+  atomic_init(&channel->head, 0);
+  atomic_init(&channel->tail, 0);
+  atomic_init(&channel->closed, false);
+  atomic_init(&channel->waiting, 0);
+  channel->obj.klass = vm.channelClass;
+
+  return channel;
+}
+
+ObjAtomic *newAtomic(ObjClass *klass, AtomicKind kind, int count) {
+  void *cells = NULL;
+  switch (kind) {
+    case ATOMIC_INT64: {
+      _Atomic int64_t *int64 = ALLOCATE(_Atomic int64_t, count);
+      for (int idx = 0; idx < count; idx++) atomic_init(&int64[idx], 0);
+      cells = int64;
+      break;
+    }
+    case ATOMIC_FLOAT64: {
+      _Atomic double *float64 = ALLOCATE(_Atomic double, count);
+      for (int idx = 0; idx < count; idx++) atomic_init(&float64[idx], 0);
+      cells = float64;
+      break;
+    }
+  }
+
+  ObjAtomic *atomic = ALLOCATE_OBJ(OBJ_ATOMIC, ObjAtomic);
+  atomic->kind = kind;
+  atomic->count = count;
+  atomic->as.int64 = cells;
+  atomic->obj.klass = klass;
+
+  return atomic;
+}
+
+ObjIsolate *newIsolate(pid_t pid, int in, int out) {
+  ObjIsolate *isolate = ALLOCATE_OBJ(OBJ_ISOLATE, ObjIsolate);
+  isolate->pid = pid;
+  isolate->in = in;
+  isolate->out = out;
+  isolate->exitCode = -1;
+  pthread_mutex_init(&isolate->sendMutex, NULL);
+  pthread_mutex_init(&isolate->receiveMutex, NULL);
+  isolate->obj.klass = vm.isolateClass;
+
+  return isolate;
+}
+
+ObjSync *newSync(SyncKind kind, unsigned int value) {
+  ObjSync *sync = ALLOCATE_OBJ(OBJ_SYNC, ObjSync);
+  sync->kind = kind;
+  sync->obj.klass = vm.syncClasses[kind];
+
+  switch (kind) {
+    case SYNC_MUTEX: {
+      // Unlocking a mutex not owned or locking it twice fails, instead of
+      // being undefined
+      pthread_mutexattr_t attributes;
+      pthread_mutexattr_init(&attributes);
+      pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_ERRORCHECK);
+      pthread_mutex_init(&sync->as.mutex, &attributes);
+      pthread_mutexattr_destroy(&attributes);
+      break;
+    }
+    case SYNC_SEMAPHORE:
+      sem_init(&sync->as.semaphore, 0, value);
+      break;
+    case SYNC_RWLOCK:
+      pthread_rwlock_init(&sync->as.rwlock, NULL);
+      break;
+    case SYNC_CONDITION:
+      pthread_cond_init(&sync->as.condition, NULL);
+      break;
+  }
+
+  return sync;
+}
+
+void freeSync(ObjSync *sync) {
+  switch (sync->kind) {
+    case SYNC_MUTEX:
+      pthread_mutex_destroy(&sync->as.mutex);
+      break;
+    case SYNC_SEMAPHORE:
+      sem_destroy(&sync->as.semaphore);
+      break;
+    case SYNC_RWLOCK:
+      pthread_rwlock_destroy(&sync->as.rwlock);
+      break;
+    case SYNC_CONDITION:
+      pthread_cond_destroy(&sync->as.condition);
+      break;
+  }
+}
+
 ObjModule *newModule(ObjFunction *function) {
   ObjModule *module = ALLOCATE_OBJ(OBJ_MODULE, ObjModule);
   module->function = function;
@@ -252,35 +508,38 @@ ObjNativeFn *newNativeFunction(NativeFn function, ObjString *name,
   return nativeFn;
 }
 
-ObjString *allocateString(char *chars, int length) {
+// A concurrent thread may intern the same content first, in that case the
+// new string is left unreferenced for the GC to collect.
+static ObjString *allocateString(char *chars, int length, uint32_t hash) {
   ObjString *string = ALLOCATE_OBJ(OBJ_STRING, ObjString);
   string->chars = chars;
   string->length = length;
-  string->hash = hashString(chars, length);
+  string->interned = false;
+  string->hash = hash;
+  string->parent = NULL;
+  string->mapped = false;
+  string->left = NULL;
+  string->right = NULL;
   string->obj.klass = vm.stringClass;
 
-  GCWhiteList((Obj *)string);
-  tableSet(&vm.strings, string, BOOL_VAL(true));
-  GCPopWhiteList();
-
-  return string;
+  return interningTableAdd(&vm.strings, string);
 }
 
 ObjString *takeString(char *chars, int length) {
-  int32_t hash = hashString(chars, length);
-  ObjString *interned = tableFindString(&vm.strings, chars, length, hash);
+  uint32_t hash = hashString(chars, length);
+  ObjString *interned = interningTableFind(&vm.strings, chars, length, hash);
 
   if (interned != NULL) {
     FREE_ARRAY(char, chars, length);
     return interned;
   }
 
-  return allocateString(chars, length);
+  return allocateString(chars, length, hash);
 }
 
 ObjString *copyString(const char *chars, int length) {
-  int32_t hash = hashString(chars, length);
-  ObjString *interned = tableFindString(&vm.strings, chars, length, hash);
+  uint32_t hash = hashString(chars, length);
+  ObjString *interned = interningTableFind(&vm.strings, chars, length, hash);
 
   if (interned != NULL) {
     return interned;
@@ -289,72 +548,314 @@ ObjString *copyString(const char *chars, int length) {
   char *buffer = ALLOCATE(char, length + 1);
   memcpy(buffer, chars, length);
   buffer[length] = '\0';
-  return allocateString(buffer, length);
+  return allocateString(buffer, length, hash);
 }
 
-static void printFunction(ObjFunction *function) {
+// Transient strings are meant for runtime produced text (e.g, concatenation,
+// split, substr) that rarely needs identity, so neither hashing nor interning
+// is paid upfront.
+ObjString *takeTransientString(char *chars, int length) {
+  ObjString *string = ALLOCATE_OBJ(OBJ_STRING, ObjString);
+  string->chars = chars;
+  string->length = length;
+  string->interned = false;
+  string->hash = 0;
+  string->parent = NULL;
+  string->mapped = false;
+  string->left = NULL;
+  string->right = NULL;
+  string->obj.klass = vm.stringClass;
+
+  return string;
+}
+
+// The chars are a file mapping that must outlive the string and be null
+// terminated right after length (see fsReadFile).
+ObjString *takeMappedString(char *chars, int length) {
+  ObjString *string = takeTransientString(chars, length);
+  string->mapped = true;
+
+  return string;
+}
+
+// Slices are transient strings sharing the buffer of the string they are
+// taken from, so that substr, split and trim don't copy. Slices of slices
+// reference the buffer owner directly.
+ObjString *newStringSlice(ObjString *string, int start, int length) {
+  flattenRope(string);
+
+  ObjString *slice = ALLOCATE_OBJ(OBJ_STRING, ObjString);
+  slice->length = length;
+  slice->interned = false;
+  slice->hash = 0;
+  slice->mapped = false;
+  slice->left = NULL;
+  slice->right = NULL;
+  slice->obj.klass = vm.stringClass;
+
+  // Buffer and owner are read together, string may be flattened concurrently
+  pthread_mutex_lock(&vm.memoryAllocationMutex);
+  slice->chars = string->chars + start;
+  slice->parent = string->parent != NULL ? string->parent : string;
+  pthread_mutex_unlock(&vm.memoryAllocationMutex);
+
+  return slice;
+}
+
+// Ropes defer concatenation so that strings built by repeated appends are
+// copied once, when their chars are first needed, instead of on every append.
+ObjString *newStringRope(ObjString *left, ObjString *right) {
+  ObjString *rope = ALLOCATE_OBJ(OBJ_STRING, ObjString);
+  rope->chars = NULL;
+  rope->length = left->length + right->length;
+  rope->interned = false;
+  rope->hash = 0;
+  rope->parent = NULL;
+  rope->mapped = false;
+  rope->left = left;
+  rope->right = right;
+  rope->obj.klass = vm.stringClass;
+
+  return rope;
+}
+
+// Gives the rope its own null terminated buffer, releasing the children.
+// Ropes built in a loop are as deep as the number of appends, so leaves are
+// copied right to left from an explicit stack rather than by recursion.
+ObjString *flattenRope(ObjString *string) {
+  if (string->chars != NULL) return string;
+
+  pthread_mutex_lock(&vm.memoryAllocationMutex);
+
+  // Another thread may have flattened it meanwhile
+  if (string->chars == NULL) {
+    char *buffer = ALLOCATE(char, string->length + 1);
+    int end = string->length;
+    buffer[end] = '\0';
+
+    int capacity = 8;
+    int count = 0;
+    ObjString **stack = malloc(sizeof(ObjString *) * capacity);
+    if (stack == NULL) exit(1);
+    stack[count++] = string;
+
+    while (count > 0) {
+      ObjString *node = stack[--count];
+
+      if (node->chars != NULL) {
+        end -= node->length;
+        memcpy(buffer + end, node->chars, node->length);
+        continue;
+      }
+
+      if (capacity < count + 2) {
+        capacity = GROW_CAPACITY(capacity);
+        stack = realloc(stack, sizeof(ObjString *) * capacity);
+        if (stack == NULL) exit(1);
+      }
+
+      stack[count++] = node->left;
+      stack[count++] = node->right;
+    }
+
+    free(stack);
+
+    string->chars = buffer;
+    string->left = NULL;
+    string->right = NULL;
+  }
+
+  pthread_mutex_unlock(&vm.memoryAllocationMutex);
+
+  return string;
+}
+
+// Gives the slice its own null terminated buffer, releasing the parent.
+ObjString *flattenString(ObjString *string) {
+  flattenRope(string);
+  if (string->parent == NULL) return string;
+
+  pthread_mutex_lock(&vm.memoryAllocationMutex);
+
+  // Another thread may have flattened it meanwhile
+  if (string->parent != NULL) {
+    char *buffer = ALLOCATE(char, string->length + 1);
+    memcpy(buffer, string->chars, string->length);
+    buffer[string->length] = '\0';
+
+    string->chars = buffer;
+    string->parent = NULL;
+  }
+
+  pthread_mutex_unlock(&vm.memoryAllocationMutex);
+
+  return string;
+}
+
+ObjString *copyTransientString(const char *chars, int length) {
+  char *buffer = ALLOCATE(char, length + 1);
+  memcpy(buffer, chars, length);
+  buffer[length] = '\0';
+  return takeTransientString(buffer, length);
+}
+
+uint32_t stringHash(ObjString *string) {
+  // Concurrent threads may compute it at once, they write the same value.
+  if (string->hash == 0) {
+    string->hash = hashString(flattenRope(string)->chars, string->length);
+  }
+
+  return string->hash;
+}
+
+// Returns the interned string with the same content, the transient string
+// itself is promoted when there is none.
+ObjString *internString(ObjString *string) {
+  if (string->interned) return string;
+
+  flattenString(string);
+  stringHash(string);
+  return interningTableAdd(&vm.strings, string);
+}
+
+// Same as internString, but returns NULL instead of promoting the string.
+ObjString *findInternedString(ObjString *string) {
+  if (string->interned) return string;
+
+  flattenRope(string);
+  return interningTableFind(&vm.strings, string->chars, string->length,
+                            stringHash(string));
+}
+
+static void writeFunction(OutputBuffer *output, ObjFunction *function) {
   if (function->name == NULL) {
-    printf("<script>");
+    outputWrite(output, "<script>", 8);
   } else if (function->name == vm.lambdaFunctionName) {
-    printf("<lambda fn>");
+    outputWrite(output, "<lambda fn>", 11);
   } else {
-    printf("<%s fn>", function->name->chars);
+    outputWriteFormat(output, "<%s fn>", function->name->chars);
   }
 }
 
-static void printValueArray(ValueArray *array) {
-  printf("[");
+static void writeArrayElements(OutputBuffer *output, ValueArray *array) {
+  outputWrite(output, "[", 1);
 
   for (int idx = 0; idx < array->count; idx++) {
-    printValue(array->values[idx]);
+    writeValue(output, array->values[idx]);
     if (idx < array->count - 1) {
-      printf(", ");
+      outputWrite(output, ", ", 2);
     }
   }
 
-  printf("]");
+  outputWrite(output, "]", 1);
 }
 
-void printObject(Value value) {
+// Atomic cells are written as their number, AtomicArray cells as an array
+static void writeAtomic(OutputBuffer *output, ObjAtomic *atomic) {
+  if (atomic->obj.klass == vm.atomicClass) {
+    writeValue(output, NUMBER_VAL(atomicGet(atomic, 0)));
+    return;
+  }
+
+  outputWrite(output, "[", 1);
+
+  for (int idx = 0; idx < atomic->count; idx++) {
+    writeValue(output, NUMBER_VAL(atomicGet(atomic, idx)));
+    if (idx < atomic->count - 1) {
+      outputWrite(output, ", ", 2);
+    }
+  }
+
+  outputWrite(output, "]", 1);
+}
+
+static void writeTypedArrayElements(OutputBuffer *output,
+                                    ObjTypedArray *array) {
+  outputWrite(output, "[", 1);
+
+  for (int idx = 0; idx < array->count; idx++) {
+    writeValue(output, NUMBER_VAL(typedArrayGet(array, idx)));
+    if (idx < array->count - 1) {
+      outputWrite(output, ", ", 2);
+    }
+  }
+
+  outputWrite(output, "]", 1);
+}
+
+void writeObject(OutputBuffer *output, Value value) {
   switch (AS_OBJ(value)->type) {
     case OBJ_BOUND_OVERLOADED_METHOD:
-      printf("<%s fn>",
-             AS_BOUND_OVERLOADED_METHOD(value)->overloadedMethod->name->chars);
+      outputWriteFormat(
+          output, "<%s fn>",
+          AS_BOUND_OVERLOADED_METHOD(value)->overloadedMethod->name->chars);
       break;
     case OBJ_OVERLOADED_METHOD:
-      printf("<%s fn>", AS_OVERLOADED_METHOD(value)->name->chars);
+      outputWriteFormat(output, "<%s fn>",
+                        AS_OVERLOADED_METHOD(value)->name->chars);
       break;
     case OBJ_ARRAY:
-      printValueArray(&AS_ARRAY(value)->list);
+      writeArrayElements(output, &AS_ARRAY(value)->list);
       break;
     case OBJ_MODULE:
       ObjModule* module = AS_MODULE(value);
       if (module->native) {
-        printf("<native module>");
+        outputWrite(output, "<native module>", 15);
       } else {
-        printf("<%s module>", AS_MODULE(value)->function->name->chars);
+        outputWriteFormat(output, "<%s module>",
+                          AS_MODULE(value)->function->name->chars);
       }
       break;
     case OBJ_INSTANCE:
-      printf("instance of %s", AS_INSTANCE(value)->obj.klass->name->chars);
+      outputWriteFormat(output, "instance of %s",
+                        AS_INSTANCE(value)->obj.klass->name->chars);
       break;
     case OBJ_CLASS:
-      printf("class %s", AS_CLASS(value)->name->chars);
+      outputWriteFormat(output, "class %s", AS_CLASS(value)->name->chars);
       break;
     case OBJ_STRING:
-      printf("%s", AS_CSTRING(value));
+      outputWrite(output, flattenRope(AS_STRING(value))->chars,
+                  AS_STRING(value)->length);
+      break;
+    case OBJ_STRING_BUILDER:
+      outputWrite(output, AS_STRING_BUILDER(value)->chars,
+                  AS_STRING_BUILDER(value)->length);
       break;
     case OBJ_FUNCTION:
-      printFunction(AS_FUNCTION(value));
+      writeFunction(output, AS_FUNCTION(value));
       break;
     case OBJ_NATIVE_FN:
-      printf("<native fn>");
+      outputWrite(output, "<native fn>", 11);
       break;
     case OBJ_CLOSURE:
-      printFunction(AS_CLOSURE(value)->function);
+      writeFunction(output, AS_CLOSURE(value)->function);
       break;
     case OBJ_UPVALUE:
-      printf("<up value>");
+      outputWrite(output, "<up value>", 10);
+      break;
+    case OBJ_JUMP_TABLE:
+      outputWrite(output, "<jump table>", 12);
+      break;
+    case OBJ_FILE:
+      outputWrite(output, "<file>", 6);
+      break;
+    case OBJ_FUTURE:
+      outputWrite(output, "<future>", 8);
+      break;
+    case OBJ_CHANNEL:
+      outputWrite(output, "<channel>", 9);
+      break;
+    case OBJ_SYNC:
+      outputWriteFormat(output, "<%s>", AS_OBJ(value)->klass->name->chars);
+      break;
+    case OBJ_ATOMIC:
+      writeAtomic(output, AS_ATOMIC(value));
+      break;
+    case OBJ_ISOLATE:
+      outputWrite(output, "<isolate>", 9);
+      break;
+    case OBJ_TYPED_ARRAY:
+      writeTypedArrayElements(output, AS_TYPED_ARRAY(value));
       break;
   }
 }
@@ -391,8 +892,10 @@ ObjString *numberToString(double value) {
    * = 22 digits
    */
   char buffer[22];
-  int len = sprintf(buffer, "%.12g", value);
-  return copyString(buffer, len);
+  int len = formatNumber(buffer, value, 12);
+
+  // Numbers are rarely used as keys, interning happens on demand
+  return copyTransientString(buffer, len);
 }
 
 static ObjString *functionToString(ObjFunction *function) {
@@ -415,8 +918,12 @@ ObjString *objToString(Value value) {
     case OBJ_CLASS:
       return copyString(AS_CLASS(value)->name->chars,
                         AS_CLASS(value)->name->length);
+    // Strings are immutable and interned, copying would yield the same object
     case OBJ_STRING:
-      return copyString(AS_CSTRING(value), AS_STRING(value)->length);
+      return flattenRope(AS_STRING(value));
+    case OBJ_STRING_BUILDER:
+      return copyTransientString(AS_STRING_BUILDER(value)->chars,
+                                 AS_STRING_BUILDER(value)->length);
     case OBJ_FUNCTION:
       return functionToString(AS_FUNCTION(value));
     case OBJ_CLOSURE:
@@ -426,7 +933,25 @@ ObjString *objToString(Value value) {
     case OBJ_NATIVE_FN:
       return copyString(AS_NATIVE(value)->name->chars,
                         AS_NATIVE(value)->name->length);
+    case OBJ_JUMP_TABLE:
+      return CONSTANT_STRING("<jump table>");
+    case OBJ_FILE:
+      return CONSTANT_STRING("<file>");
+    case OBJ_FUTURE:
+      return CONSTANT_STRING("<future>");
+    case OBJ_CHANNEL:
+      return CONSTANT_STRING("<channel>");
+    case OBJ_ISOLATE:
+      return CONSTANT_STRING("<isolate>");
+    case OBJ_SYNC: {
+      // + 3 comes from template length + '\0' char
+      char buffer[AS_OBJ(value)->klass->name->length + 3];
+      int len = sprintf(buffer, "<%s>", AS_OBJ(value)->klass->name->chars);
+      return copyString(buffer, len);
+    }
     case OBJ_ARRAY:
+    case OBJ_TYPED_ARRAY:
+    case OBJ_ATOMIC:
     case OBJ_MODULE:
     case OBJ_INSTANCE: {
       // + 13 comes from template length + '\0' char
@@ -444,7 +969,7 @@ ObjString *objToString(Value value) {
 ObjString *toString(Value value) {
 #ifdef NAN_BOXING
   if (IS_BOOL(value)) {
-    return CONSTANT_STRING(AS_BOOL(value) ? "true" : "false");
+    return AS_BOOL(value) ? CONSTANT_STRING("true") : CONSTANT_STRING("false");
   } else if (IS_NIL(value)) {
     return CONSTANT_STRING("nil");
   } else if (IS_NUMBER(value)) {
@@ -455,7 +980,7 @@ ObjString *toString(Value value) {
 #else
   switch (value.type) {
     case VAL_BOOL:
-      return CONSTANT_STRING(AS_BOOL(value) ? "true" : "false");
+      return AS_BOOL(value) ? CONSTANT_STRING("true") : CONSTANT_STRING("false");
     case VAL_NUMBER:
       return numberToString(AS_NUMBER(value));
     case VAL_NIL:
@@ -1,6 +1,14 @@
 #ifndef object_h
 #define object_h
 
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
 #include "chunk.h"
 #include "common.h"
 #include "table.h"
@@ -17,7 +25,16 @@ typedef enum {
   OBJ_CLOSURE,
   OBJ_UPVALUE,
   OBJ_OVERLOADED_METHOD,
-  OBJ_BOUND_OVERLOADED_METHOD
+  OBJ_BOUND_OVERLOADED_METHOD,
+  OBJ_JUMP_TABLE,
+  OBJ_STRING_BUILDER,
+  OBJ_FILE,
+  OBJ_TYPED_ARRAY,
+  OBJ_FUTURE,
+  OBJ_CHANNEL,
+  OBJ_SYNC,
+  OBJ_ATOMIC,
+  OBJ_ISOLATE
 } ObjType;
 
 typedef enum { USER_METHOD, NATIVE_METHOD } MethodType;
@@ -52,10 +69,29 @@ struct Obj {
   struct Obj *next;
 };
 
+// Concatenations shorter than this are copied right away instead of deferred
+#define ROPE_MIN_LENGTH 64
+
 struct ObjString {
   Obj obj;
   int length;
+  // Interned strings are unique by content and compared by identity.
+  // Transient strings skip the interning table and are compared by content,
+  // they are interned on demand when used as a table key.
+  bool interned;
+  // Transient strings hash is lazily computed (0 means not computed yet),
+  // use stringHash.
   uint32_t hash;
+  // Slices point into their parent buffer (kept alive by the GC) and are not
+  // null terminated, use flattenString before handing chars to C functions.
+  // The parent is NULL for strings that own their buffer.
+  struct ObjString *parent;
+  // Buffer is a read only file mapping (see fs.c), unmapped when collected.
+  bool mapped;
+  // Ropes are deferred concatenations of left and right (see newStringRope),
+  // their chars are NULL until flattenRope joins them on first use.
+  struct ObjString *left;
+  struct ObjString *right;
   char *chars;
 };
 
@@ -136,11 +172,176 @@ typedef struct ObjArray {
   ValueArray list;
 } ObjArray;
 
+typedef struct {
+  // Case constant, NIL_VAL for empty entries
+  Value key;
+  // Case statement offset from the switch start address
+  int offset;
+} JumpTableEntry;
+
+// Switch statements whose cases are all constant numbers or strings are
+// dispatched through a jump table stored in the chunk constants.
+typedef struct ObjJumpTable {
+  Obj obj;
+  // Switch out address offset from the switch start address
+  int outOffset;
+  int count;
+  int capacity;
+  JumpTableEntry *entries;
+} ObjJumpTable;
+
+// Mutable string buffer, repeated appends are amortized O(1) and the
+// content is only copied (and interned) when converted back to a string.
+typedef struct ObjStringBuilder {
+  Obj obj;
+  int length;
+  int capacity;
+  char *chars;
+} ObjStringBuilder;
+
+typedef enum { FILE_READER, FILE_WRITER } FileMode;
+
+// Files opened through the "fs" module. Readers keep the bytes of the last
+// chunk read that weren't consumed yet in buffer[start, length), writers the
+// bytes not written out yet in buffer[0, length).
+typedef struct ObjFile {
+  Obj obj;
+  FileMode mode;
+  // Operating system file descriptor, -1 once closed
+  int fd;
+  bool eof;
+  int start;
+  int length;
+  int capacity;
+  char *buffer;
+} ObjFile;
+
+typedef enum {
+  TYPED_ARRAY_FLOAT64,
+  TYPED_ARRAY_INT32,
+  TYPED_ARRAY_UINT8
+} TypedArrayKind;
+
+#define TYPED_ARRAY_KINDS 3
+
+// Fixed length arrays of unboxed numbers, stored contiguously and never
+// scanned by the GC. Integer kinds truncate and wrap around on writes.
+typedef struct ObjTypedArray {
+  Obj obj;
+  TypedArrayKind kind;
+  int count;
+  union {
+    void *bytes;
+    double *float64;
+    int32_t *int32;
+    uint8_t *uint8;
+  } as;
+} ObjTypedArray;
+
+typedef enum { FUTURE_PENDING, FUTURE_DONE, FUTURE_FAILED } FutureState;
+
+// Result of a function started on its own or on a green thread by the
+// "threads" module.
+// Futures are settled once, guarded by vm.futuresMutex.
+typedef struct ObjFuture {
+  Obj obj;
+  FutureState state;
+  // Function return value, once done
+  Value value;
+  // Green threads suspended until the future is settled
+  struct ActiveThread *waiters;
+} ObjFuture;
+
+typedef struct {
+  // Twice the position of the send the slot waits for, plus one once the value
+  // is written
+  atomic_size_t sequence;
+  Value value;
+} ChannelSlot;
+
+// Bounded multi-producer multi-consumer queue. Slots are claimed by moving
+// head and tail forward, without locks. Received slots are reset to nil, so
+// that the GC doesn't keep their values.
+typedef struct ObjChannel {
+  Obj obj;
+  int capacity;
+  ChannelSlot *slots;
+  // Position of the next receive
+  atomic_size_t head;
+  // Position of the next send
+  atomic_size_t tail;
+  atomic_bool closed;
+  // Threads blocked on the channel, they are only woken up when not zero
+  atomic_int waiting;
+} ObjChannel;
+
+typedef enum {
+  SYNC_MUTEX,
+  SYNC_SEMAPHORE,
+  SYNC_RWLOCK,
+  SYNC_CONDITION
+} SyncKind;
+
+#define SYNC_KINDS 4
+
+// Synchronization primitives of the "sync" module, handed to threads as
+// values. They are destroyed along with the object.
+typedef struct ObjSync {
+  Obj obj;
+  SyncKind kind;
+  union {
+    pthread_mutex_t mutex;
+    sem_t semaphore;
+    pthread_rwlock_t rwlock;
+    pthread_cond_t condition;
+  } as;
+} ObjSync;
+
+typedef enum { ATOMIC_INT64, ATOMIC_FLOAT64 } AtomicKind;
+
+// Numbers updated atomically by any thread. An Atomic is a single cell, an
+// AtomicArray has count cells. Integer cells wrap around on overflow.
+typedef struct ObjAtomic {
+  Obj obj;
+  AtomicKind kind;
+  int count;
+  union {
+    _Atomic int64_t *int64;
+    _Atomic double *float64;
+  } as;
+} ObjAtomic;
+
+// Script running in a child process, with a heap, string table and GC of its
+// own. Messages are structured clones written to pipes, guarded by a mutex
+// per direction.
+typedef struct ObjIsolate {
+  Obj obj;
+  // Child process, 0 for the parent isolate seen from the child
+  pid_t pid;
+  // Pipe messages are received from, -1 once closed
+  int in;
+  // Pipe messages are sent to, -1 once closed
+  int out;
+  // Exit code once waited for, -1 before
+  int exitCode;
+  pthread_mutex_t sendMutex;
+  pthread_mutex_t receiveMutex;
+} ObjIsolate;
+
 #define OBJ_TYPE(value) (AS_OBJ(value)->type)
 
 #define IS_BOUND_OVERLOADED_METHOD(value) \
   (isObjType(value, OBJ_BOUND_OVERLOADED_METHOD))
 #define IS_OVERLOADED_METHOD(value) (isObjType(value, OBJ_OVERLOADED_METHOD))
+#define IS_JUMP_TABLE(value) (isObjType(value, OBJ_JUMP_TABLE))
+#define IS_STRING_BUILDER(value) (isObjType(value, OBJ_STRING_BUILDER))
+#define IS_FILE(value) (isObjType(value, OBJ_FILE))
+#define IS_TYPED_ARRAY(value) (isObjType(value, OBJ_TYPED_ARRAY))
+#define IS_FUTURE(value) (isObjType(value, OBJ_FUTURE))
+#define IS_CHANNEL(value) (isObjType(value, OBJ_CHANNEL))
+#define IS_SYNC(value) (isObjType(value, OBJ_SYNC))
+#define IS_ATOMIC(value) (isObjType(value, OBJ_ATOMIC))
+#define IS_ISOLATE(value) (isObjType(value, OBJ_ISOLATE))
 #define IS_CLOSURE(value) (isObjType(value, OBJ_CLOSURE))
 #define IS_ARRAY(value) (isObjType(value, OBJ_ARRAY))
 #define IS_MODULE(value) (isObjType(value, OBJ_MODULE))
@@ -159,6 +360,15 @@ typedef struct ObjArray {
 #define AS_BOUND_OVERLOADED_METHOD(value) \
   ((ObjBoundOverloadedMethod *)AS_OBJ(value))
 #define AS_OVERLOADED_METHOD(value) ((ObjOverloadedMethod *)AS_OBJ(value))
+#define AS_JUMP_TABLE(value) ((ObjJumpTable *)AS_OBJ(value))
+#define AS_STRING_BUILDER(value) ((ObjStringBuilder *)AS_OBJ(value))
+#define AS_FILE(value) ((ObjFile *)AS_OBJ(value))
+#define AS_TYPED_ARRAY(value) ((ObjTypedArray *)AS_OBJ(value))
+#define AS_FUTURE(value) ((ObjFuture *)AS_OBJ(value))
+#define AS_CHANNEL(value) ((ObjChannel *)AS_OBJ(value))
+#define AS_SYNC(value) ((ObjSync *)AS_OBJ(value))
+#define AS_ATOMIC(value) ((ObjAtomic *)AS_OBJ(value))
+#define AS_ISOLATE(value) ((ObjIsolate *)AS_OBJ(value))
 #define AS_UP_VALUE(value) ((ObjUpValue *)AS_OBJ(value))
 #define AS_ARRAY_LIST(value) (((ObjArray *)AS_OBJ(value))->list)
 #define AS_ARRAY(value) ((ObjArray *)AS_OBJ(value))
@@ -181,6 +391,23 @@ ObjBoundOverloadedMethod *newBoundOverloadedMethod(
     Value base, ObjOverloadedMethod *overloadedMethod);
 ObjOverloadedMethod *newNativeOverloadedMethod(ObjString *name);
 ObjOverloadedMethod *newOverloadedMethod(ObjString *name);
+ObjJumpTable *newJumpTable(int count);
+bool jumpTableSet(ObjJumpTable *table, Value key, int offset);
+bool jumpTableGet(ObjJumpTable *table, Value key, int *offset);
+ObjStringBuilder *newStringBuilder();
+void stringBuilderAppend(ObjStringBuilder *builder, const char *chars,
+                         int length);
+ObjFile *newFile(int fd, FileMode mode);
+ObjTypedArray *newTypedArray(TypedArrayKind kind, int count);
+ObjTypedArray *takeTypedArray(TypedArrayKind kind, void *bytes, int count);
+ObjFuture *newFuture();
+ObjChannel *newChannel(int capacity);
+// value is the semaphore initial value, ignored by other kinds
+ObjSync *newSync(SyncKind kind, unsigned int value);
+void freeSync(ObjSync *sync);
+// Cells start at 0. klass is either Atomic or AtomicArray.
+ObjAtomic *newAtomic(ObjClass *klass, AtomicKind kind, int count);
+ObjIsolate *newIsolate(pid_t pid, int in, int out);
 ObjString *toString(Value value);
 ObjArray *newArray();
 ObjModule *newNativeModule(ObjString* moduleName);
@@ -193,10 +420,88 @@ ObjFunction *newFunction();
 ObjNativeFn *newNativeFunction(NativeFn function, ObjString *name, Arity arity);
 ObjString *copyString(const char *chars, int length);
 ObjString *takeString(char *chars, int length);
-void printObject(Value value);
+ObjString *copyTransientString(const char *chars, int length);
+ObjString *takeTransientString(char *chars, int length);
+ObjString *takeMappedString(char *chars, int length);
+ObjString *newStringSlice(ObjString *string, int start, int length);
+ObjString *newStringRope(ObjString *left, ObjString *right);
+ObjString *flattenRope(ObjString *string);
+ObjString *flattenString(ObjString *string);
+ObjString *internString(ObjString *string);
+ObjString *findInternedString(ObjString *string);
+uint32_t stringHash(ObjString *string);
+void writeObject(OutputBuffer *output, Value value);
 
 static inline bool isObjType(Value value, ObjType type) {
   return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
 
+static inline size_t typedArrayElementSize(TypedArrayKind kind) {
+  switch (kind) {
+    case TYPED_ARRAY_FLOAT64:
+      return sizeof(double);
+    case TYPED_ARRAY_INT32:
+      return sizeof(int32_t);
+    case TYPED_ARRAY_UINT8:
+      return sizeof(uint8_t);
+  }
+
+  return 0;
+}
+
+// Wraps around modulo 2^32, non finite numbers become 0
+static inline int32_t toInt32(double number) {
+  if (number >= INT32_MIN && number <= INT32_MAX) return (int32_t)number;
+  if (!isfinite(number)) return 0;
+
+  return (int32_t)(uint32_t)(int64_t)fmod(trunc(number), 4294967296.0);
+}
+
+static inline double typedArrayGet(ObjTypedArray *array, int idx) {
+  switch (array->kind) {
+    case TYPED_ARRAY_FLOAT64:
+      return array->as.float64[idx];
+    case TYPED_ARRAY_INT32:
+      return array->as.int32[idx];
+    case TYPED_ARRAY_UINT8:
+      return array->as.uint8[idx];
+  }
+
+  return 0;
+}
+
+static inline void typedArraySet(ObjTypedArray *array, int idx,
+                                 double number) {
+  switch (array->kind) {
+    case TYPED_ARRAY_FLOAT64:
+      array->as.float64[idx] = number;
+      break;
+    case TYPED_ARRAY_INT32:
+      array->as.int32[idx] = toInt32(number);
+      break;
+    case TYPED_ARRAY_UINT8:
+      array->as.uint8[idx] = (uint8_t)toInt32(number);
+      break;
+  }
+}
+
+static inline double atomicGet(ObjAtomic *atomic, int idx) {
+  switch (atomic->kind) {
+    case ATOMIC_INT64:
+      return (double)atomic_load(&atomic->as.int64[idx]);
+    case ATOMIC_FLOAT64:
+      return atomic_load(&atomic->as.float64[idx]);
+  }
+
+  return 0;
+}
+
+static inline bool stringsEqual(ObjString *a, ObjString *b) {
+  if (a == b) return true;
+  if (a->interned && b->interned) return false;
+  if (a->length != b->length) return false;
+
+  return memcmp(flattenRope(a)->chars, flattenRope(b)->chars, a->length) == 0;
+}
+
 #endif
\ No newline at end of file
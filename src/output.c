@@ -0,0 +1,235 @@
+#include "output.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#define OUTPUT_BUFFER_INITIAL 256
+// Buffers written by a single writev call in outputFlushAll
+#define OUTPUT_BATCH_MAX 64
+
+// Buffers storage is managed with plain malloc/free instead of reallocate.
+// Output is not part of the program heap and must not trigger the GC.
+//
+// Locks are always taken in this order: buffersMutex, buffer mutex,
+// writeMutex.
+
+static bool stdoutIsTerminal() {
+#if defined(_WIN32) || defined(_WIN64)
+  return _isatty(_fileno(stdout));
+#else
+  return isatty(STDOUT_FILENO);
+#endif
+}
+
+void initOutput(Output* output) {
+  // Interactive sessions see their lines right away, pipes and files are
+  // batched.
+  output->policy = stdoutIsTerminal() ? FLUSH_LINE : FLUSH_SIZE;
+  pthread_mutex_init(&output->buffersMutex, NULL);
+  pthread_mutex_init(&output->writeMutex, NULL);
+  output->buffers = NULL;
+}
+
+void freeOutput(Output* output) {
+  outputFlushAll(output);
+  pthread_mutex_destroy(&output->buffersMutex);
+  pthread_mutex_destroy(&output->writeMutex);
+}
+
+void initOutputBuffer(OutputBuffer* buffer) {
+  pthread_mutex_init(&buffer->mutex, NULL);
+  buffer->length = 0;
+  buffer->capacity = 0;
+  buffer->chars = NULL;
+  buffer->previous = NULL;
+  buffer->next = NULL;
+}
+
+void freeOutputBuffer(OutputBuffer* buffer) {
+  pthread_mutex_destroy(&buffer->mutex);
+  free(buffer->chars);
+  buffer->length = 0;
+  buffer->capacity = 0;
+  buffer->chars = NULL;
+}
+
+void registerOutputBuffer(Output* output, OutputBuffer* buffer) {
+  pthread_mutex_lock(&output->buffersMutex);
+  buffer->previous = NULL;
+  buffer->next = output->buffers;
+  if (output->buffers != NULL) output->buffers->previous = buffer;
+  output->buffers = buffer;
+  pthread_mutex_unlock(&output->buffersMutex);
+}
+
+void unregisterOutputBuffer(Output* output, OutputBuffer* buffer) {
+  outputFlush(output, buffer);
+
+  pthread_mutex_lock(&output->buffersMutex);
+  if (buffer->previous != NULL) {
+    buffer->previous->next = buffer->next;
+  } else if (output->buffers == buffer) {
+    output->buffers = buffer->next;
+  }
+  if (buffer->next != NULL) buffer->next->previous = buffer->previous;
+  buffer->previous = NULL;
+  buffer->next = NULL;
+  pthread_mutex_unlock(&output->buffersMutex);
+}
+
+static void ensureCapacity(OutputBuffer* buffer, int length) {
+  if (buffer->length + length <= buffer->capacity) return;
+
+  int capacity =
+      buffer->capacity < OUTPUT_BUFFER_INITIAL ? OUTPUT_BUFFER_INITIAL
+                                               : buffer->capacity;
+  while (capacity < buffer->length + length) {
+    capacity *= 2;
+  }
+
+  char* chars = realloc(buffer->chars, capacity);
+  if (chars == NULL) exit(1);
+
+  buffer->chars = chars;
+  buffer->capacity = capacity;
+}
+
+void outputWrite(OutputBuffer* buffer, const char* chars, int length) {
+  ensureCapacity(buffer, length);
+  memcpy(buffer->chars + buffer->length, chars, length);
+  buffer->length += length;
+}
+
+void outputWriteFormat(OutputBuffer* buffer, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+
+  // vsnprintf always writes the null terminator
+  ensureCapacity(buffer, length + 1);
+
+  va_start(args, format);
+  vsnprintf(buffer->chars + buffer->length, length + 1, format, args);
+  va_end(args);
+  buffer->length += length;
+}
+
+// Writes every chunk, retrying on partial writes. Output errors (e.g, a
+// closed pipe) are ignored, like the standard library would.
+static void writeChunks(Output* output, struct iovec* chunks, int count) {
+  pthread_mutex_lock(&output->writeMutex);
+
+  while (count > 0) {
+#if defined(_WIN32) || defined(_WIN64)
+    ssize_t written = fwrite(chunks->iov_base, 1, chunks->iov_len, stdout);
+    if (written <= 0) break;
+#else
+    ssize_t written = writev(STDOUT_FILENO, chunks, count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+#endif
+
+    while (count > 0 && (size_t)written >= chunks->iov_len) {
+      written -= chunks->iov_len;
+      chunks++;
+      count--;
+    }
+    if (count > 0) {
+      chunks->iov_base = (char*)chunks->iov_base + written;
+      chunks->iov_len -= written;
+    }
+  }
+
+#if defined(_WIN32) || defined(_WIN64)
+  fflush(stdout);
+#endif
+
+  pthread_mutex_unlock(&output->writeMutex);
+}
+
+// Caller must hold the buffer mutex
+static void flushBuffer(Output* output, OutputBuffer* buffer) {
+  if (buffer->length == 0) return;
+
+  struct iovec chunk = {.iov_base = buffer->chars, .iov_len = buffer->length};
+  writeChunks(output, &chunk, 1);
+  buffer->length = 0;
+}
+
+void beginOutputLine(OutputBuffer* buffer) {
+  pthread_mutex_lock(&buffer->mutex);
+}
+
+void endOutputLine(Output* output, OutputBuffer* buffer) {
+  outputWrite(buffer, "\n", 1);
+
+  switch (output->policy) {
+    case FLUSH_LINE:
+      flushBuffer(output, buffer);
+      break;
+    case FLUSH_SIZE:
+      if (buffer->length >= OUTPUT_FLUSH_SIZE) flushBuffer(output, buffer);
+      break;
+    case FLUSH_EXPLICIT:
+      if (buffer->length >= OUTPUT_BUFFER_MAX) flushBuffer(output, buffer);
+      break;
+  }
+
+  pthread_mutex_unlock(&buffer->mutex);
+}
+
+void outputFlush(Output* output, OutputBuffer* buffer) {
+  pthread_mutex_lock(&buffer->mutex);
+  flushBuffer(output, buffer);
+  pthread_mutex_unlock(&buffer->mutex);
+}
+
+void outputFlushAll(Output* output) {
+  pthread_mutex_lock(&output->buffersMutex);
+
+  OutputBuffer* buffer = output->buffers;
+  while (buffer != NULL) {
+    struct iovec chunks[OUTPUT_BATCH_MAX];
+    OutputBuffer* locked[OUTPUT_BATCH_MAX];
+    int count = 0;
+    int lockedCount = 0;
+
+    for (; buffer != NULL && lockedCount < OUTPUT_BATCH_MAX;
+         buffer = buffer->next) {
+      pthread_mutex_lock(&buffer->mutex);
+      locked[lockedCount++] = buffer;
+      if (buffer->length > 0) {
+        chunks[count].iov_base = buffer->chars;
+        chunks[count].iov_len = buffer->length;
+        count++;
+      }
+    }
+
+    writeChunks(output, chunks, count);
+
+    for (int idx = 0; idx < lockedCount; idx++) {
+      locked[idx]->length = 0;
+      pthread_mutex_unlock(&locked[idx]->mutex);
+    }
+  }
+
+  pthread_mutex_unlock(&output->buffersMutex);
+}
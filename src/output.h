@@ -0,0 +1,63 @@
+#ifndef output_h
+#define output_h
+
+#include <pthread.h>
+
+#include "common.h"
+
+// Pending output above this size is written out under FLUSH_SIZE
+#define OUTPUT_FLUSH_SIZE (64 * 1024)
+// Pending output is always written out above this size, even under
+// FLUSH_EXPLICIT, so that long running scripts don't hold unbounded memory
+#define OUTPUT_BUFFER_MAX (1024 * 1024)
+
+typedef enum {
+  // Every line is written as soon as it is complete
+  FLUSH_LINE,
+  // Lines are batched up to OUTPUT_FLUSH_SIZE
+  FLUSH_SIZE,
+  // Lines are written on System.flush(), at thread end and before errors
+  FLUSH_EXPLICIT
+} FlushPolicy;
+
+// Every program thread formats its lines in its own buffer, so logging
+// threads don't compete for a lock. Buffers only ever hold complete lines
+// when written out, lines from different threads are never interleaved.
+typedef struct OutputBuffer {
+  // Only contended when another thread flushes every buffer
+  pthread_mutex_t mutex;
+  int length;
+  int capacity;
+  char* chars;
+  // Neighbours in the buffers list, unregistered in constant time
+  struct OutputBuffer* previous;
+  struct OutputBuffer* next;
+} OutputBuffer;
+
+typedef struct {
+  FlushPolicy policy;
+  // Guards the buffers list
+  pthread_mutex_t buffersMutex;
+  // Serializes the writes to the standard output
+  pthread_mutex_t writeMutex;
+  OutputBuffer* buffers;
+} Output;
+
+void initOutput(Output* output);
+void freeOutput(Output* output);
+void initOutputBuffer(OutputBuffer* buffer);
+void freeOutputBuffer(OutputBuffer* buffer);
+void registerOutputBuffer(Output* output, OutputBuffer* buffer);
+void unregisterOutputBuffer(Output* output, OutputBuffer* buffer);
+
+void outputWrite(OutputBuffer* buffer, const char* chars, int length);
+void outputWriteFormat(OutputBuffer* buffer, const char* format, ...);
+// A line is written between beginOutputLine and endOutputLine, which applies
+// the flush policy.
+void beginOutputLine(OutputBuffer* buffer);
+void endOutputLine(Output* output, OutputBuffer* buffer);
+void outputFlush(Output* output, OutputBuffer* buffer);
+// Writes every registered buffer in a single batch
+void outputFlushAll(Output* output);
+
+#endif
@@ -0,0 +1,130 @@
+#include "simpl.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "core.h"
+#include "isolate.h"
+#include "object.h"
+#include "utils.h"
+#include "value.h"
+#include "vm.h"
+
+_Static_assert(sizeof(SimplValue) == sizeof(Value),
+               "SimplValue must match the NaN boxed Value");
+
+SimplVM* simplNewVM() { return newVM(); }
+
+void simplFreeVM(SimplVM* machine) { freeVM(machine); }
+
+bool simplDefineFunction(SimplVM* machine, const char* name,
+                         SimplNativeFn function, int arity) {
+  if (arity < 0 || arity >= ARGS_ARITY_MAX) {
+    return false;
+  }
+
+  currentVM = machine;
+  defineHostFunction(machine, name, function, (Arity)arity);
+  return true;
+}
+
+bool simplDefineModuleFunction(SimplVM* machine, const char* module,
+                               const char* name, SimplNativeFn function,
+                               int arity) {
+  if (arity < 0 || arity >= ARGS_ARITY_MAX) {
+    return false;
+  }
+
+  currentVM = machine;
+  defineHostModuleFunction(machine, module, name, function, (Arity)arity);
+  return true;
+}
+
+void simplSetIsolateExecutable(SimplVM* machine, const char* path) {
+  setIsolateExecutable(machine, path);
+}
+
+SimplResult simplLoad(SimplVM* machine, const char* source, const char* path,
+                      SimplScript** script) {
+  currentVM = machine;
+
+  char* absPath = path != NULL ? getFileAbsPath(path) : NULL;
+  InterpretResult result;
+  *script = loadScript(source, absPath, &result);
+  free(absPath);
+
+  return (SimplResult)result;
+}
+
+void simplUnload(SimplVM* machine, SimplScript* script) {
+  currentVM = machine;
+  unloadScript(script);
+}
+
+bool simplGetGlobal(SimplVM* machine, SimplScript* script, const char* name,
+                    SimplValue* value) {
+  currentVM = machine;
+  return tableGet(&script->namespace, copyString(name, strlen(name)), value);
+}
+
+SimplResult simplCall(SimplVM* machine, SimplScript* script,
+                      SimplValue function, int argCount,
+                      const SimplValue* args, SimplValue* result) {
+  currentVM = machine;
+
+  Value value;
+  InterpretResult status = callScript(script, function, argCount, args, &value);
+  if (result != NULL) {
+    *result = status == INTERPRET_OK ? value : NIL_VAL;
+  }
+
+  return (SimplResult)status;
+}
+
+const char* simplError(SimplVM* machine) { return machine->hostError; }
+
+SimplValue simplNil() { return NIL_VAL; }
+
+SimplValue simplBool(bool boolean) { return BOOL_VAL(boolean); }
+
+SimplValue simplNumber(double number) { return NUMBER_VAL(number); }
+
+SimplValue simplString(SimplVM* machine, const char* chars, int length) {
+  currentVM = machine;
+  return OBJ_VAL(copyString(chars, length));
+}
+
+bool simplIsNil(SimplValue value) { return IS_NIL(value); }
+
+bool simplIsBool(SimplValue value) { return IS_BOOL(value); }
+
+bool simplIsNumber(SimplValue value) { return IS_NUMBER(value); }
+
+bool simplIsString(SimplValue value) { return IS_STRING(value); }
+
+bool simplAsBool(SimplValue value) { return AS_BOOL(value); }
+
+double simplAsNumber(SimplValue value) { return AS_NUMBER(value); }
+
+const char* simplAsString(SimplVM* machine, SimplValue value, int* length) {
+  currentVM = machine;
+  // Slices don't end with a null character, they get their own buffer
+  ObjString* string = flattenString(AS_STRING(value));
+
+  if (length != NULL) {
+    *length = string->length;
+  }
+
+  return string->chars;
+}
+
+bool simplReturn(void* thread, SimplValue value) {
+  push(thread, value);
+  return true;
+}
+
+bool simplThrow(void* thread, const char* message) {
+  push(thread, OBJ_VAL(copyString(message, strlen(message))));
+  return false;
+}
@@ -0,0 +1,93 @@
+#ifndef simpl_h
+#define simpl_h
+
+// Embedding API. A host creates a VM, loads scripts once and calls their
+// functions as many times as needed, without recompiling them.
+//
+//   SimplVM* machine = simplNewVM();
+//   SimplScript* script;
+//   simplLoad(machine, "fun add(a, b) { return a + b; }", NULL, &script);
+//
+//   SimplValue add, args[2] = {simplNumber(1), simplNumber(2)}, result;
+//   simplGetGlobal(machine, script, "add", &add);
+//   if (simplCall(machine, script, add, 2, args, &result) == SIMPL_OK) {
+//     printf("%g\n", simplAsNumber(result));
+//   }
+//
+//   simplFreeVM(machine);
+//
+// A VM runs one host call at a time, on the host thread calling it. Values
+// returned to the host stay valid until the next call into the same VM,
+// unless they are reachable from a loaded script variable.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct VM SimplVM;
+typedef struct Script SimplScript;
+
+// NaN boxed value, see value.h
+typedef uint64_t SimplValue;
+
+// Native function. args[0] is the receiver (nil for global functions) and
+// args[1..argCount] are the arguments. Returns with simplReturn or
+// simplThrow.
+typedef bool (*SimplNativeFn)(void* thread, int argCount, SimplValue* args);
+
+typedef enum {
+  SIMPL_OK,
+  SIMPL_COMPILE_ERROR,
+  SIMPL_RUNTIME_ERROR,
+} SimplResult;
+
+SimplVM* simplNewVM();
+// Threads started by scripts must be done
+void simplFreeVM(SimplVM* machine);
+
+// Natives must be defined before loading the scripts using them. A name may
+// be overloaded with a function per arity, up to 15 arguments.
+bool simplDefineFunction(SimplVM* machine, const char* name,
+                         SimplNativeFn function, int arity);
+// Scripts use host modules as native ones: import Name from "module";
+bool simplDefineModuleFunction(SimplVM* machine, const char* module,
+                               const char* name, SimplNativeFn function,
+                               int arity);
+
+// Isolate.spawn runs path, a simpl interpreter executable, as the isolate.
+// Isolates fail with ENOSYS until it is set, they never run the host.
+void simplSetIsolateExecutable(SimplVM* machine, const char* path);
+
+// Compiles source and runs it once. path resolves the script imports and may
+// be NULL.
+SimplResult simplLoad(SimplVM* machine, const char* source, const char* path,
+                      SimplScript** script);
+void simplUnload(SimplVM* machine, SimplScript* script);
+// Reads a script variable, resolve functions once and call them many times
+bool simplGetGlobal(SimplVM* machine, SimplScript* script, const char* name,
+                    SimplValue* value);
+SimplResult simplCall(SimplVM* machine, SimplScript* script,
+                      SimplValue function, int argCount,
+                      const SimplValue* args, SimplValue* result);
+// Describes the last failed load or call, uncaught errors come with their
+// stack trace
+const char* simplError(SimplVM* machine);
+
+SimplValue simplNil();
+SimplValue simplBool(bool boolean);
+SimplValue simplNumber(double number);
+SimplValue simplString(SimplVM* machine, const char* chars, int length);
+
+bool simplIsNil(SimplValue value);
+bool simplIsBool(SimplValue value);
+bool simplIsNumber(SimplValue value);
+bool simplIsString(SimplValue value);
+bool simplAsBool(SimplValue value);
+double simplAsNumber(SimplValue value);
+// Null terminated and not copied, length may be NULL
+const char* simplAsString(SimplVM* machine, SimplValue value, int* length);
+
+// Return from native functions
+bool simplReturn(void* thread, SimplValue value);
+bool simplThrow(void* thread, const char* message);
+
+#endif
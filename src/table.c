@@ -42,8 +42,11 @@ static Entry* findEntry(Entry* entries, int capacity, ObjString* key) {
   }
 }
 
+// Tables are keyed by interned strings. A transient key without interned
+// counterpart can't be in any table.
 bool tableGet(Table* table, ObjString* key, Value* value) {
   if (table->count == 0) return false;
+  if (!key->interned && (key = findInternedString(key)) == NULL) return false;
 
   Entry* entry = findEntry(table->entries, table->capacity, key);
 
@@ -81,23 +84,36 @@ static void adjustCapacity(Table* table, int capacity) {
 }
 
 bool tableSet(Table* table, ObjString* key, Value value) {
+  if (!key->interned) key = internString(key);
+
+  // Existing keys are updated in place, never growing the table. Frames and
+  // hosted calls hold copies of a namespace, which must keep sharing its
+  // entries when a global is assigned.
+  Entry* entry = NULL;
+  if (table->entries != NULL) {
+    entry = findEntry(table->entries, table->capacity, key);
+    if (entry->key != NULL) {
+      entry->value = value;
+      return false;
+    }
+  }
+
   if (table->count + 1 > (table->capacity + 1) * TABLE_MAX_LOAD) {
     adjustCapacity(table, GROW_CAPACITY(table->capacity + 1) - 1);
+    entry = findEntry(table->entries, table->capacity, key);
   }
 
-  Entry* entry = findEntry(table->entries, table->capacity, key);
-  bool isNewKey = entry->key == NULL;
-
-  // is a new key and entry is not a tombstone => table->count++
-  if (isNewKey && IS_NIL(entry->value)) table->count++;
+  // Not a tombstone => table->count++
+  if (IS_NIL(entry->value)) table->count++;
 
   entry->key = key;
   entry->value = value;
-  return isNewKey;
+  return true;
 }
 
 bool tableDelete(Table* table, ObjString* key) {
   if (table->count == 0) return false;
+  if (!key->interned && (key = findInternedString(key)) == NULL) return false;
 
   Entry* entry = findEntry(table->entries, table->capacity, key);
 
@@ -160,28 +176,6 @@ void tableAddAllInherintance(Table* from, Table* to) {
   }
 }
 
-ObjString* tableFindString(Table* table, const char* chars, int length,
-                           uint32_t hash) {
-  if (table->count == 0) return NULL;
-
-  uint32_t idx = hash & table->capacity;
-
-  for (;;) {
-    Entry* entry = &table->entries[idx];
-
-    if (entry->key == NULL) {
-      if (IS_NIL(entry->value)) {
-        return NULL;
-      }
-    } else if (entry->key->length == length && entry->key->hash == hash &&
-               memcmp(entry->key->chars, chars, length) == 0) {
-      return entry->key;
-    }
-
-    idx = (idx + 1) & table->capacity;
-  }
-}
-
 void markTable(Table* table) {
   for (int idx = 0; idx <= table->capacity; idx++) {
     Entry* entry = &table->entries[idx];
@@ -189,12 +183,3 @@ void markTable(Table* table) {
     markValue(entry->value);
   }
 }
-
-void tableRemoveNotReferenced(Table* table) {
-  for (int idx = 0; idx <= table->capacity; idx++) {
-    Entry* entry = &table->entries[idx];
-    if (entry->key != NULL && !entry->key->obj.isMarked) {
-      tableDelete(table, entry->key);
-    }
-  }
-}
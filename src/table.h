@@ -21,9 +21,6 @@ bool tableSet(Table* table, ObjString* key, Value value);
 bool tableDelete(Table* table, ObjString* key);
 void tableAddAll(Table* from, Table* to);
 void tableAddAllInherintance(Table* from, Table* to);
-ObjString* tableFindString(Table* table, const char* chars, int length,
-                           uint32_t hash);
 void markTable(Table* table);
-void tableRemoveNotReferenced(Table* table);
 
 #endif
\ No newline at end of file
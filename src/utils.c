@@ -194,6 +194,71 @@ char *resolvePath(const char *entryFilePath, const char *filePath,
 #endif
 }
 
+#ifdef WORD_STRINGS
+
+// Bytes repeated along a word
+#define WORD_REPEAT(byte) (0x0101010101010101ull * (uint8_t)(byte))
+
+static inline uint64_t readWord(const char *chars)
+{
+  uint64_t word;
+  memcpy(&word, chars, sizeof(word));
+  return word;
+}
+
+// Reads the last (< 8) bytes without crossing the string end
+static inline uint64_t readPartialWord(const char *chars, int length)
+{
+  uint64_t word = 0;
+  memcpy(&word, chars, length);
+  return word;
+}
+
+// 64x64 -> 128 bits multiplication folded back to 64 bits, it is the mixing
+// step of wyhash-like hashes.
+static inline uint64_t hashMix(uint64_t a, uint64_t b)
+{
+  __uint128_t product = (__uint128_t)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+uint32_t hashString(const char *key, int length)
+{
+  const uint64_t secret0 = 0xa0761d6478bd642full;
+  const uint64_t secret1 = 0xe7037ed1a0b428dbull;
+  const uint64_t secret2 = 0x8ebc6af09c88c6e3ull;
+
+  uint64_t seed = secret0 ^ (uint64_t)length;
+  int remaining = length;
+
+  // Consume 16 bytes per round
+  while (remaining > 16)
+  {
+    seed = hashMix(readWord(key) ^ secret1, readWord(key + 8) ^ seed);
+    key += 16;
+    remaining -= 16;
+  }
+
+  uint64_t a = 0;
+  uint64_t b = 0;
+
+  if (remaining > 8)
+  {
+    a = readWord(key);
+    b = readPartialWord(key + 8, remaining - 8);
+  }
+  else if (remaining > 0)
+  {
+    a = readPartialWord(key, remaining);
+  }
+
+  uint64_t hash = hashMix(secret2 ^ (uint64_t)length,
+                          hashMix(a ^ secret1, b ^ seed));
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+#else
+
 uint32_t hashString(const char *key, int length)
 {
   uint32_t hash = 2166136261u;
@@ -203,4 +268,158 @@ uint32_t hashString(const char *key, int length)
     hash *= 16777619;
   }
   return hash;
-}
\ No newline at end of file
+}
+
+#endif
+
+// Returns the index of the first occurrence of search in string at or after
+// start, or -1. memchr (vectorized by the C library) skips to the candidates.
+int findSubstring(const char *string, int length, const char *search,
+                  int searchLength, int start)
+{
+  if (searchLength == 0)
+    return start <= length ? start : -1;
+
+  const char *end = string + length - searchLength + 1;
+  const char *cursor = string + start;
+
+  while (cursor < end)
+  {
+    cursor = memchr(cursor, search[0], end - cursor);
+
+    if (cursor == NULL)
+      return -1;
+
+    if (memcmp(cursor + 1, search + 1, searchLength - 1) == 0)
+      return cursor - string;
+
+    cursor++;
+  }
+
+  return -1;
+}
+
+// Returns the index of the first non space char
+int skipLeadingSpaces(const char *string, int length)
+{
+  int idx = 0;
+
+#ifdef WORD_STRINGS
+  while (idx + 8 <= length && readWord(string + idx) == WORD_REPEAT(' '))
+    idx += 8;
+#endif
+
+  while (idx < length && string[idx] == ' ')
+    idx++;
+
+  return idx;
+}
+
+// Returns the length without trailing spaces
+int skipTrailingSpaces(const char *string, int length)
+{
+  int idx = length;
+
+#ifdef WORD_STRINGS
+  while (idx >= 8 && readWord(string + idx - 8) == WORD_REPEAT(' '))
+    idx -= 8;
+#endif
+
+  while (idx > 0 && string[idx - 1] == ' ')
+    idx--;
+
+  return idx;
+}
+
+#ifdef WORD_STRINGS
+
+// Flips the case bit (0x20) of the ASCII bytes within [first, last] of each
+// word byte, non ASCII bytes are left untouched.
+static inline uint64_t flipCaseRange(uint64_t word, char first, char last)
+{
+  uint64_t heptets = word & WORD_REPEAT(0x7f);
+  uint64_t aboveLast = heptets + WORD_REPEAT(0x7f - last);
+  uint64_t fromFirst = heptets + WORD_REPEAT(0x80 - first);
+  uint64_t inRange = ~word & (fromFirst ^ aboveLast) & WORD_REPEAT(0x80);
+
+  return word ^ (inRange >> 2);
+}
+
+#endif
+
+static void copyFlippedCase(char *dest, const char *src, int length,
+                            char first, char last)
+{
+  int idx = 0;
+
+#ifdef WORD_STRINGS
+  for (; idx + 8 <= length; idx += 8)
+  {
+    uint64_t word = flipCaseRange(readWord(src + idx), first, last);
+    memcpy(dest + idx, &word, sizeof(word));
+  }
+#endif
+
+  for (; idx < length; idx++)
+  {
+    char c = src[idx];
+    dest[idx] = c >= first && c <= last ? c ^ 0x20 : c;
+  }
+}
+
+void copyUpperCase(char *dest, const char *src, int length)
+{
+  copyFlippedCase(dest, src, length, 'a', 'z');
+}
+
+void copyLowerCase(char *dest, const char *src, int length)
+{
+  copyFlippedCase(dest, src, length, 'A', 'Z');
+}
+
+static const char digitPairs[] = "00010203040506070809"
+                                 "10111213141516171819"
+                                 "20212223242526272829"
+                                 "30313233343536373839"
+                                 "40414243444546474849"
+                                 "50515253545556575859"
+                                 "60616263646566676869"
+                                 "70717273747576777879"
+                                 "80818283848586878889"
+                                 "90919293949596979899";
+
+// Writes the decimal digits of 'integer' (without a null terminator) two at a
+// time, from the end backwards, and returns how many chars were written.
+int formatInteger(char *buffer, int64_t integer)
+{
+  char digits[20];
+  char *cursor = digits + sizeof(digits);
+  uint64_t magnitude = integer < 0 ? -(uint64_t)integer : (uint64_t)integer;
+
+  while (magnitude >= 100)
+  {
+    int pair = (int)(magnitude % 100) * 2;
+    magnitude /= 100;
+    *--cursor = digitPairs[pair + 1];
+    *--cursor = digitPairs[pair];
+  }
+  if (magnitude >= 10)
+  {
+    int pair = (int)magnitude * 2;
+    *--cursor = digitPairs[pair + 1];
+    *--cursor = digitPairs[pair];
+  }
+  else
+  {
+    *--cursor = '0' + (char)magnitude;
+  }
+
+  int length = 0;
+  if (integer < 0)
+  {
+    buffer[length++] = '-';
+  }
+  int digitsLength = (int)(digits + sizeof(digits) - cursor);
+  memcpy(buffer + length, cursor, digitsLength);
+  return length + digitsLength;
+}
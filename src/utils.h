@@ -5,8 +5,16 @@
 
 char *readFile(const char *path);
 char *getFileAbsPath(const char *relativePath);
+char *removeLastPathFragment(const char *path);
 char *resolvePath(const char *entryFilePath, const char *filePath,
                   const char *relativePath);
 uint32_t hashString(const char *key, int length);
+int findSubstring(const char *string, int length, const char *search,
+                  int searchLength, int start);
+int skipLeadingSpaces(const char *string, int length);
+int skipTrailingSpaces(const char *string, int length);
+void copyUpperCase(char *dest, const char *src, int length);
+void copyLowerCase(char *dest, const char *src, int length);
+int formatInteger(char *buffer, int64_t integer);
 
 #endif
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include "value.h"
 
+#include <math.h>
 #include <stdio.h>
 
 #include "memory.h"
+#include "utils.h"
 
 void initValueArray(ValueArray* array) {
   array->capacity = 0;
@@ -28,7 +30,10 @@ void freeValueArray(ValueArray* array) {
 
 bool valuesEqual(Value a, Value b) {
 #ifdef NAN_BOXING
-  return a == b;
+  if (a == b) return true;
+
+  // Transient strings are compared by content
+  return IS_STRING(a) && IS_STRING(b) && stringsEqual(AS_STRING(a), AS_STRING(b));
 #else
   if (a.type != b.type) return false;
 
@@ -40,6 +45,9 @@ bool valuesEqual(Value a, Value b) {
     case VAL_NUMBER:
       return AS_NUMBER(a) == AS_NUMBER(b);
     case VAL_OBJ:
+      if (IS_STRING(a) && IS_STRING(b)) {
+        return stringsEqual(AS_STRING(a), AS_STRING(b));
+      }
       return AS_OBJ(a) == AS_OBJ(b);
     default:
       return false;
@@ -47,31 +55,65 @@ bool valuesEqual(Value a, Value b) {
 #endif
 }
 
-void printValue(Value value) {
+static const double integralLimits[] = {1e0, 1e1, 1e2,  1e3,  1e4,  1e5,  1e6,
+                                        1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+                                        1e14, 1e15};
+
+int formatNumber(char* buffer, double value, int precision) {
+  double limit = integralLimits[precision];
+
+  // Integral numbers that %g would print without an exponent skip printf
+  if (value > -limit && value < limit && value == (int64_t)value &&
+      !(value == 0 && signbit(value))) {
+    return formatInteger(buffer, (int64_t)value);
+  }
+
+  return sprintf(buffer, "%.*g", precision, value);
+}
+
+static void writeNumber(OutputBuffer* output, double number) {
+  char buffer[NUMBER_BUFFER_LENGTH];
+  outputWrite(output, buffer, formatNumber(buffer, number, 6));
+}
+
+void writeValue(OutputBuffer* output, Value value) {
 #ifdef NAN_BOXING
   if (IS_BOOL(value)) {
-    printf(AS_BOOL(value) ? "true" : "false");
+    AS_BOOL(value) ? outputWrite(output, "true", 4)
+                   : outputWrite(output, "false", 5);
   } else if (IS_NIL(value)) {
-    printf("nil");
+    outputWrite(output, "nil", 3);
   } else if (IS_NUMBER(value)) {
-    printf("%g", AS_NUMBER(value));
+    writeNumber(output, AS_NUMBER(value));
   } else if (IS_OBJ(value)) {
-    printObject(value);
+    writeObject(output, value);
   }
 #else
   switch (value.type) {
     case VAL_BOOL:
-      printf(AS_BOOL(value) == true ? "true" : "false");
+      AS_BOOL(value) == true ? outputWrite(output, "true", 4)
+                             : outputWrite(output, "false", 5);
       break;
     case VAL_NIL:
-      printf("nil");
+      outputWrite(output, "nil", 3);
       break;
     case VAL_NUMBER:
-      printf("%g", AS_NUMBER(value));
+      writeNumber(output, AS_NUMBER(value));
       break;
     case VAL_OBJ:
-      printObject(value);
+      writeObject(output, value);
       break;
   }
 #endif
+}
+
+// Unbuffered print through stdio, used by debugging routines
+void printValue(Value value) {
+  OutputBuffer output;
+  initOutputBuffer(&output);
+
+  writeValue(&output, value);
+  fwrite(output.chars, 1, output.length, stdout);
+
+  freeOutputBuffer(&output);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "common.h"
+#include "output.h"
 
 typedef enum { VAL_BOOL, VAL_NUMBER, VAL_NIL, VAL_OBJ } ValueType;
 
@@ -87,6 +88,11 @@ bool valuesEqual(Value a, Value b);
 void initValueArray(ValueArray* array);
 void writeValueArray(ValueArray* array, Value value);
 void freeValueArray(ValueArray* array);
+// Fits any number formatted with up to 15 digits of precision
+#define NUMBER_BUFFER_LENGTH 32
+
+int formatNumber(char* buffer, double value, int precision);
+void writeValue(OutputBuffer* output, Value value);
 void printValue(Value value);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,685 @@
+#include "vector.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define VECTOR_X86
+// SSE2 is part of x86-64, AVX2 kernels are only selected after checking CPUID
+#define AVX2_KERNEL __attribute__((target("avx2")))
+#endif
+
+// Reductions keep 8 partial results, whatever the registers width. Lanes are
+// combined in a fixed order, so that scalar, SSE2 and AVX2 kernels round
+// exactly the same way.
+#define VECTOR_LANES 8
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+typedef struct {
+  double (*sum)(const double* values, int count);
+  double (*dot)(const double* a, const double* b, int count);
+  double (*min)(const double* values, int count);
+  double (*max)(const double* values, int count);
+  void (*arithmetic)(double* out, const double* a, const double* b,
+                     bool broadcast, int count, VectorOperation operation);
+  void (*compare)(uint8_t* mask, const double* a, const double* b,
+                  bool broadcast, int count, VectorComparison comparison);
+} VectorKernels;
+
+static double combineSum(const double* lanes) {
+  return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+         ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+static double combineMin(const double* lanes) {
+  return MIN(MIN(MIN(lanes[1], lanes[0]), MIN(lanes[3], lanes[2])),
+             MIN(MIN(lanes[5], lanes[4]), MIN(lanes[7], lanes[6])));
+}
+
+static double combineMax(const double* lanes) {
+  return MAX(MAX(MAX(lanes[1], lanes[0]), MAX(lanes[3], lanes[2])),
+             MAX(MAX(lanes[5], lanes[4]), MAX(lanes[7], lanes[6])));
+}
+
+// -------------------------------- Scalar kernels --------------------------------
+
+static double scalarSum(const double* values, int count) {
+  double lanes[VECTOR_LANES] = {0};
+  int idx = 0;
+
+  for (; idx + VECTOR_LANES <= count; idx += VECTOR_LANES) {
+    for (int lane = 0; lane < VECTOR_LANES; lane++) {
+      lanes[lane] += values[idx + lane];
+    }
+  }
+
+  double sum = combineSum(lanes);
+  for (; idx < count; idx++) {
+    sum += values[idx];
+  }
+
+  return sum;
+}
+
+static double scalarDot(const double* a, const double* b, int count) {
+  double lanes[VECTOR_LANES] = {0};
+  int idx = 0;
+
+  for (; idx + VECTOR_LANES <= count; idx += VECTOR_LANES) {
+    for (int lane = 0; lane < VECTOR_LANES; lane++) {
+      lanes[lane] += a[idx + lane] * b[idx + lane];
+    }
+  }
+
+  double sum = combineSum(lanes);
+  for (; idx < count; idx++) {
+    sum += a[idx] * b[idx];
+  }
+
+  return sum;
+}
+
+static double scalarMin(const double* values, int count) {
+  double min = values[0];
+  int idx = 1;
+
+  if (count >= VECTOR_LANES) {
+    double lanes[VECTOR_LANES];
+    memcpy(lanes, values, sizeof(lanes));
+
+    for (idx = VECTOR_LANES; idx + VECTOR_LANES <= count;
+         idx += VECTOR_LANES) {
+      for (int lane = 0; lane < VECTOR_LANES; lane++) {
+        lanes[lane] = MIN(values[idx + lane], lanes[lane]);
+      }
+    }
+    min = combineMin(lanes);
+  }
+
+  for (; idx < count; idx++) {
+    min = MIN(values[idx], min);
+  }
+
+  for (idx = 0; idx < count; idx++) {
+    if (isnan(values[idx])) return NAN;
+  }
+
+  return min;
+}
+
+static double scalarMax(const double* values, int count) {
+  double max = values[0];
+  int idx = 1;
+
+  if (count >= VECTOR_LANES) {
+    double lanes[VECTOR_LANES];
+    memcpy(lanes, values, sizeof(lanes));
+
+    for (idx = VECTOR_LANES; idx + VECTOR_LANES <= count;
+         idx += VECTOR_LANES) {
+      for (int lane = 0; lane < VECTOR_LANES; lane++) {
+        lanes[lane] = MAX(values[idx + lane], lanes[lane]);
+      }
+    }
+    max = combineMax(lanes);
+  }
+
+  for (; idx < count; idx++) {
+    max = MAX(values[idx], max);
+  }
+
+  for (idx = 0; idx < count; idx++) {
+    if (isnan(values[idx])) return NAN;
+  }
+
+  return max;
+}
+
+static void scalarArithmetic(double* out, const double* a, const double* b,
+                             bool broadcast, int count,
+                             VectorOperation operation) {
+  for (int idx = 0; idx < count; idx++) {
+    double other = broadcast ? b[0] : b[idx];
+    out[idx] = operation == VECTOR_ADD ? a[idx] + other : a[idx] * other;
+  }
+}
+
+static void scalarCompare(uint8_t* mask, const double* a, const double* b,
+                          bool broadcast, int count,
+                          VectorComparison comparison) {
+  for (int idx = 0; idx < count; idx++) {
+    double other = broadcast ? b[0] : b[idx];
+
+    switch (comparison) {
+      case VECTOR_LESS:
+        mask[idx] = a[idx] < other;
+        break;
+      case VECTOR_LESS_EQUAL:
+        mask[idx] = a[idx] <= other;
+        break;
+      case VECTOR_GREATER:
+        mask[idx] = a[idx] > other;
+        break;
+      case VECTOR_GREATER_EQUAL:
+        mask[idx] = a[idx] >= other;
+        break;
+      case VECTOR_EQUAL:
+        mask[idx] = a[idx] == other;
+        break;
+    }
+  }
+}
+
+#ifdef VECTOR_X86
+
+// -------------------------------- SSE2 kernels --------------------------------
+
+static double sse2Sum(const double* values, int count) {
+  __m128d sums[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(),
+                     _mm_setzero_pd()};
+  int idx = 0;
+
+  for (; idx + VECTOR_LANES <= count; idx += VECTOR_LANES) {
+    for (int reg = 0; reg < 4; reg++) {
+      sums[reg] =
+          _mm_add_pd(sums[reg], _mm_loadu_pd(values + idx + reg * 2));
+    }
+  }
+
+  double lanes[VECTOR_LANES];
+  for (int reg = 0; reg < 4; reg++) {
+    _mm_storeu_pd(lanes + reg * 2, sums[reg]);
+  }
+
+  double sum = combineSum(lanes);
+  for (; idx < count; idx++) {
+    sum += values[idx];
+  }
+
+  return sum;
+}
+
+static double sse2Dot(const double* a, const double* b, int count) {
+  __m128d sums[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(),
+                     _mm_setzero_pd()};
+  int idx = 0;
+
+  for (; idx + VECTOR_LANES <= count; idx += VECTOR_LANES) {
+    for (int reg = 0; reg < 4; reg++) {
+      __m128d product = _mm_mul_pd(_mm_loadu_pd(a + idx + reg * 2),
+                                   _mm_loadu_pd(b + idx + reg * 2));
+      sums[reg] = _mm_add_pd(sums[reg], product);
+    }
+  }
+
+  double lanes[VECTOR_LANES];
+  for (int reg = 0; reg < 4; reg++) {
+    _mm_storeu_pd(lanes + reg * 2, sums[reg]);
+  }
+
+  double sum = combineSum(lanes);
+  for (; idx < count; idx++) {
+    sum += a[idx] * b[idx];
+  }
+
+  return sum;
+}
+
+// min and max share the lanes layout with the scalar kernels, NaN elements
+// are tracked apart since minpd and maxpd don't propagate them.
+static double sse2MinMax(const double* values, int count, bool min) {
+  if (count < VECTOR_LANES) {
+    return min ? scalarMin(values, count) : scalarMax(values, count);
+  }
+
+  __m128d acc[4];
+  __m128d nan = _mm_setzero_pd();
+  for (int reg = 0; reg < 4; reg++) {
+    acc[reg] = _mm_loadu_pd(values + reg * 2);
+    nan = _mm_or_pd(nan, _mm_cmpunord_pd(acc[reg], acc[reg]));
+  }
+
+  int idx = VECTOR_LANES;
+  for (; idx + VECTOR_LANES <= count; idx += VECTOR_LANES) {
+    for (int reg = 0; reg < 4; reg++) {
+      __m128d next = _mm_loadu_pd(values + idx + reg * 2);
+      nan = _mm_or_pd(nan, _mm_cmpunord_pd(next, next));
+      acc[reg] = min ? _mm_min_pd(next, acc[reg]) : _mm_max_pd(next, acc[reg]);
+    }
+  }
+
+  if (_mm_movemask_pd(nan) != 0) return NAN;
+
+  double lanes[VECTOR_LANES];
+  for (int reg = 0; reg < 4; reg++) {
+    _mm_storeu_pd(lanes + reg * 2, acc[reg]);
+  }
+
+  double result = min ? combineMin(lanes) : combineMax(lanes);
+  for (; idx < count; idx++) {
+    if (isnan(values[idx])) return NAN;
+    result = min ? MIN(values[idx], result) : MAX(values[idx], result);
+  }
+
+  return result;
+}
+
+static double sse2Min(const double* values, int count) {
+  return sse2MinMax(values, count, true);
+}
+
+static double sse2Max(const double* values, int count) {
+  return sse2MinMax(values, count, false);
+}
+
+static void sse2Arithmetic(double* out, const double* a, const double* b,
+                           bool broadcast, int count,
+                           VectorOperation operation) {
+  __m128d other = _mm_set1_pd(b[0]);
+  int idx = 0;
+
+  for (; idx + 2 <= count; idx += 2) {
+    if (!broadcast) other = _mm_loadu_pd(b + idx);
+
+    __m128d value = _mm_loadu_pd(a + idx);
+    _mm_storeu_pd(out + idx, operation == VECTOR_ADD
+                                 ? _mm_add_pd(value, other)
+                                 : _mm_mul_pd(value, other));
+  }
+
+  scalarArithmetic(out + idx, a + idx, broadcast ? b : b + idx, broadcast,
+                   count - idx, operation);
+}
+
+static inline __m128d sse2Comparison(__m128d a, __m128d b,
+                                     VectorComparison comparison) {
+  switch (comparison) {
+    case VECTOR_LESS:
+      return _mm_cmplt_pd(a, b);
+    case VECTOR_LESS_EQUAL:
+      return _mm_cmple_pd(a, b);
+    case VECTOR_GREATER:
+      return _mm_cmpgt_pd(a, b);
+    case VECTOR_GREATER_EQUAL:
+      return _mm_cmpge_pd(a, b);
+    default:
+      return _mm_cmpeq_pd(a, b);
+  }
+}
+
+static void sse2Compare(uint8_t* mask, const double* a, const double* b,
+                        bool broadcast, int count,
+                        VectorComparison comparison) {
+  __m128d other = _mm_set1_pd(b[0]);
+  int idx = 0;
+
+  for (; idx + 2 <= count; idx += 2) {
+    if (!broadcast) other = _mm_loadu_pd(b + idx);
+
+    int bits =
+        _mm_movemask_pd(sse2Comparison(_mm_loadu_pd(a + idx), other, comparison));
+    mask[idx] = bits & 1;
+    mask[idx + 1] = (bits >> 1) & 1;
+  }
+
+  scalarCompare(mask + idx, a + idx, broadcast ? b : b + idx, broadcast,
+                count - idx, comparison);
+}
+
+// -------------------------------- AVX2 kernels --------------------------------
+
+AVX2_KERNEL static double avx2Sum(const double* values, int count) {
+  __m256d low = _mm256_setzero_pd();
+  __m256d high = _mm256_setzero_pd();
+  int idx = 0;
+
+  for (; idx + VECTOR_LANES <= count; idx += VECTOR_LANES) {
+    low = _mm256_add_pd(low, _mm256_loadu_pd(values + idx));
+    high = _mm256_add_pd(high, _mm256_loadu_pd(values + idx + 4));
+  }
+
+  double lanes[VECTOR_LANES];
+  _mm256_storeu_pd(lanes, low);
+  _mm256_storeu_pd(lanes + 4, high);
+
+  double sum = combineSum(lanes);
+  for (; idx < count; idx++) {
+    sum += values[idx];
+  }
+
+  return sum;
+}
+
+AVX2_KERNEL static double avx2Dot(const double* a, const double* b,
+                                  int count) {
+  __m256d low = _mm256_setzero_pd();
+  __m256d high = _mm256_setzero_pd();
+  int idx = 0;
+
+  // Products are not fused with the sums, to round like the other kernels
+  for (; idx + VECTOR_LANES <= count; idx += VECTOR_LANES) {
+    low = _mm256_add_pd(
+        low, _mm256_mul_pd(_mm256_loadu_pd(a + idx), _mm256_loadu_pd(b + idx)));
+    high = _mm256_add_pd(high, _mm256_mul_pd(_mm256_loadu_pd(a + idx + 4),
+                                             _mm256_loadu_pd(b + idx + 4)));
+  }
+
+  double lanes[VECTOR_LANES];
+  _mm256_storeu_pd(lanes, low);
+  _mm256_storeu_pd(lanes + 4, high);
+
+  double sum = combineSum(lanes);
+  for (; idx < count; idx++) {
+    sum += a[idx] * b[idx];
+  }
+
+  return sum;
+}
+
+AVX2_KERNEL static double avx2MinMax(const double* values, int count,
+                                     bool min) {
+  if (count < VECTOR_LANES) {
+    return min ? scalarMin(values, count) : scalarMax(values, count);
+  }
+
+  __m256d low = _mm256_loadu_pd(values);
+  __m256d high = _mm256_loadu_pd(values + 4);
+  __m256d nan = _mm256_or_pd(_mm256_cmp_pd(low, low, _CMP_UNORD_Q),
+                             _mm256_cmp_pd(high, high, _CMP_UNORD_Q));
+
+  int idx = VECTOR_LANES;
+  for (; idx + VECTOR_LANES <= count; idx += VECTOR_LANES) {
+    __m256d nextLow = _mm256_loadu_pd(values + idx);
+    __m256d nextHigh = _mm256_loadu_pd(values + idx + 4);
+    nan = _mm256_or_pd(nan, _mm256_cmp_pd(nextLow, nextLow, _CMP_UNORD_Q));
+    nan = _mm256_or_pd(nan, _mm256_cmp_pd(nextHigh, nextHigh, _CMP_UNORD_Q));
+
+    if (min) {
+      low = _mm256_min_pd(nextLow, low);
+      high = _mm256_min_pd(nextHigh, high);
+    } else {
+      low = _mm256_max_pd(nextLow, low);
+      high = _mm256_max_pd(nextHigh, high);
+    }
+  }
+
+  if (_mm256_movemask_pd(nan) != 0) return NAN;
+
+  double lanes[VECTOR_LANES];
+  _mm256_storeu_pd(lanes, low);
+  _mm256_storeu_pd(lanes + 4, high);
+
+  double result = min ? combineMin(lanes) : combineMax(lanes);
+  for (; idx < count; idx++) {
+    if (isnan(values[idx])) return NAN;
+    result = min ? MIN(values[idx], result) : MAX(values[idx], result);
+  }
+
+  return result;
+}
+
+static double avx2Min(const double* values, int count) {
+  return avx2MinMax(values, count, true);
+}
+
+static double avx2Max(const double* values, int count) {
+  return avx2MinMax(values, count, false);
+}
+
+AVX2_KERNEL static void avx2Arithmetic(double* out, const double* a,
+                                       const double* b, bool broadcast,
+                                       int count, VectorOperation operation) {
+  __m256d other = _mm256_set1_pd(b[0]);
+  int idx = 0;
+
+  for (; idx + 4 <= count; idx += 4) {
+    if (!broadcast) other = _mm256_loadu_pd(b + idx);
+
+    __m256d value = _mm256_loadu_pd(a + idx);
+    _mm256_storeu_pd(out + idx, operation == VECTOR_ADD
+                                    ? _mm256_add_pd(value, other)
+                                    : _mm256_mul_pd(value, other));
+  }
+
+  scalarArithmetic(out + idx, a + idx, broadcast ? b : b + idx, broadcast,
+                   count - idx, operation);
+}
+
+AVX2_KERNEL static inline __m256d avx2Comparison(
+    __m256d a, __m256d b, VectorComparison comparison) {
+  switch (comparison) {
+    case VECTOR_LESS:
+      return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+    case VECTOR_LESS_EQUAL:
+      return _mm256_cmp_pd(a, b, _CMP_LE_OQ);
+    case VECTOR_GREATER:
+      return _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+    case VECTOR_GREATER_EQUAL:
+      return _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+    default:
+      return _mm256_cmp_pd(a, b, _CMP_EQ_OQ);
+  }
+}
+
+AVX2_KERNEL static void avx2Compare(uint8_t* mask, const double* a,
+                                    const double* b, bool broadcast, int count,
+                                    VectorComparison comparison) {
+  __m256d other = _mm256_set1_pd(b[0]);
+  int idx = 0;
+
+  for (; idx + 4 <= count; idx += 4) {
+    if (!broadcast) other = _mm256_loadu_pd(b + idx);
+
+    int bits = _mm256_movemask_pd(
+        avx2Comparison(_mm256_loadu_pd(a + idx), other, comparison));
+    for (int lane = 0; lane < 4; lane++) {
+      mask[idx + lane] = (bits >> lane) & 1;
+    }
+  }
+
+  scalarCompare(mask + idx, a + idx, broadcast ? b : b + idx, broadcast,
+                count - idx, comparison);
+}
+
+static const VectorKernels sse2Kernels = {sse2Sum, sse2Dot, sse2Min,
+                                          sse2Max, sse2Arithmetic,
+                                          sse2Compare};
+static const VectorKernels avx2Kernels = {avx2Sum, avx2Dot, avx2Min,
+                                          avx2Max, avx2Arithmetic,
+                                          avx2Compare};
+
+#endif
+
+static const VectorKernels scalarKernels = {scalarSum, scalarDot,
+                                            scalarMin, scalarMax,
+                                            scalarArithmetic, scalarCompare};
+
+static VectorKernels kernels = scalarKernels;
+static pthread_once_t kernelsOnce = PTHREAD_ONCE_INIT;
+
+static void selectVectorKernels() {
+#ifdef VECTOR_X86
+  __builtin_cpu_init();
+  kernels = __builtin_cpu_supports("avx2") ? avx2Kernels : sse2Kernels;
+#else
+  kernels = scalarKernels;
+#endif
+}
+
+// Kernels are shared by every VM of the process, selected by the first one
+void initVectorKernels() { pthread_once(&kernelsOnce, selectVectorKernels); }
+
+// -------------------------------- Operands --------------------------------
+
+static double* allocateScratch(int count) {
+  // Scratch buffers never outlive a native call, they are kept apart from the
+  // program heap and don't count towards the GC threshold
+  double* scratch = malloc(sizeof(double) * (count > 0 ? count : 1));
+  if (scratch == NULL) exit(1);
+
+  return scratch;
+}
+
+bool initVectorOperand(VectorOperand* operand, Value value) {
+  operand->values = NULL;
+  operand->count = 0;
+  operand->scratch = NULL;
+
+  if (IS_ARRAY(value)) {
+    ValueArray* list = &AS_ARRAY(value)->list;
+    for (int idx = 0; idx < list->count; idx++) {
+      if (!IS_NUMBER(list->values[idx])) return false;
+    }
+
+#ifdef NAN_BOXING
+    // Number values are plain doubles under NaN boxing, they are read in place
+    operand->values = (const double*)list->values;
+#else
+    operand->scratch = allocateScratch(list->count);
+    for (int idx = 0; idx < list->count; idx++) {
+      operand->scratch[idx] = AS_NUMBER(list->values[idx]);
+    }
+    operand->values = operand->scratch;
+#endif
+    operand->count = list->count;
+    return true;
+  }
+
+  if (IS_TYPED_ARRAY(value)) {
+    ObjTypedArray* array = AS_TYPED_ARRAY(value);
+    operand->count = array->count;
+
+    switch (array->kind) {
+      case TYPED_ARRAY_FLOAT64:
+        operand->values = array->as.float64;
+        return true;
+      case TYPED_ARRAY_INT32:
+        operand->scratch = allocateScratch(array->count);
+        for (int idx = 0; idx < array->count; idx++) {
+          operand->scratch[idx] = array->as.int32[idx];
+        }
+        break;
+      case TYPED_ARRAY_UINT8:
+        operand->scratch = allocateScratch(array->count);
+        for (int idx = 0; idx < array->count; idx++) {
+          operand->scratch[idx] = array->as.uint8[idx];
+        }
+        break;
+    }
+
+    operand->values = operand->scratch;
+    return true;
+  }
+
+  return false;
+}
+
+void freeVectorOperand(VectorOperand* operand) {
+  free(operand->scratch);
+  operand->scratch = NULL;
+}
+
+double* beginVectorResult(Thread* program, Value like, int count) {
+  if (IS_TYPED_ARRAY(like)) {
+    ObjTypedArray* array = newTypedArray(AS_TYPED_ARRAY(like)->kind, count);
+    push(program, OBJ_VAL(array));
+
+    return array->kind == TYPED_ARRAY_FLOAT64 ? array->as.float64
+                                              : allocateScratch(count);
+  }
+
+  ObjArray* array = newArray();
+  // push beforehand to the stack to protect from the GC
+  push(program, OBJ_VAL(array));
+
+  array->list.values = GROW_ARRAY(Value, NULL, 0, count);
+  array->list.capacity = count;
+  array->list.count = count;
+
+#ifdef NAN_BOXING
+  return (double*)array->list.values;
+#else
+  return allocateScratch(count);
+#endif
+}
+
+void endVectorResult(Thread* program, double* values) {
+  Value result = peek(program, 0);
+
+  if (IS_TYPED_ARRAY(result)) {
+    ObjTypedArray* array = AS_TYPED_ARRAY(result);
+    if (array->kind == TYPED_ARRAY_FLOAT64) return;
+
+    for (int idx = 0; idx < array->count; idx++) {
+      typedArraySet(array, idx, values[idx]);
+    }
+    free(values);
+    return;
+  }
+
+#ifndef NAN_BOXING
+  ValueArray* list = &AS_ARRAY(result)->list;
+  for (int idx = 0; idx < list->count; idx++) {
+    list->values[idx] = NUMBER_VAL(values[idx]);
+  }
+  free(values);
+#endif
+}
+
+// -------------------------------- Kernels --------------------------------
+
+double vectorSum(const double* values, int count) {
+  return kernels.sum(values, count);
+}
+
+double vectorDot(const double* a, const double* b, int count) {
+  return kernels.dot(a, b, count);
+}
+
+double vectorMin(const double* values, int count) {
+  return kernels.min(values, count);
+}
+
+double vectorMax(const double* values, int count) {
+  return kernels.max(values, count);
+}
+
+void vectorArithmetic(double* out, const double* a, const double* b,
+                      bool broadcast, int count, VectorOperation operation) {
+  if (count == 0) return;
+  kernels.arithmetic(out, a, b, broadcast, count, operation);
+}
+
+void vectorCompare(uint8_t* mask, const double* a, const double* b,
+                   bool broadcast, int count, VectorComparison comparison) {
+  if (count == 0) return;
+  kernels.compare(mask, a, b, broadcast, count, comparison);
+}
+
+// Each sum depends on the previous one, there is nothing to vectorize
+void vectorPrefixSum(double* out, const double* values, int count) {
+  double sum = 0;
+  for (int idx = 0; idx < count; idx++) {
+    sum += values[idx];
+    out[idx] = sum;
+  }
+}
+
+void vectorFill(double* out, double value, int count) {
+  for (int idx = 0; idx < count; idx++) {
+    out[idx] = value;
+  }
+}
+
+void vectorRange(double* out, double start, double step, int count) {
+  for (int idx = 0; idx < count; idx++) {
+    out[idx] = start + idx * step;
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef vector_h
+#define vector_h
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+typedef enum { VECTOR_ADD, VECTOR_MUL } VectorOperation;
+
+typedef enum {
+  VECTOR_LESS,
+  VECTOR_LESS_EQUAL,
+  VECTOR_GREATER,
+  VECTOR_GREATER_EQUAL,
+  VECTOR_EQUAL
+} VectorComparison;
+
+// Numeric elements of an Array or a typed array, read as doubles
+typedef struct {
+  const double* values;
+  int count;
+  // Elements converted from other representations, owned by the operand
+  double* scratch;
+} VectorOperand;
+
+// Selects the widest kernels the CPU supports
+void initVectorKernels();
+
+// Fails when the value isn't an array or has elements other than numbers
+bool initVectorOperand(VectorOperand* operand, Value value);
+void freeVectorOperand(VectorOperand* operand);
+
+// Results take the representation of like (an Array or a typed array) and are
+// pushed to the stack. Kernels write their doubles to the returned buffer,
+// which endVectorResult stores in the result.
+double* beginVectorResult(Thread* program, Value like, int count);
+void endVectorResult(Thread* program, double* values);
+
+// Reductions give the same result whatever kernels are selected
+double vectorSum(const double* values, int count);
+double vectorDot(const double* a, const double* b, int count);
+// Expect at least one element, NaN if any element is NaN
+double vectorMin(const double* values, int count);
+double vectorMax(const double* values, int count);
+
+// b is a single number repeated for every element when broadcast is set
+void vectorArithmetic(double* out, const double* a, const double* b,
+                      bool broadcast, int count, VectorOperation operation);
+void vectorCompare(uint8_t* mask, const double* a, const double* b,
+                   bool broadcast, int count, VectorComparison comparison);
+void vectorPrefixSum(double* out, const double* values, int count);
+void vectorFill(double* out, double value, int count);
+void vectorRange(double* out, double start, double step, int count);
+
+#endif
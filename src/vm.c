@@ -1,6 +1,7 @@
 #include "vm.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <pthread.h>
 #ifndef PTHREAD_MUTEX_RECURSIVE
 #define PTHREAD_MUTEX_RECURSIVE PTHREAD_MUTEX_RECURSIVE_NP
@@ -16,11 +17,14 @@
 #include "compiler.h"
 #include "core.h"
 #include "debug.h"
+#include "events.h"
+#include "fs.h"
 #include "memory.h"
+#include "multithreading.h"
 #include "utils.h"
 #include "value.h"
 
-VM vm;
+_Thread_local VM* currentVM = NULL;
 
 static void closeUpValue(ObjUpValue* upvalue);
 static void closeUpValues(Thread* program, Value* last);
@@ -33,22 +37,162 @@ static void resetStack(Thread* program) { program->stackTop = program->stack; }
 
 void initProgram(Thread* program) {
   initTable(&program->global);
-  resetStack(program);
   program->id = 0;
+  program->machine = currentVM;
   program->frame = NULL;
   program->upvalues = NULL;
+  program->frames = NULL;
   program->framesCount = 0;
+  program->framesCapacity = 0;
+  program->stack = NULL;
+  program->stackCapacity = 0;
+  program->stackLimit = NULL;
+  program->loopStack = NULL;
   program->loopStackCount = 0;
+  program->loopStackCapacity = 0;
+  program->tryCatchStack = NULL;
   program->tryCatchStackCount = 0;
+  program->tryCatchStackCapacity = 0;
+  program->switchStack = NULL;
   program->switchStackCount = 0;
+  program->switchStackCapacity = 0;
+
+  program->loopStack = ALLOCATE(Loop, BLOCK_STACK_INITIAL);
+  program->loopStackCapacity = BLOCK_STACK_INITIAL;
+  program->tryCatchStack = ALLOCATE(TryCatch, BLOCK_STACK_INITIAL);
+  program->tryCatchStackCapacity = BLOCK_STACK_INITIAL;
+  program->switchStack = ALLOCATE(Switch, BLOCK_STACK_INITIAL);
+  program->switchStackCapacity = BLOCK_STACK_INITIAL;
+  program->frames = ALLOCATE(CallFrame, FRAMES_INITIAL);
+  program->framesCapacity = FRAMES_INITIAL;
+  program->stack = ALLOCATE(Value, STACK_INITIAL);
+  program->stackCapacity = STACK_INITIAL;
+  program->stackLimit =
+      program->stack + STACK_INITIAL - STACK_INSTRUCTION_RESERVE;
+  resetStack(program);
+
+  initOutputBuffer(&program->output);
+  registerOutputBuffer(&vm.output, &program->output);
+
+  program->uncaughtHandler = NULL;
+  program->green = false;
+  program->suspending = false;
+  program->retrying = false;
+  program->retryNative = NULL;
+  program->awaiting = NULL;
+  program->awaitingError = NULL;
 }
 
-void freeProgram(Thread* program) { freeTable(&program->global); }
+void freeProgram(Thread* program) {
+  freeTable(&program->global);
+  FREE_ARRAY(CallFrame, program->frames, program->framesCapacity);
+  FREE_ARRAY(Value, program->stack, program->stackCapacity);
+  FREE_ARRAY(Loop, program->loopStack, program->loopStackCapacity);
+  FREE_ARRAY(TryCatch, program->tryCatchStack,
+             program->tryCatchStackCapacity);
+  FREE_ARRAY(Switch, program->switchStack, program->switchStackCapacity);
+  unregisterOutputBuffer(&vm.output, &program->output);
+  freeOutputBuffer(&program->output);
+}
+
+// Frames are moved when the frames array grows, so every frame pointer must
+// be relocated.
+static void growFrames(Thread* program) {
+  CallFrame* oldFrames = program->frames;
+  int oldCapacity = program->framesCapacity;
+  int newCapacity = GROW_CAPACITY(oldCapacity);
+  CallFrame* newFrames = ALLOCATE(CallFrame, newCapacity);
+
+  memcpy(newFrames, oldFrames, sizeof(CallFrame) * program->framesCount);
+
+#define RELOCATE(pointer) ((pointer) = newFrames + ((pointer) - oldFrames))
+  if (program->frame != NULL) RELOCATE(program->frame);
+
+  for (int idx = 0; idx < program->loopStackCount; idx++) {
+    RELOCATE(program->loopStack[idx].frame);
+  }
+  for (int idx = 0; idx < program->tryCatchStackCount; idx++) {
+    RELOCATE(program->tryCatchStack[idx].frame);
+  }
+  for (int idx = 0; idx < program->switchStackCount; idx++) {
+    RELOCATE(program->switchStack[idx].frame);
+  }
+#undef RELOCATE
+
+  program->frames = newFrames;
+  program->framesCapacity = newCapacity;
+  FREE_ARRAY(CallFrame, oldFrames, oldCapacity);
+}
+
+// Values are moved when the stack grows, so every pointer to the stack, i.e,
+// frame slots, block registers and open upvalues must be relocated.
+static void growStack(Thread* program) {
+  Value* oldStack = program->stack;
+  int oldCapacity = program->stackCapacity;
+  int newCapacity = GROW_CAPACITY(oldCapacity);
+  Value* newStack = ALLOCATE(Value, newCapacity);
+
+  memcpy(newStack, oldStack, sizeof(Value) * (program->stackTop - oldStack));
+
+#define RELOCATE(pointer) ((pointer) = newStack + ((pointer) - oldStack))
+  RELOCATE(program->stackTop);
+
+  for (int idx = 0; idx < program->framesCount; idx++) {
+    RELOCATE(program->frames[idx].slots);
+  }
+  for (int idx = 0; idx < program->loopStackCount; idx++) {
+    RELOCATE(program->loopStack[idx].frameStackTop);
+  }
+  for (int idx = 0; idx < program->tryCatchStackCount; idx++) {
+    RELOCATE(program->tryCatchStack[idx].frameStackTop);
+  }
+  for (int idx = 0; idx < program->switchStackCount; idx++) {
+    RELOCATE(program->switchStack[idx].expression);
+  }
+  for (ObjUpValue* upvalue = program->upvalues; upvalue != NULL;
+       upvalue = upvalue->next) {
+    RELOCATE(upvalue->location);
+  }
+#undef RELOCATE
+
+  program->stack = newStack;
+  program->stackCapacity = newCapacity;
+  program->stackLimit = newStack + newCapacity - STACK_INSTRUCTION_RESERVE;
+  FREE_ARRAY(Value, oldStack, oldCapacity);
+}
+
+// Ensure there is room for a new frame and its share of the stack
+static inline void ensureFrame(Thread* program) {
+  if (program->framesCount == program->framesCapacity) {
+    growFrames(program);
+  }
+
+  while (program->stackCapacity - (program->stackTop - program->stack) <
+         STACK_FRAME_RESERVE) {
+    growStack(program);
+  }
+}
+
+// Ensure a single instruction, and any native it calls, can push without
+// checking. Only called between instructions, when nothing else points into
+// the stack.
+static inline void ensureInstructionStack(Thread* program) {
+  if (__builtin_expect(program->stackTop >= program->stackLimit, false)) {
+    growStack(program);
+  }
+}
+
+VM* newVM() {
+  VM* machine = calloc(1, sizeof(VM));
+  if (machine == NULL) {
+    fprintf(stderr, "Not enough memory to create a VM.\n");
+    exit(1);
+  }
+  currentVM = machine;
 
-void initVM() {
   vm.state = INITIALIZING;
 
-  initTable(&vm.strings);
+  initInterningTable(&vm.strings);
   vm.threads = NULL;
   vm.locks = NULL;
   vm.semaphores = NULL;
@@ -75,18 +219,72 @@ void initVM() {
                             PTHREAD_MUTEX_RECURSIVE);
   pthread_mutex_init(&vm.memoryAllocationMutex, &vm.memoryAllocationMutexAttr);
 
+  initWorkersPool(&vm.workers);
+  initScheduler(&vm.scheduler);
+  initEventLoop(&vm.events);
+  pthread_mutex_init(&vm.futuresMutex, NULL);
+  pthread_cond_init(&vm.futuresCond, NULL);
+  pthread_mutex_init(&vm.channelsMutex, NULL);
+  pthread_cond_init(&vm.channelsCond, NULL);
+  initWakeup(&vm.channelsWakeup);
+  initWakeup(&vm.semaphoresWakeup);
+
+  vm.parentIsolate = NULL;
+  vm.entryPath = NULL;
+  vm.isolateExecutable = NULL;
+  vm.compiler = NULL;
+  vm.scripts = NULL;
+  vm.hostError = NULL;
+
+  initOutput(&vm.output);
   initProgram(&vm.program);
   initCore(&vm);
 
   vm.lambdaFunctionName = CONSTANT_STRING("lambda function");
 
   vm.state = INITIALIZED;
+
+  return machine;
 }
 
-void freeVM() {
+void setCurrentVM(VM* machine) { currentVM = machine; }
+
+void freeVM(VM* machine) {
+  VM* previous = currentVM;
+  currentVM = machine;
+
+  awaitGarbageCollector(&vm.program);
+  // Settled timers and watches resume green threads
+  stopEventLoop(&vm.events);
+  stopScheduler(&vm.scheduler);
+  stopWorkersPool(&vm.workers);
+
+  while (vm.scripts != NULL) {
+    unloadScript(vm.scripts);
+  }
   freeProgram(&vm.program);
+  freeTable(&vm.modules);
+  freeOutput(&vm.output);
   freeObjects();
-  freeTable(&vm.strings);
+  freeInterningTable(&vm.strings);
+
+  pthread_mutex_destroy(&vm.GCMutex);
+  pthread_mutexattr_destroy(&vm.GCMutexAttr);
+  pthread_cond_destroy(&vm.GCSafezoneCond);
+  pthread_mutex_destroy(&vm.memoryAllocationMutex);
+  pthread_mutexattr_destroy(&vm.memoryAllocationMutexAttr);
+  pthread_mutex_destroy(&vm.futuresMutex);
+  pthread_cond_destroy(&vm.futuresCond);
+  pthread_mutex_destroy(&vm.channelsMutex);
+  pthread_cond_destroy(&vm.channelsCond);
+  pthread_mutex_destroy(&vm.channelsWakeup.mutex);
+  pthread_mutex_destroy(&vm.semaphoresWakeup.mutex);
+  free(vm.entryPath);
+  free(vm.isolateExecutable);
+  free(vm.hostError);
+  free(machine);
+
+  currentVM = previous == machine ? NULL : previous;
 }
 
 // ***** GCWhiteList is not a thread-safe function. ******
@@ -110,6 +308,12 @@ ObjString* stackTrace(Thread* program) {
   int length = 0;
 
   for (int idx = program->framesCount - 1; idx >= 0; idx--) {
+    // Deep recursions are truncated
+    if (length > (int)sizeof(buffer) - 128) {
+      length += sprintf(&buffer[length], "...\n");
+      break;
+    }
+
     CallFrame* frame = &program->frames[idx];
     ObjFunction* function = IS_FRAME_MODULE(frame)
                                 ? FRAME_AS_MODULE(frame)->function
@@ -143,13 +347,32 @@ static void runtimeError(Thread* program, ObjString* stack, const char* format,
     stack = stackTrace(program);
   }
 
+  // Program output comes before the error
+  outputFlushAll(&vm.output);
+
+  // Host calls get the error back, the host decides what to do with it
+  if (program->uncaughtHandler != NULL) {
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    free(vm.hostError);
+    vm.hostError = malloc(length + stack->length + 2);
+    va_start(args, format);
+    vsnprintf(vm.hostError, length + 1, format, args);
+    va_end(args);
+    sprintf(&vm.hostError[length], "\n%.*s", stack->length, stack->chars);
+
+    longjmp(*program->uncaughtHandler, 1);
+  }
+
   // Print error message
   va_start(args, format);
   vfprintf(stderr, format, args);
   va_end(args);
   fputs("\n", stderr);
   // Print track stace
-  fprintf(stderr, stack->chars);
+  fprintf(stderr, "%.*s", stack->length, stack->chars);
 
   resetStack(program);
   // SOFTWARE_ERROR
@@ -244,12 +467,26 @@ static void concatenate(Thread* program) {
   ObjString* a = AS_STRING(peek(program, 1));
   int length = a->length + b->length;
 
-  char* buffer = ALLOCATE(char, length + 1);
-  memcpy(buffer, a->chars, a->length);
-  memcpy(buffer + a->length, b->chars, b->length);
-  buffer[length] = '\0';
+  // Appending to an empty string yields the other operand itself
+  if (a->length == 0 || b->length == 0) {
+    Value value = OBJ_VAL(a->length == 0 ? b : a);
+    pop(program);
+    pop(program);
+    push(program, value);
+    return;
+  }
 
-  Value value = OBJ_VAL(takeString(buffer, length));
+  // Short results are cheaper to copy than to keep as a rope
+  Value value;
+  if (length < ROPE_MIN_LENGTH) {
+    char* buffer = ALLOCATE(char, length + 1);
+    memcpy(buffer, flattenRope(a)->chars, a->length);
+    memcpy(buffer + a->length, flattenRope(b)->chars, b->length);
+    buffer[length] = '\0';
+    value = OBJ_VAL(takeTransientString(buffer, length));
+  } else {
+    value = OBJ_VAL(newStringRope(a, b));
+  }
 
   pop(program);
   pop(program);
@@ -257,6 +494,8 @@ static void concatenate(Thread* program) {
 }
 
 bool callEntry(Thread* thread, ObjClosure* closure) {
+  ensureFrame(thread);
+
   thread->frame = &thread->frames[thread->framesCount++];
   thread->frame->type = FRAME_TYPE_CLOSURE;
   thread->frame->as.closure = closure;
@@ -269,11 +508,29 @@ bool callEntry(Thread* thread, ObjClosure* closure) {
   return true;
 }
 
+// Pooled workers run many entry frames. Instead of copying the globals each
+// time, the frame shares the namespace of the thread that submitted the work.
+bool callSharedEntry(Thread* thread, ObjClosure* closure, Table* namespace,
+                     int argCount) {
+  ensureFrame(thread);
+
+  thread->frame = &thread->frames[thread->framesCount++];
+  thread->frame->type = FRAME_TYPE_CLOSURE;
+  thread->frame->as.closure = closure;
+  thread->frame->ip = closure->function->chunk.code;
+  thread->frame->slots = thread->stackTop - argCount - 1;
+  thread->frame->namespace = *namespace;
+
+  return true;
+}
+
 static bool call(Thread* program, ObjClosure* closure, uint8_t argCount) {
   if (program->framesCount == FRAMES_MAX) {
     runtimeError(program, NULL, "Stack overflow.");
   }
 
+  ensureFrame(program);
+
   CallFrame* frame = &program->frames[program->framesCount++];
   frame->type = FRAME_TYPE_CLOSURE;
   frame->namespace = program->frames[program->framesCount - 2].namespace;
@@ -284,11 +541,67 @@ static bool call(Thread* program, ObjClosure* closure, uint8_t argCount) {
   return true;
 }
 
+// Ensure loop, switch and try-catch blocks of the current frame are popped
+// before leaving it
+static void popFrameBlocks(Thread* program) {
+  while (program->loopStackCount > 0 &&
+         program->loopStack[program->loopStackCount - 1].frame ==
+             program->frame) {
+    program->loopStackCount--;
+  }
+
+  while (program->switchStackCount > 0 &&
+         program->switchStack[program->switchStackCount - 1].frame ==
+             program->frame) {
+    program->switchStackCount--;
+  }
+
+  while (program->tryCatchStackCount > 0 &&
+         program->tryCatchStack[program->tryCatchStackCount - 1].frame ==
+             program->frame) {
+    program->tryCatchStackCount--;
+  }
+}
+
+// Calls in tail position reuse the current frame. The callee and its
+// arguments are moved to the start of the frame slots and the frame is
+// popped, so that the call pushes the new frame in the very same place. If
+// the callee is not a closure (e.g, a native function), its result is left
+// where the current frame return value would be, as if it has returned.
+//
+// Returns false if the frame can't be reused and the call must be handled as
+// a plain call.
+static bool prepareTailCall(Thread* program, uint8_t argCount) {
+  CallFrame* frame = program->frame;
+
+  // Entry frames must be kept, worker threads handle its return value.
+  if (program->framesCount == 1 || IS_FRAME_MODULE(frame)) return false;
+
+  // Errors thrown by the callee must be caught by this frame try-catch blocks
+  if (program->tryCatchStackCount > 0 &&
+      program->tryCatchStack[program->tryCatchStackCount - 1].frame == frame) {
+    return false;
+  }
+
+  closeUpValues(program, frame->slots);
+  popFrameBlocks(program);
+
+  Value* callee = program->stackTop - argCount - 1;
+  memmove(frame->slots, callee, sizeof(Value) * (argCount + 1));
+  program->stackTop = frame->slots + argCount + 1;
+
+  program->framesCount--;
+  program->frame = &program->frames[program->framesCount - 1];
+  return true;
+}
+
 static bool callModule(Thread* program, ObjModule* module) {
   if (program->framesCount == FRAMES_MAX) {
     runtimeError(program, NULL, "Stack overflow.");
   }
 
+  ensureFrame(program);
+
   CallFrame* frame = &program->frames[program->framesCount++];
   frame->type = FRAME_TYPE_MODULE;
   frame->as.module = module;
@@ -314,12 +627,30 @@ static bool callNativeFn(Thread* program, NativeFn function, int argCount,
   }
 
   Value fnReturn = pop(program);
+
+  // The call is done once retried, only its result is dropped
+  if (__builtin_expect(program->retrying, false)) {
+    program->retrying = false;
+    program->retryNative = function;
+    program->retryArgCount = argCount;
+    program->retryIsMethod = isMethod;
+    return true;
+  }
+
   program->stackTop -=
       argCount + 1;  // pop from the stack the callee? + function arguments
   push(program, fnReturn);
   return true;
 }
 
+bool retryNativeCall(Thread* program) {
+  NativeFn function = program->retryNative;
+  program->retryNative = NULL;
+
+  return callNativeFn(program, function, program->retryArgCount,
+                      program->retryIsMethod);
+}
+
 // You can call whatever function as long as the argCount >= arity.
 // consequences are:
 //
@@ -614,6 +945,18 @@ static inline void getArrayItem(Thread* program, ObjArray* arr, Value index,
   return;
 }
 
+static inline void getTypedArrayItem(Thread* program, ObjTypedArray* arr,
+                                     Value index, Value* value) {
+  if (!IS_NUMBER(index)) {
+    recoverableRuntimeError(program, "Array index must be a number.");
+    return;
+  } else if (AS_NUMBER(index) < 0 || AS_NUMBER(index) >= arr->count) {
+    return;
+  }
+
+  *value = NUMBER_VAL(typedArrayGet(arr, (int)AS_NUMBER(index)));
+}
+
 static inline void getStringChar(Thread* program, ObjString* string,
                                  Value index, Value* value) {
   if (!IS_NUMBER(index)) {
@@ -624,7 +967,8 @@ static inline void getStringChar(Thread* program, ObjString* string,
     return;
   }
 
-  *value = OBJ_VAL(copyString(&string->chars[(int)AS_NUMBER(index)], 1));
+  *value =
+      OBJ_VAL(copyString(&flattenRope(string)->chars[(int)AS_NUMBER(index)], 1));
 }
 
 static inline void setArrayItem(Thread* program, ObjArray* arr, Value index,
@@ -640,6 +984,22 @@ static inline void setArrayItem(Thread* program, ObjArray* arr, Value index,
   arr->list.values[(int)AS_NUMBER(index)] = value;
 }
 
+static inline void setTypedArrayItem(Thread* program, ObjTypedArray* arr,
+                                     Value index, Value value) {
+  if (!IS_NUMBER(index)) {
+    recoverableRuntimeError(program, "Array index must be a number.");
+    return;
+  } else if (AS_NUMBER(index) < 0 || AS_NUMBER(index) >= arr->count) {
+    recoverableRuntimeError(program, "Array index out of bounds.");
+    return;
+  } else if (!IS_NUMBER(value)) {
+    recoverableRuntimeError(program, "Typed array values must be numbers.");
+    return;
+  }
+
+  typedArraySet(arr, (int)AS_NUMBER(index), AS_NUMBER(value));
+}
+
 static inline void getInstanceProperty(Thread* program, ObjInstance* instance,
                                        Value index, Value* value) {
   if (!IS_STRING(index)) {
@@ -674,92 +1034,68 @@ static inline void getObjectProperty(Thread* program, Obj* obj, Value index,
   }
 }
 
-// String interpolation is handled in two pass:
-//  - 1°) Compute resulting string length and store placeholder string values
-//  - 2°) Fill resulting string, swapping placeholder literal for placeholder
-//  string value
-static inline Value stringInterpolation(Thread* program, ObjString* template) {
-  
-  pthread_mutex_lock(&vm.memoryAllocationMutex); 
-
-  ObjArray* valueArray = (ObjArray*)GCWhiteList((Obj*)newArray());
-  int length = template->length;
-
-  for (int i = 0; i < template->length; i++) {
-    // template placeholder slot found
-    if (template->chars[i] == '$' && i + 1 < template->length &&
-        template->chars[i + 1] == '(') {
-      int placeholderStart = i;
-
-      // skip $(
-      i += 2;
-
-      // Since we are popping from one stack to other, the items order is
-      // reversed. Which is exactly what we need.
-      Value value = pop(program);
-      ObjString* valueStr = (ObjString*)GCWhiteList((Obj*)toString(value));
-      writeValueArray(&valueArray->list, OBJ_VAL(valueStr));
-      GCPopWhiteList();
+// String interpolation template comes pre-split in literal segments, with one
+// value stacked for each gap between them. The values are stringified in
+// place, so that they stay reachable by the GC, and then written along with
+// the segments to an exactly-sized buffer.
+static inline Value stringInterpolation(Thread* program, ObjArray* segments) {
+  int valuesCount = segments->list.count - 1;
+  Value* values = program->stackTop - valuesCount;
+  int length = 0;
 
-      // consume everything until placeholder end
-      int isPlaceholderOpen = 1;
-      while (isPlaceholderOpen > 0) {
-        if (template->chars[i] == '(') isPlaceholderOpen++;
-        if (template->chars[i] == ')') isPlaceholderOpen--;
-        i++;
-      }
-      i--;
+  for (int idx = 0; idx <= valuesCount; idx++) {
+    length += AS_STRING(segments->list.values[idx])->length;
+  }
 
-      // Although this is computed in a reverse way, it is able to correctly get
-      // the resulting string length. It does so by incrementing the delta
-      // (placeholder length - placeholder-value length).
-      length = length - (i - placeholderStart + 1) + valueStr->length;
+  for (int idx = 0; idx < valuesCount; idx++) {
+    if (!IS_STRING(values[idx])) {
+      values[idx] = OBJ_VAL(toString(values[idx]));
     }
+    length += AS_STRING(values[idx])->length;
   }
 
-  char buffer[length + 1];
-
-  int idx = 0;
-  for (int i = 0; i < template->length; i++) {
-    // template placeholder slot found
-    if (template->chars[i] == '$' && i + 1 < template->length &&
-        template->chars[i + 1] == '(') {
-      // skip $(
-      i += 2;
+  char* buffer = ALLOCATE(char, length + 1);
+  char* end = buffer;
 
-      // consume everything until placeholder end
-      int isPlaceholderOpen = 1;
-      while (isPlaceholderOpen > 0) {
-        if (template->chars[i] == '(') isPlaceholderOpen++;
-        if (template->chars[i] == ')') isPlaceholderOpen--;
-        i++;
-      }
-      i--;
+  for (int idx = 0; idx <= valuesCount; idx++) {
+    ObjString* segment = AS_STRING(segments->list.values[idx]);
+    memcpy(end, segment->chars, segment->length);
+    end += segment->length;
 
-      // write placeholder value on the buffer
-      ObjString* valueStr =
-          AS_STRING(valueArray->list.values[--valueArray->list.count]);
-      for (int j = 0; j < valueStr->length; j++) {
-        buffer[idx++] = valueStr->chars[j];
-      }
-    } else {
-      // write template-non-placeholder on the buffer
-      buffer[idx++] = template->chars[i];
+    if (idx < valuesCount) {
+      ObjString* value = flattenRope(AS_STRING(values[idx]));
+      memcpy(end, value->chars, value->length);
+      end += value->length;
     }
   }
 
-  GCPopWhiteList(&valueArray);
-  buffer[idx] = '\0';
+  *end = '\0';
+  program->stackTop -= valuesCount;
 
-  pthread_mutex_unlock(&vm.memoryAllocationMutex);
+  return OBJ_VAL(takeTransientString(buffer, length));
+}
 
-  return OBJ_VAL(copyString(buffer, idx));
+// Largest magnitude for which every integer is exactly representable as a
+// double. Ranged loops within it can be counted with unboxed integers.
+#define RANGE_INT_MAX 9007199254740992.0
+
+static inline bool isRangeInteger(double value) {
+  return value >= -RANGE_INT_MAX && value <= RANGE_INT_MAX &&
+         value == (double)(int64_t)value;
 }
 
 InterpretResult run(Thread* program) {
   program->frame = &program->frames[program->framesCount - 1];
 
 #define IS_WORKER_THREAD() &vm.program != program
+// Natives only suspend green threads, which resume after the call
+#define SUSPEND_IF_REQUESTED()     \
+  do {                             \
+    if (program->suspending) {     \
+      program->suspending = false; \
+      return INTERPRET_SUSPENDED;  \
+    }                              \
+  } while (false)
 #define READ_BYTE() (*program->frame->ip++)
 #define READ_CONSTANT()                                      \
   (IS_FRAME_MODULE(program->frame)                           \
@@ -767,10 +1103,46 @@ InterpretResult run(Thread* program) {
              ->function->chunk.constants.values[READ_BYTE()] \
        : FRAME_AS_CLOSURE(program->frame)                    \
              ->function->chunk.constants.values[READ_BYTE()])
+#define READ_SHORT_CONSTANT()                                 \
+  (IS_FRAME_MODULE(program->frame)                            \
+       ? FRAME_AS_MODULE(program->frame)                      \
+             ->function->chunk.constants.values[READ_SHORT()] \
+       : FRAME_AS_CLOSURE(program->frame)                     \
+             ->function->chunk.constants.values[READ_SHORT()])
 #define READ_SHORT()        \
   (program->frame->ip += 2, \
    (uint16_t)((program->frame->ip[-2] << 8) | program->frame->ip[-1]))
 #define READ_STRING() (AS_STRING(READ_CONSTANT()))
+// Block registers are only referenced by index, so they can simply be moved
+#define GROW_BLOCK_STACK(program, type, blocks)                            \
+  do {                                                                     \
+    int oldCapacity = program->blocks##Capacity;                           \
+    program->blocks##Capacity = GROW_CAPACITY(oldCapacity);                \
+    program->blocks = GROW_ARRAY(type, program->blocks, oldCapacity,       \
+                                 program->blocks##Capacity);               \
+  } while (false)
+// Integer ranged loop head. "headOffset" is the distance back to the
+// floating point loop head, used whenever the iteration variable is reassigned
+// in the loop body.
+#define RANGED_LOOP_INT(program, op, headOffset)                             \
+  Loop* loop = &program->loopStack[program->loopStackCount - 1];             \
+  if (program->stackTop[-3] != loop->rangeValue) {                           \
+    if (!IS_NUMBER(program->stackTop[-3])) {                                 \
+      runtimeError(program, NULL,                                            \
+                   "Expected range iteration variable to be a number.");    \
+    }                                                                        \
+    loop->startIp = program->frame->ip - headOffset;                         \
+    program->frame->ip = loop->startIp;                                      \
+    break;                                                                   \
+  }                                                                          \
+  int64_t current = loop->rangeCurrent + loop->rangeStep;                    \
+  if (current op loop->rangeEnd) {                                           \
+    program->frame->ip = loop->outIp;                                        \
+    program->stackTop = loop->frameStackTop + 1;                             \
+    break;                                                                   \
+  }                                                                          \
+  loop->rangeCurrent = current;                                              \
+  loop->rangeValue = program->stackTop[-3] = NUMBER_VAL((double)current);
 #define BINARY_OP(program, valueType, op)                               \
   do {                                                                  \
     if (!IS_NUMBER(peek(program, 0)) || !IS_NUMBER(peek(program, 1))) { \
@@ -784,6 +1156,7 @@ InterpretResult run(Thread* program) {
 
   for (;;) {
     passGCSafezone(program);
+    ensureInstructionStack(program);
 
 #ifdef DEBUG_TRACE_EXECUTION
     printf("        ");
@@ -815,8 +1188,8 @@ InterpretResult run(Thread* program) {
         break;
       }
       case OP_STRING_INTERPOLATION: {
-        ObjString* name = AS_STRING(READ_CONSTANT());
-        push(program, stringInterpolation(program, name));
+        ObjArray* segments = AS_ARRAY(READ_CONSTANT());
+        push(program, stringInterpolation(program, segments));
         break;
       }
       case OP_ARRAY: {
@@ -914,6 +1287,21 @@ InterpretResult run(Thread* program) {
         }
 
         program->frame = &program->frames[program->framesCount - 1];
+        SUSPEND_IF_REQUESTED();
+        break;
+      }
+      case OP_TAIL_INVOKE: {
+        ObjString* name = READ_STRING();
+        uint8_t argCount = READ_BYTE();
+
+        prepareTailCall(program, argCount);
+
+        if (!invokeMethod(program, peek(program, argCount), name, argCount)) {
+          continue;
+        }
+
+        program->frame = &program->frames[program->framesCount - 1];
+        SUSPEND_IF_REQUESTED();
         break;
       }
       case OP_SET_PROPERTY: {
@@ -948,6 +1336,8 @@ InterpretResult run(Thread* program) {
 
         if (IS_ARRAY(base)) {
           getArrayItem(program, AS_ARRAY(base), identifier, &value);
+        } else if (IS_TYPED_ARRAY(base)) {
+          getTypedArrayItem(program, AS_TYPED_ARRAY(base), identifier, &value);
         } else if (IS_STRING(base)) {
           getStringChar(program, AS_STRING(base), identifier, &value);
         } else if (IS_STRING(identifier)) {
@@ -967,6 +1357,8 @@ InterpretResult run(Thread* program) {
 
         if (IS_ARRAY(base)) {
           setArrayItem(program, AS_ARRAY(base), identifier, value);
+        } else if (IS_TYPED_ARRAY(base)) {
+          setTypedArrayItem(program, AS_TYPED_ARRAY(base), identifier, value);
         } else if (IS_INSTANCE(base)) {
           setInstanceProperty(program, AS_INSTANCE(base), identifier, value);
         }
@@ -1029,11 +1421,30 @@ InterpretResult run(Thread* program) {
           step = AS_NUMBER(stepValue);
         }
 
-        start -= step;
-
-        program->stackTop[-3] = NUMBER_VAL(start);
+        program->stackTop[-3] = NUMBER_VAL(start - step);
         program->stackTop[-2] = NUMBER_VAL(end);
         program->stackTop[-1] = NUMBER_VAL(step);
+
+        // The loop heads are laid out right after this instruction:
+        //
+        //  OP_RANGED_LOOP
+        //  OP_RANGED_LOOP_INT_UP
+        //  OP_RANGED_LOOP_INT_DOWN
+        //
+        // Pick the one that is going to be used for the whole loop.
+        Loop* loop = &program->loopStack[program->loopStackCount - 1];
+        loop->startIp = program->frame->ip;
+
+        if (isRangeInteger(start) && isRangeInteger(end) &&
+            isRangeInteger(step)) {
+          loop->rangeCurrent = (int64_t)start - (int64_t)step;
+          loop->rangeEnd = (int64_t)end;
+          loop->rangeStep = (int64_t)step;
+          loop->rangeValue = program->stackTop[-3];
+          loop->startIp += step > 0 ? 1 : 2;
+        }
+
+        program->frame->ip = loop->startIp;
         break;
       }
       case OP_RANGED_LOOP: {
@@ -1058,21 +1469,58 @@ InterpretResult run(Thread* program) {
         }
 
         program->stackTop[-3] = NUMBER_VAL(current);
+        // skip the integer loop heads
+        program->frame->ip += 2;
+        break;
+      }
+      case OP_RANGED_LOOP_INT_UP: {
+        RANGED_LOOP_INT(program, >=, 2);
+        // skip the descending loop head
+        program->frame->ip++;
+        break;
+      }
+      case OP_RANGED_LOOP_INT_DOWN: {
+        RANGED_LOOP_INT(program, <=, 3);
+        break;
+      }
+      case OP_RANGED_LOOP_RESTART: {
+        program->frame->ip =
+            program->loopStack[program->loopStackCount - 1].startIp;
         break;
       }
       case OP_NAMED_LOOP: {
         Value iterator = peek(program, 0);
         Value iterationIdx = peek(program, 1);
         int nextIdx = AS_NUMBER(iterationIdx) + 1;
-
-        if (!IS_ARRAY(iterator)) {
+        Value next = NIL_VAL;
+        bool done;
+
+        if (IS_ARRAY(iterator)) {
+          done = nextIdx >= AS_ARRAY(iterator)->list.count;
+          if (!done) next = AS_ARRAY(iterator)->list.values[nextIdx];
+        } else if (IS_TYPED_ARRAY(iterator)) {
+          done = nextIdx >= AS_TYPED_ARRAY(iterator)->count;
+          if (!done) {
+            next = NUMBER_VAL(typedArrayGet(AS_TYPED_ARRAY(iterator), nextIdx));
+          }
+        } else if (IS_FILE(iterator) &&
+                   AS_FILE(iterator)->mode == FILE_READER &&
+                   AS_FILE(iterator)->fd >= 0) {
+          // Files are iterated line by line
+          if (!fsReadLine(program, AS_FILE(iterator), &next)) {
+            recoverableRuntimeError(program, "Can't read file: %s.",
+                                    strerror(errno));
+            continue;
+          }
+          done = IS_NIL(next);
+        } else {
           recoverableRuntimeError(
               program, "Expected for each iterator variable to be iterable.");
           continue;
         }
 
         // Get out of the loop
-        if (nextIdx >= AS_ARRAY(iterator)->list.count) {
+        if (done) {
           Loop* loop = &program->loopStack[program->loopStackCount - 1];
 
           program->frame->ip = loop->outIp;
@@ -1088,13 +1536,12 @@ InterpretResult run(Thread* program) {
         // update iteration idx
         program->stackTop[-2] = NUMBER_VAL(nextIdx);
         // update iteration name
-        program->stackTop[-3] = AS_ARRAY(iterator)->list.values[nextIdx];
+        program->stackTop[-3] = next;
         break;
       }
       case OP_LOOP_GUARD: {
-        if (program->loopStackCount + 1 == LOOP_STACK_MAX) {
-          runtimeError(program, NULL, "Cant stack more than %d loops.",
-                       LOOP_STACK_MAX);
+        if (program->loopStackCount == program->loopStackCapacity) {
+          GROW_BLOCK_STACK(program, Loop, loopStack);
         }
 
         uint16_t startOffset = READ_SHORT();
@@ -1159,10 +1606,8 @@ InterpretResult run(Thread* program) {
         break;
       }
       case OP_TRY_CATCH: {
-        if (program->tryCatchStackCount + 1 == TRY_CATCH_STACK_MAX) {
-          runtimeError(program, NULL,
-                       "Cant stack more than %d try-catch blocks.",
-                       TRY_CATCH_STACK_MAX);
+        if (program->tryCatchStackCount == program->tryCatchStackCapacity) {
+          GROW_BLOCK_STACK(program, TryCatch, tryCatchStack);
         }
 
         uint16_t catchOffset = READ_SHORT();
@@ -1212,11 +1657,14 @@ InterpretResult run(Thread* program) {
                      (ObjString*)GCWhiteList((Obj*)CONSTANT_STRING("stack")),
                      &stackValue);
 
-            runtimeError(program, AS_STRING(stackValue),
-                         "Uncaught Exception.\n%s", AS_CSTRING(messageValue));
+            runtimeError(program, flattenRope(AS_STRING(stackValue)),
+                         "Uncaught Exception.\n%.*s",
+                         AS_STRING(messageValue)->length,
+                         flattenRope(AS_STRING(messageValue))->chars);
           } else {
-            runtimeError(program, NULL, "Uncaught Exception.\n%s",
-                         toString(value)->chars);
+            ObjString* string = toString(value);
+            runtimeError(program, NULL, "Uncaught Exception.\n%.*s",
+                         string->length, string->chars);
           }
         }
 
@@ -1269,10 +1717,8 @@ InterpretResult run(Thread* program) {
       case OP_SWITCH: {
         // Stacks a switch block on the stack
 
-        if (program->switchStackCount + 1 == SWITCH_STACK_MAX) {
-          runtimeError(program, NULL,
-                       "Cant stack more than %d switch-case blocks.",
-                       SWITCH_STACK_MAX);
+        if (program->switchStackCount == program->switchStackCapacity) {
+          GROW_BLOCK_STACK(program, Switch, switchStack);
         }
 
         Switch* switchBlock =
@@ -1286,6 +1732,35 @@ InterpretResult run(Thread* program) {
         switchBlock->frame = program->frame;
         break;
       }
+      case OP_SWITCH_TABLE: {
+        // Constant cases switch. Instead of comparing each case expression in
+        // sequence, look up the matching case statement in the jump table and
+        // fall through from there. If no case matches, go straight to the
+        // OP_SWITCH_END instruction, that handles the default statement.
+
+        if (program->switchStackCount == program->switchStackCapacity) {
+          GROW_BLOCK_STACK(program, Switch, switchStack);
+        }
+
+        Switch* switchBlock =
+            &program->switchStack[program->switchStackCount++];
+        ObjJumpTable* table = AS_JUMP_TABLE(READ_SHORT_CONSTANT());
+
+        switchBlock->expression = &program->stackTop[-1];
+        switchBlock->startIp = program->frame->ip;
+        switchBlock->outIp = program->frame->ip + table->outOffset;
+        switchBlock->frame = program->frame;
+
+        int caseOffset;
+        if (jumpTableGet(table, program->stackTop[-1], &caseOffset)) {
+          switchBlock->fallThrough = true;
+          program->frame->ip += caseOffset;
+        } else {
+          switchBlock->fallThrough = false;
+          program->frame->ip = switchBlock->outIp;
+        }
+        break;
+      }
       case OP_SWITCH_BREAK: {
         // Break current switch execution a pop any enclosing try catch
         // statement.
@@ -1458,6 +1933,19 @@ InterpretResult run(Thread* program) {
           continue;
         }
         program->frame = &program->frames[program->framesCount - 1];
+        SUSPEND_IF_REQUESTED();
+        break;
+      }
+      case OP_TAIL_CALL: {
+        uint8_t argCount = READ_BYTE();
+
+        prepareTailCall(program, argCount);
+
+        if (!callValue(program, peek(program, argCount), argCount)) {
+          continue;
+        }
+        program->frame = &program->frames[program->framesCount - 1];
+        SUSPEND_IF_REQUESTED();
         break;
       }
       case OP_CLOSURE: {
@@ -1575,33 +2063,14 @@ InterpretResult run(Thread* program) {
           result = FRAME_AS_MODULE(program->frame)->exports;
         }
 
-        // Ensure loop blocks are popped if returned inside them
-        while (program->loopStackCount > 0 &&
-               program->loopStack[program->loopStackCount - 1].frame ==
-                   program->frame) {
-          program->loopStackCount--;
-        }
-
-        // Ensure switch blocks are popped if returned inside them
-        while (program->switchStackCount > 0 &&
-               program->switchStack[program->switchStackCount - 1].frame ==
-                   program->frame) {
-          program->switchStackCount--;
-        }
-
-        // Ensure try-catch blocks are popped if returned inside them
-        while (program->tryCatchStackCount > 0 &&
-               program->tryCatchStack[program->tryCatchStackCount - 1].frame ==
-                   program->frame) {
-          program->tryCatchStackCount--;
-        }
+        popFrameBlocks(program);
 
         program->framesCount--;
         if (program->framesCount == 0) {
           pop(program);
 
-          // Worker threads are expected to return something.
-          if (IS_WORKER_THREAD()) {
+          // Worker threads and host calls are expected to return something.
+          if (IS_WORKER_THREAD() || program->uncaughtHandler != NULL) {
             push(program, result);
           }
 
@@ -1621,11 +2090,19 @@ InterpretResult run(Thread* program) {
   }
 
 #undef BINARY_OP
+#undef SUSPEND_IF_REQUESTED
+#undef GROW_BLOCK_STACK
+#undef RANGED_LOOP_INT
 #undef READ_CONSTANT
+#undef READ_SHORT_CONSTANT
 #undef READ_BYTE
 }
 
 InterpretResult interpret(const char* source, char* absPath) {
+  if (absPath != NULL && vm.entryPath == NULL) {
+    vm.entryPath = strdup(absPath);
+  }
+
   ObjFunction* function =
       (ObjFunction*)GCWhiteList((Obj*)compile(source, absPath));
 
@@ -1640,6 +2117,160 @@ InterpretResult interpret(const char* source, char* absPath) {
   callEntry(&vm.program, closure);
 
   InterpretResult result = run(&vm.program);
+  outputFlush(&vm.output, &vm.program.output);
 
   return result;
 }
+
+// Reports an error to the embedding host
+static void hostError(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+
+  free(vm.hostError);
+  vm.hostError = malloc(length + 1);
+  va_start(args, format);
+  vsnprintf(vm.hostError, length + 1, format, args);
+  va_end(args);
+}
+
+// Runs the main program on behalf of the embedding host, the entry frame is
+// already called. Uncaught errors unwind back here, and leave the program
+// ready for the next call.
+static InterpretResult runHosted(Thread* program, Value* result) {
+  jmp_buf handler;
+  int whiteListCount = vm.GCWhiteListCount;
+
+  if (setjmp(handler) != 0) {
+    closeUpValues(program, program->stack);
+    resetStack(program);
+    program->frame = NULL;
+    program->framesCount = 0;
+    program->loopStackCount = 0;
+    program->tryCatchStackCount = 0;
+    program->switchStackCount = 0;
+    program->uncaughtHandler = NULL;
+    // White listing holds the memory allocation lock until popped
+    while (vm.GCWhiteListCount > whiteListCount) {
+      GCPopWhiteList();
+    }
+
+    return INTERPRET_RUNTIME_ERROR;
+  }
+
+  program->uncaughtHandler = &handler;
+  InterpretResult status = run(program);
+  program->uncaughtHandler = NULL;
+  outputFlush(&vm.output, &program->output);
+
+  if (result != NULL) {
+    *result = peek(program, 0);
+  }
+  resetStack(program);
+
+  return status;
+}
+
+Script* loadScript(const char* source, char* absPath, InterpretResult* result) {
+  Thread* program = &vm.program;
+
+  if (program->framesCount != 0) {
+    hostError("Cannot load a script while the VM is running.");
+    *result = INTERPRET_RUNTIME_ERROR;
+    return NULL;
+  }
+
+  if (absPath != NULL && vm.entryPath == NULL) {
+    vm.entryPath = strdup(absPath);
+  }
+
+  ObjFunction* function = compile(source, absPath);
+
+  if (function == NULL) {
+    hostError("Cannot compile script.");
+    *result = INTERPRET_COMPILE_ERROR;
+    return NULL;
+  }
+
+  GCWhiteList((Obj*)function);
+  ObjClosure* closure = newClosure(function);
+  GCPopWhiteList();
+
+  push(program, OBJ_VAL(closure));
+  callEntry(program, closure);
+
+  *result = runHosted(program, NULL);
+  // The entry frame namespace holds the script variables
+  Table namespace = program->frames[0].namespace;
+
+  if (*result != INTERPRET_OK) {
+    freeTable(&namespace);
+    return NULL;
+  }
+
+  Script* script = malloc(sizeof(Script));
+  if (script == NULL) {
+    fprintf(stderr, "Not enough memory to load a script.\n");
+    exit(1);
+  }
+
+  script->namespace = namespace;
+  script->previous = NULL;
+  script->next = vm.scripts;
+  if (vm.scripts != NULL) {
+    vm.scripts->previous = script;
+  }
+  vm.scripts = script;
+
+  return script;
+}
+
+InterpretResult callScript(Script* script, Value callee, int argCount,
+                           const Value* args, Value* result) {
+  Thread* program = &vm.program;
+
+  if (program->framesCount != 0) {
+    hostError("Cannot call a function while the VM is running.");
+    return INTERPRET_RUNTIME_ERROR;
+  }
+  if (!IS_CLOSURE(callee)) {
+    hostError("Can only call functions.");
+    return INTERPRET_RUNTIME_ERROR;
+  }
+  if (argCount > UINT8_MAX) {
+    hostError("Can't have more than 255 arguments.");
+    return INTERPRET_RUNTIME_ERROR;
+  }
+
+  ObjClosure* closure = AS_CLOSURE(callee);
+
+  if (closure->function->arity > argCount) {
+    hostError("Expected %d arguments but got %d.", closure->function->arity,
+              argCount);
+    return INTERPRET_RUNTIME_ERROR;
+  }
+
+  push(program, callee);
+  for (int idx = 0; idx < argCount; idx++) {
+    push(program, args[idx]);
+  }
+  callSharedEntry(program, closure, &script->namespace, argCount);
+
+  return runHosted(program, result);
+}
+
+void unloadScript(Script* script) {
+  if (script->previous != NULL) {
+    script->previous->next = script->next;
+  } else {
+    vm.scripts = script->next;
+  }
+  if (script->next != NULL) {
+    script->next->previous = script->previous;
+  }
+
+  freeTable(&script->namespace);
+  free(script);
+}
@@ -3,17 +3,31 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <setjmp.h>
 
 #include "chunk.h"
+#include "interning.h"
 #include "object.h"
+#include "output.h"
 #include "table.h"
 #include "value.h"
 
-#define FRAMES_MAX 64
-#define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
+// Call frames and the value stack start small and grow on demand. FRAMES_MAX
+// only guards against runaway recursion.
+#define FRAMES_MAX (1 << 16)
+#define FRAMES_INITIAL 8
+// Free stack slots guaranteed whenever a frame is pushed. A function has at
+// most UINT8_COUNT locals, the remaining slots are left for temporaries.
+#define STACK_FRAME_RESERVE (UINT8_COUNT * 2)
+// Free stack slots guaranteed before every instruction, temporaries of a
+// single frame are unbounded (nested array literals, call arguments...)
+#define STACK_INSTRUCTION_RESERVE UINT8_COUNT
+#define STACK_INITIAL (STACK_FRAME_RESERVE * 2)
 #define GC_WHITE_LIST_MAX 16
 
-#define TRY_CATCH_STACK_MAX 8
+// Loop, try-catch and switch block registers also grow on demand
+#define BLOCK_STACK_INITIAL 8
+// Max nesting of loop and switch blocks in a function
 #define LOOP_STACK_MAX 8
 #define SWITCH_STACK_MAX 8
 #define BLOCK_MAX LOOP_STACK_MAX + SWITCH_STACK_MAX
@@ -65,6 +79,15 @@ typedef struct Loop {
   Value* frameStackTop;
   uint8_t* startIp;
   uint8_t* outIp;
+  // Ranged for-loop integer registers. When all the range arguments are
+  // integral, the counter is kept unboxed here and the stack slot only
+  // mirrors it for the loop body.
+  int64_t rangeCurrent;
+  int64_t rangeEnd;
+  int64_t rangeStep;
+  // Last value written to the iteration variable slot, used to detect
+  // assignments to the iteration variable inside the loop body
+  Value rangeValue;
 } Loop;
 
 // Auxiliary struct to handle switch-case sstatements
@@ -81,9 +104,14 @@ typedef struct {
   // Mainly used for debugging
   int id;  
 
+  // VM the thread belongs to, made current when its operating system thread
+  // starts
+  struct VM* machine;
+
   // Program frames
-  CallFrame frames[FRAMES_MAX];
+  CallFrame* frames;
   int framesCount;
+  int framesCapacity;
 
   // Current frame pointer
   CallFrame* frame;
@@ -92,9 +120,13 @@ typedef struct {
   Table global;
 
   // Program stack
-  Value stack[STACK_MAX];
+  Value* stack;
+  int stackCapacity;
   // Program stack pointer
   Value* stackTop;
+  // Grown before each instruction once the stack pointer reaches it, keeping
+  // STACK_INSTRUCTION_RESERVE free slots
+  Value* stackLimit;
 
   // Closure is handled through upvalues.
   // This list stores open upvalues, i.e, access to variables in an outer scope
@@ -102,16 +134,41 @@ typedef struct {
   ObjUpValue* upvalues;
 
   // Active Loop registers
-  Loop loopStack[LOOP_STACK_MAX];
+  Loop* loopStack;
   int loopStackCount;
+  int loopStackCapacity;
 
   // Active try-catch block registers
-  TryCatch tryCatchStack[TRY_CATCH_STACK_MAX];
+  TryCatch* tryCatchStack;
   int tryCatchStackCount;
+  int tryCatchStackCapacity;
 
   // Active switch block registers
-  Switch switchStack[SWITCH_STACK_MAX];
+  Switch* switchStack;
   int switchStackCount;
+  int switchStackCapacity;
+
+  // Pending System.log lines
+  OutputBuffer output;
+
+  // Set while the thread runs on behalf of an embedding host, uncaught errors
+  // jump back to the host instead of exiting the process
+  jmp_buf* uncaughtHandler;
+
+  // Green threads run on the scheduler carriers. Natives suspend them by
+  // setting suspending, run() then returns right after the call.
+  bool green;
+  bool suspending;
+  // Set along with suspending by natives that would block. Their callee and
+  // arguments are kept on the stack, and the native is called again on resume.
+  bool retrying;
+  NativeFn retryNative;
+  int retryArgCount;
+  bool retryIsMethod;
+  // Future the suspended thread waits for, NULL when it just yields. Its value
+  // replaces the call result on resume, or awaitingError is thrown.
+  ObjFuture* awaiting;
+  const char* awaitingError;
 } Thread;
 
 typedef struct ActiveThread {
@@ -121,10 +178,130 @@ typedef struct ActiveThread {
   pthread_t pthreadId;
   // Program thread
   Thread* program;
-  // Pointer to next active thread
+  // Settled with the program return value
+  ObjFuture* future;
+  // Future awaited before running, for continuations
+  ObjFuture* previous;
+  // Neighbours in vm.threads, unlinked in constant time
+  struct ActiveThread* prev;
   struct ActiveThread* next;
+  // Next green thread in the run queue or in a future waiters list
+  struct ActiveThread* nextReady;
 } ActiveThread;
 
+// Work submitted to the workers pool: function(start, end) is called for
+// every chunk of [0, count). Tasks live in the submitting thread, which waits
+// for all chunks to be done.
+typedef struct ParallelTask {
+  ObjClosure* function;
+  // Submitting frame namespace, shared by the workers entry frames
+  Table namespace;
+  // Chunks return values, in chunks order
+  ObjArray* results;
+  int count;
+  int chunkSize;
+  int chunksCount;
+  // Next chunk to be claimed by a worker
+  int nextChunk;
+  // Chunks not done yet
+  int pendingChunks;
+  // Pointer to next task in the queue
+  struct ParallelTask* next;
+} ParallelTask;
+
+// Worker threads are started on the first parallel operation and then kept
+// waiting for work, in a GC safezone.
+typedef struct {
+  // Guards the whole pool state
+  pthread_mutex_t mutex;
+  // Signaled when a task is submitted
+  pthread_cond_t workAvailable;
+  // Signaled when the last chunk of a task is done
+  pthread_cond_t taskDone;
+  // Tasks with chunks not claimed yet, in submission order
+  ParallelTask* tasks;
+  ParallelTask* lastTask;
+  int workersCount;
+  int idleWorkers;
+  // Set when the VM is freed, idle workers exit
+  bool stopping;
+} WorkersPool;
+
+// Green threads are multiplexed on a few carrier threads, started on demand
+// up to one per processor. Carriers only count as program threads while
+// running a green thread, suspended ones are just kept in vm.threads.
+typedef struct {
+  // Guards the whole scheduler state
+  pthread_mutex_t mutex;
+  // Signaled when a green thread is ready
+  pthread_cond_t readyAvailable;
+  // Signaled when a carrier exits
+  pthread_cond_t carrierDone;
+  // Run queue, in readiness order
+  ActiveThread* ready;
+  ActiveThread* lastReady;
+  int carriersCount;
+  // One carrier per processor
+  int carriersMax;
+  int idleCarriers;
+  // Set when the VM is freed, carriers exit once done with their slice
+  bool stopping;
+} Scheduler;
+
+// Green threads can't block their carrier, they wait for future instead and
+// retry. The future is settled on the next change to what they wait for, and
+// replaced by the next waiter. pending tells changes whether anyone waits.
+typedef struct {
+  // Guards future
+  pthread_mutex_t mutex;
+  ObjFuture* future;
+  atomic_bool pending;
+} Wakeup;
+
+// Timer of the event loop, settles its future with nil at deadline
+typedef struct {
+  // Monotonic clock seconds
+  double deadline;
+  ObjFuture* future;
+} EventTimer;
+
+// File descriptor watched by the event loop, settles its future with source
+// once ready
+typedef struct EventWatch {
+  // Own duplicate of the watched descriptor, the source may be closed
+  // meanwhile
+  int fd;
+  ObjFuture* future;
+  // File or descriptor number the watch was asked for
+  Value source;
+  struct EventWatch* previous;
+  struct EventWatch* next;
+} EventWatch;
+
+// Timers and file descriptors readiness are waited for by a single poller
+// thread, started on the first registration. It only sleeps in epoll_wait,
+// inside a GC safezone. Timers and watches are GC roots.
+typedef struct {
+  // Guards the whole event loop state
+  pthread_mutex_t mutex;
+  // Signaled when the poller exits
+  pthread_cond_t pollerDone;
+  // -1 until the poller is started
+  int epollFd;
+  // Written to wake up the poller, when the next deadline changes or when
+  // stopping
+  int wakeFd;
+  // Min heap by deadline
+  EventTimer* timers;
+  int timersCount;
+  int timersCapacity;
+  EventWatch* watches;
+  bool running;
+  // Set when the VM is freed, the poller exits and pending futures are never
+  // settled
+  bool stopping;
+} EventLoop;
+
 typedef struct ThreadLock {
   // id
   ObjString* id;
@@ -143,7 +320,15 @@ typedef struct ThreadSemaphore {
   struct ThreadSemaphore* next;
 } ThreadSemaphore;
 
-typedef struct {
+// Script loaded by an embedding host. Its variables outlive the run, so that
+// its functions can be called again.
+typedef struct Script {
+  Table namespace;
+  struct Script* previous;
+  struct Script* next;
+} Script;
+
+typedef struct VM {
   // The process of initializing the VM is complex and need the VM itself to
   // interpret some core functionalities. For this, we have a few states to
   // tweak the VM behavior a little:
@@ -160,7 +345,10 @@ typedef struct {
   // String interning table.
   // For performance sake, strings are interned and reused in case it appears
   // somewhere else in the code.
-  Table strings;
+  InterningTable strings;
+
+  // Standard output layer, every thread writes to its own buffer.
+  Output output;
 
   // Modules table that stores all simpl imported modules.
   // Native Modules (*) are written in C and common modules in Simpl.
@@ -168,6 +356,10 @@ typedef struct {
   // - priority-queue
   // - (*) threads
   // - (*) sync
+  // - (*) fs
+  // - (*) vector
+  // - (*) channel
+  // - (*) events
   Table modules;
 
   // Process main thread program
@@ -177,12 +369,35 @@ typedef struct {
   ActiveThread* threads;
   // A precise counter of operating system threads running.
   // So, it starts as 1 - because of the main thread.  
-  // This is not a correct proxy of the vm.threads count, since the VM keeps the opened
-  // threads metadata allocated until a pthread_join is called.  
+  // This is not a correct proxy of the vm.threads count, since threads are registered
+  // before their operating system thread starts.  
   uint32_t threadsCounter;
   // Counter used to assign threads unique ids and keep them trackable
   uint32_t threadsIdCounter;
 
+  // Worker threads running parallel operations
+  WorkersPool workers;
+
+  // Carrier threads running green threads
+  Scheduler scheduler;
+
+  // Timers and non-blocking I/O readiness
+  EventLoop events;
+
+  // Guards every future state. Waiters of any future sleep on futuresCond,
+  // which is broadcast whenever a future is settled.
+  pthread_mutex_t futuresMutex;
+  pthread_cond_t futuresCond;
+
+  // Threads blocked on channels sleep on channelsCond, which is broadcast
+  // when a channel they may wait on changes.
+  pthread_mutex_t channelsMutex;
+  pthread_cond_t channelsCond;
+  // Green threads blocked on channels wait for the same changes
+  Wakeup channelsWakeup;
+  // Green threads blocked on any semaphore, until the next post
+  Wakeup semaphoresWakeup;
+
   // Process critical sections locks linked list
   ThreadLock* locks;
   // Process semaphores linked list
@@ -207,6 +422,8 @@ typedef struct {
   ObjClass* metaSystemClass;
   // - Where Object static methods are defined
   ObjClass* metaObjectClass;
+  // - Where StringBuilder constructor is defined
+  ObjClass* metaStringBuilderClass;
 
   // Data Type Classes are superclasses of all data types
   // - Where nil literal inherits from
@@ -225,6 +442,24 @@ typedef struct {
   ObjClass* nativeFunctionClass;
   // - Where arrays inherits from
   ObjClass* arrayClass;
+  // - Where string builders inherits from
+  ObjClass* stringBuilderClass;
+  // - Where "fs" module files inherits from
+  ObjClass* fileClass;
+  // - Where "threads" module futures inherits from
+  ObjClass* futureClass;
+  // - Where "channel" module channels inherits from
+  ObjClass* channelClass;
+  // - Where "sync" module primitives inherits from, indexed by SyncKind
+  ObjClass* syncClasses[SYNC_KINDS];
+  // - Where atomic cells inherits from
+  ObjClass* atomicClass;
+  // - Where atomic arrays inherits from
+  ObjClass* atomicArrayClass;
+  // - Where "isolate" module isolates inherits from
+  ObjClass* isolateClass;
+  // - Where typed arrays inherits from, indexed by TypedArrayKind
+  ObjClass* typedArrayClasses[TYPED_ARRAY_KINDS];
   // - Standard Error class
   ObjClass* errorClass;
   // - Where exports objects inherits from
@@ -238,6 +473,24 @@ typedef struct {
   // Name for lambda functions
   ObjString* lambdaFunctionName;
 
+  // Isolate this process was spawned by, NULL until first asked for
+  ObjIsolate* parentIsolate;
+
+  // Entry script path, NULL in repl mode. Isolate paths are resolved from it.
+  char* entryPath;
+
+  // Interpreter spawned by isolates, NULL when isolates are unavailable
+  char* isolateExecutable;
+
+  // Compilers chain of the thread compiling, marked as GC roots. NULL when
+  // not compiling.
+  struct Compiler** compiler;
+
+  // Scripts loaded by the embedding host, their namespaces are GC roots
+  Script* scripts;
+  // Last error reported to the embedding host, NULL if none
+  char* hostError;
+
   // Only one thread can allocate memory at a time, in order to avoid complications with the GC.
   // This mutex is used to guarantee mutual exclusion between threads.
   pthread_mutex_t memoryAllocationMutex;
@@ -275,8 +528,9 @@ typedef struct {
   // Indicate whether a memory allocation triggered the GC
   bool GCTriggered;
   //
-  // Indicate whether a GC thread is spawned
-  bool GCThreadSpawned;
+  // Indicate whether a GC thread is spawned. Set under GCMutex, but read
+  // without it on every instruction.
+  atomic_bool GCThreadSpawned;
   //
   // Only one thread can manipulate the GC fields at a time.
   // Program threads updates the stop-the-world safezone counter.
@@ -323,9 +577,14 @@ typedef enum {
   INTERPRET_OK,
   INTERPRET_COMPILE_ERROR,
   INTERPRET_RUNTIME_ERROR,
+  // Green thread suspended, run() resumes it
+  INTERPRET_SUSPENDED,
 } InterpretResult;
 
-extern VM vm;
+// VM the calling thread runs on. Every global VM state is reached through
+// it, so that one process can host several independent VMs.
+extern _Thread_local VM* currentVM;
+#define vm (*currentVM)
 
 #define IS_FRAME_MODULE(frame) ((frame)->type == FRAME_TYPE_MODULE)
 #define IS_FRAME_CLOSURE(frame) ((frame)->type == FRAME_TYPE_CLOSURE)
@@ -333,14 +592,31 @@ extern VM vm;
 #define FRAME_AS_MODULE(frame) ((frame)->as.module)
 #define FRAME_AS_CLOSURE(frame) ((frame)->as.closure)
 
-void initVM();
+// Creates a VM, current on the calling thread from then on
+VM* newVM();
+// Makes machine current on the calling thread, a host thread may switch
+// between VMs while none of them is running on it
+void setCurrentVM(VM* machine);
 void initProgram(Thread* program);
 void freeProgram(Thread* program);
-void freeVM();
+// Threads started by the VM must be done, workers are stopped
+void freeVM(VM* machine);
 InterpretResult interpret(const char* source, char* absPath);
+// Compiles and runs source once, keeping its variables for later calls. NULL
+// on errors, described by vm.hostError.
+Script* loadScript(const char* source, char* absPath, InterpretResult* result);
+// Calls a function of a loaded script, without recompiling anything
+InterpretResult callScript(Script* script, Value callee, int argCount,
+                           const Value* args, Value* result);
+void unloadScript(Script* script);
 bool callEntry(Thread* thread, ObjClosure* closure);
+bool callSharedEntry(Thread* thread, ObjClosure* closure, Table* namespace,
+                     int argCount);
 void recoverableRuntimeError(Thread* program, const char* format, ...);
 InterpretResult run(Thread* program);
+// Calls again the native a green thread suspended in to retry, its result
+// replaces the callee and arguments as for the first call
+bool retryNativeCall(Thread* program);
 void push(Thread* program, Value value);
 Value pop(Thread* program);
 Value peek(Thread* program, int distance);
@@ -0,0 +1,119 @@
+// Embedding API: scripts are loaded once and their functions called many
+// times, host natives are called back, errors are reported to the host.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simpl.h"
+
+#define CALLS 10000
+
+#define EXPECT(condition)                                               \
+  do {                                                                  \
+    if (!(condition)) {                                                 \
+      fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__,       \
+              #condition);                                              \
+      return 1;                                                         \
+    }                                                                   \
+  } while (false)
+
+static bool hostScale(void* thread, int argCount, SimplValue* args) {
+  return simplReturn(thread, simplNumber(simplAsNumber(args[1]) * 10));
+}
+
+static bool hostFail(void* thread, int argCount, SimplValue* args) {
+  return simplThrow(thread, "Host failure.");
+}
+
+static const char* source =
+    "import Rules from \"rules\";\n"
+    "import Isolate from \"isolate\";\n"
+    "var calls = 0;\n"
+    "fun score(a, b) { calls += 1; return scale(a) + b; }\n"
+    "fun label(name) { return \"rule \" + name; }\n"
+    "fun prefix(text) { return text.substr(0, 3); }\n"
+    "fun caught() { try { Rules.fail(); } catch (err) { return err.message; } }\n"
+    "fun boom() { Rules.fail(); }\n"
+    "fun count() { return calls; }\n"
+    "fun spawn() {\n"
+    "  try { return Isolate.spawn(\"/dev/null\").wait(); }\n"
+    "  catch (err) { return err.message; }\n"
+    "}\n";
+
+int main() {
+  SimplVM* machine = simplNewVM();
+  EXPECT(simplDefineFunction(machine, "scale", hostScale, 1));
+  EXPECT(simplDefineModuleFunction(machine, "rules", "fail", hostFail, 0));
+  EXPECT(!simplDefineFunction(machine, "wide", hostScale, 16));
+
+  SimplScript* script;
+  EXPECT(simplLoad(machine, source, NULL, &script) == SIMPL_OK);
+
+  SimplValue score, label, prefix, caught, boom, count, spawn, result;
+  EXPECT(simplGetGlobal(machine, script, "score", &score));
+  EXPECT(simplGetGlobal(machine, script, "label", &label));
+  EXPECT(simplGetGlobal(machine, script, "prefix", &prefix));
+  EXPECT(simplGetGlobal(machine, script, "caught", &caught));
+  EXPECT(simplGetGlobal(machine, script, "boom", &boom));
+  EXPECT(simplGetGlobal(machine, script, "count", &count));
+  EXPECT(simplGetGlobal(machine, script, "spawn", &spawn));
+  EXPECT(!simplGetGlobal(machine, script, "missing", &result));
+
+  // Calls reuse the loaded script, its variables persist between them
+  for (int idx = 0; idx < CALLS; idx++) {
+    SimplValue args[2] = {simplNumber(idx), simplNumber(2)};
+    EXPECT(simplCall(machine, script, score, 2, args, &result) == SIMPL_OK);
+    EXPECT(simplAsNumber(result) == idx * 10 + 2);
+  }
+  EXPECT(simplCall(machine, script, count, 0, NULL, &result) == SIMPL_OK);
+  EXPECT(simplAsNumber(result) == CALLS);
+
+  int length;
+  SimplValue name = simplString(machine, "alpha", 5);
+  EXPECT(simplCall(machine, script, label, 1, &name, &result) == SIMPL_OK);
+  EXPECT(simplIsString(result));
+  EXPECT(strcmp(simplAsString(machine, result, &length), "rule alpha") == 0);
+  EXPECT(length == 10);
+
+  // Slices are handed to the host as C strings
+  SimplValue text = simplString(machine, "abcdefgh", 8);
+  EXPECT(simplCall(machine, script, prefix, 1, &text, &result) == SIMPL_OK);
+  EXPECT(strcmp(simplAsString(machine, result, NULL), "abc") == 0);
+
+  EXPECT(simplCall(machine, script, caught, 0, NULL, &result) == SIMPL_OK);
+  EXPECT(strcmp(simplAsString(machine, result, NULL), "Host failure.") == 0);
+
+  // Uncaught errors fail the call only, the VM keeps working
+  EXPECT(simplCall(machine, script, boom, 0, NULL, &result) ==
+         SIMPL_RUNTIME_ERROR);
+  EXPECT(simplIsNil(result));
+  EXPECT(strstr(simplError(machine), "Host failure.") != NULL);
+
+  EXPECT(simplCall(machine, script, score, 1, &text, &result) ==
+         SIMPL_RUNTIME_ERROR);
+  EXPECT(simplCall(machine, script, count, 0, NULL, &result) == SIMPL_OK);
+  EXPECT(simplAsNumber(result) == CALLS);
+
+  // Isolates never run the host executable, only the interpreter it sets
+  EXPECT(simplCall(machine, script, spawn, 0, NULL, &result) == SIMPL_OK);
+  EXPECT(simplIsString(result));
+  EXPECT(strstr(simplAsString(machine, result, NULL), strerror(ENOSYS)) !=
+         NULL);
+  simplSetIsolateExecutable(machine, "/bin/true");
+  EXPECT(simplCall(machine, script, spawn, 0, NULL, &result) == SIMPL_OK);
+  EXPECT(simplIsNumber(result) && simplAsNumber(result) == 0);
+
+  SimplScript* failed;
+  EXPECT(simplLoad(machine, "fun (", NULL, &failed) == SIMPL_COMPILE_ERROR);
+  EXPECT(failed == NULL);
+  EXPECT(simplLoad(machine, "var x = missing;", NULL, &failed) ==
+         SIMPL_RUNTIME_ERROR);
+  EXPECT(strstr(simplError(machine), "Undefined variable 'missing'") != NULL);
+
+  simplUnload(machine, script);
+  simplFreeVM(machine);
+
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,87 @@
+// Several VMs in one process: VMs are created, used and freed concurrently
+// on host threads, and VMs sharing a thread keep their globals apart.
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "simpl.h"
+
+#define THREADS 4
+#define ROUNDS 5
+
+static const char* source =
+    "var sum = 0;\n"
+    "for (var idx = 0; idx < 100000; idx = idx + 1) sum = sum + idx;\n"
+    "var doubled = Array(1000).map((value, idx) -> idx).parallelMap((n) -> n * 2);\n"
+    "var text = \"\";\n"
+    "for (var idx = 0; idx < 1000; idx = idx + 1) text = text + \"ab\";\n"
+    "fun total() { return sum + doubled[999] + text.length(); }\n";
+
+// 4999950000 + 1998 + 2000
+static const double expected = 4999953998;
+
+static bool runRound() {
+  SimplVM* machine = simplNewVM();
+  SimplScript* script;
+  SimplValue total, result;
+
+  bool ok = simplLoad(machine, source, NULL, &script) == SIMPL_OK &&
+            simplGetGlobal(machine, script, "total", &total) &&
+            simplCall(machine, script, total, 0, NULL, &result) == SIMPL_OK &&
+            simplAsNumber(result) == expected;
+
+  simplFreeVM(machine);
+  return ok;
+}
+
+static void* runRounds(void* failures) {
+  for (int round = 0; round < ROUNDS; round++) {
+    if (!runRound()) ++*(int*)failures;
+  }
+
+  return NULL;
+}
+
+static bool readNumber(SimplVM* machine, SimplScript* script,
+                       const char* name, double expectedValue) {
+  SimplValue value;
+
+  return simplGetGlobal(machine, script, name, &value) &&
+         simplIsNumber(value) && simplAsNumber(value) == expectedValue;
+}
+
+int main() {
+  pthread_t threads[THREADS];
+  int failures[THREADS] = {0};
+
+  for (int idx = 0; idx < THREADS; idx++) {
+    pthread_create(&threads[idx], NULL, runRounds, &failures[idx]);
+  }
+  for (int idx = 0; idx < THREADS; idx++) {
+    pthread_join(threads[idx], NULL);
+    if (failures[idx] > 0) {
+      fprintf(stderr, "host thread %d: %d failed rounds\n", idx,
+              failures[idx]);
+      return 1;
+    }
+  }
+
+  // Same names, different VMs
+  SimplVM* first = simplNewVM();
+  SimplVM* second = simplNewVM();
+  SimplScript *firstScript, *secondScript;
+
+  if (simplLoad(first, "var x = 1;", NULL, &firstScript) != SIMPL_OK ||
+      simplLoad(second, "var x = 2;", NULL, &secondScript) != SIMPL_OK ||
+      !readNumber(first, firstScript, "x", 1) ||
+      !readNumber(second, secondScript, "x", 2)) {
+    fprintf(stderr, "VMs share their globals\n");
+    return 1;
+  }
+
+  simplFreeVM(first);
+  simplFreeVM(second);
+
+  printf("ok\n");
+  return 0;
+}